@@ -0,0 +1,14 @@
+#!/usr/bin/python3
+
+import sys
+import time
+
+# Writes five lines 0.4 seconds apart, flushing each, to show output
+# streaming and that other clients are served meanwhile
+print("Content-Type: text/plain")
+print()
+sys.stdout.flush()
+for i in range(5):
+    print(f"line {i}")
+    sys.stdout.flush()
+    time.sleep(0.4)
@@ -0,0 +1,35 @@
+#ifndef BODYSINK_HPP
+#define BODYSINK_HPP
+
+#include "HttpResponse.hpp"
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+/*
+ * Destination of a request body that is consumed while it arrives
+ * instead of being buffered whole. The connection handler feeds it the
+ * body bytes in order, then calls finish() once Content-Length bytes
+ * were delivered, or abort() if the client goes away first.
+ */
+class BodySink {
+public:
+    virtual ~BodySink() {}
+
+    // Returns false on failure; getErrorCode() tells which status to send
+    virtual bool write(const char* data, size_t size) = 0;
+    virtual bool finish() = 0;
+    virtual void abort() = 0;
+
+    virtual int getErrorCode() const = 0;
+    virtual HttpResponse buildResponse() const = 0;
+
+    // Sinks that store bytes unchanged may take them off the socket
+    // themselves, without copying them through user space
+    virtual bool canSplice() const;
+    virtual ssize_t spliceFrom(int socket_fd, size_t max_bytes);
+
+    static bool syncDirectory(const std::string& path);
+};
+
+#endif
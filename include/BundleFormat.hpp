@@ -0,0 +1,46 @@
+#ifndef BUNDLEFORMAT_HPP
+#define BUNDLEFORMAT_HPP
+
+#include <stdint.h>
+
+/*
+ * On-disk layout of a static site bundle, written by webserv-pack
+ * A bundle is a header, an index of fixed-size entries sorted bytewise by
+ * path, a string table (paths, Content-Types, ETags) and the file bodies.
+ * The body section starts on a page boundary and bodies of a page or more
+ * start on their own page, so the server can mmap the whole file and hand
+ * out pointers into it. Integers are in host byte order.
+ */
+namespace BundleFormat {
+
+static const char MAGIC[8] = { 'W', 'S', 'P', 'A', 'C', 'K', '0', '1' };
+static const uint32_t VERSION = 1;
+static const uint64_t PAGE_SIZE = 4096;
+static const uint64_t BODY_ALIGNMENT = 16;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t index_offset;     // Entry[entry_count]
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t file_size;        // whole bundle, for truncation checks
+};
+
+struct Entry {
+    uint32_t path_offset;      // string table offsets and lengths
+    uint32_t path_length;
+    uint32_t type_offset;
+    uint32_t type_length;
+    uint32_t etag_offset;
+    uint32_t etag_length;
+    uint64_t body_offset;      // file offsets and sizes
+    uint64_t body_size;
+    uint64_t gzip_offset;
+    uint64_t gzip_size;        // 0 when there is no gzip variant
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef CGIPOOL_HPP
+#define CGIPOOL_HPP
+
+#include "CgiProcess.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <ctime>
+
+/*
+ * Warm CGI workers for one location, set up by "cgi_pool size=N idle=M"
+ * At most N scripts of the location run at once; later requests wait in
+ * line. Up to M workers are started ahead of time and wait to be told
+ * which script to run, so a request only pays for the execve(); when
+ * none is left the script is spawned the usual way. Workers used up are
+ * replaced by fill() from the event loop, between requests.
+ * Occupancy and waiting times are logged every REPORT_INTERVAL seconds
+ * while the pool is in use.
+ */
+class CgiPool {
+public:
+    static const size_t MAX_SIZE = 256;
+    static const time_t REPORT_INTERVAL = 10;
+
+private:
+    // A request waiting for a free slot
+    struct Launch {
+        CgiProcess* process;
+        std::string interpreter;
+        std::string script;
+        CgiProcess::Environment env;
+        std::string body;
+        long queued_at;                   // milliseconds, monotonic
+    };
+
+    std::string _name;                    // location path, for the log
+    size_t _size;
+    size_t _idle_target;
+    std::vector<CgiProcess::Worker> _idle;
+    std::set<const CgiResponder*> _running;
+    std::deque<Launch> _waiting;
+
+    // Counted since the last report
+    unsigned long _started;
+    unsigned long _warm_starts;
+    unsigned long _waited;
+    long _wait_total;                     // milliseconds
+    long _wait_max;
+    size_t _peak_running;
+    size_t _peak_waiting;
+    time_t _last_report;
+
+    bool launch(CgiProcess* process, const std::string& interpreter, const std::string& script,
+                const CgiProcess::Environment& env, const std::string& body);
+    void dispatch();
+
+    CgiPool(const CgiPool& other);
+    CgiPool& operator=(const CgiPool& other);
+
+public:
+    CgiPool(const std::string& name, size_t size, size_t idle);
+    ~CgiPool();
+
+    bool submit(CgiProcess* process, const std::string& interpreter, const std::string& script,
+                const CgiProcess::Environment& env, const std::string& body);
+    void release(const CgiResponder* responder);
+    void fill();
+    void reap();
+    void report(time_t now);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef CGIPROCESS_HPP
+#define CGIPROCESS_HPP
+
+#include "CgiResponder.hpp"
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * A CGI script running as a child process
+ * Its stdin and stdout are non-blocking pipes that the event loop polls
+ * next to the sockets: the request body is written as the pipe accepts
+ * it and the output collected as it arrives, so a slow script only
+ * holds up its own client. The child is reaped once SIGCHLD reports it.
+ * Scripts are started with posix_spawn(), which does not copy the
+ * server's memory; a pool can also start workers ahead of time and hand
+ * them the script later.
+ */
+class CgiProcess : public CgiResponder {
+public:
+    // Argument that makes the server binary run as a pool worker
+    static const char* const WORKER_FLAG;
+    static const int WORKER_CONTROL_FD = 3;
+
+    // A worker waiting on its control pipe for the script to run
+    struct Worker {
+        pid_t pid;
+        int input_fd;
+        int output_fd;
+        int control_fd;
+    };
+
+    // Variables prepared once for the location, then those of the request
+    struct Environment {
+        const std::vector<std::string>* shared;   // NULL if there are none
+        std::vector<std::string> request;
+    };
+
+private:
+    pid_t _pid;
+    int _input_fd;                // script's stdin, -1 once the body is in
+    int _output_fd;               // script's stdout, -1 after end of file
+    std::string _input;
+    size_t _input_sent;
+    bool _exited;
+    int _status;
+
+    void closeInput();
+    void closeOutput();
+    void writeInput();
+    void readOutput();
+    void setExitStatus(int status);
+
+public:
+    CgiProcess();
+    ~CgiProcess();
+
+    bool start(const std::string& interpreter, const std::string& script,
+               const Environment& env, const std::string& body);
+    bool start(Worker& worker, const std::string& interpreter, const std::string& script,
+               const Environment& env, const std::string& body);
+
+    void getPollFds(std::vector<pollfd>& fds) const;
+    bool handleEvent(int fd, short revents);
+    void reap();
+    bool isOutputComplete() const;
+    bool isFinished() const;
+    bool succeeded() const;
+    int getErrorStatus() const;
+    void abort();
+    std::string describe() const;
+
+    pid_t getPid() const;
+
+    static bool spawnWorker(Worker& worker);
+    static int runWorker();
+    static void retireWorker(Worker& worker);
+    static int openChildSignalFd();
+    static void drainChildSignals(int fd);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef CGIRESPONDER_HPP
+#define CGIRESPONDER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ctime>
+#include <poll.h>
+
+/*
+ * Something that answers a request the CGI way: a header block, a blank
+ * line, then the body. A script run as a child process and a request
+ * passed to a FastCGI worker both produce that output; the connection
+ * handler streams it to the client the same way.
+ * The header block is parsed as soon as it ends; body output is then
+ * handed out piece by piece with takeOutput().
+ */
+class CgiResponder {
+public:
+    typedef std::pair<std::string, std::string> HeaderField;
+
+    static const time_t TIMEOUT = 30;               // seconds without output before giving up
+    static const size_t MAX_HEADER_SIZE = 65536;    // longer "headers" are taken as body
+    static const size_t OUTPUT_BUFFER = 262144;     // unsent output at which reading pauses
+
+private:
+    std::string _header_block;    // output until the blank line ending the headers
+    size_t _header_scan;          // start of the first header line not parsed yet
+    std::vector<HeaderField> _headers;
+    bool _headers_done;
+    std::string _output;          // body output not taken yet
+    time_t _activity_time;        // start, then last output
+    bool _updated;                // something changed since takeUpdate()
+    bool _output_paused;          // client is behind, stop reading
+
+    void parseHeaderLines();
+    void endHeaders(size_t body_start);
+
+    CgiResponder(const CgiResponder& other);
+    CgiResponder& operator=(const CgiResponder& other);
+
+protected:
+    void appendOutput(const char* data, size_t size);
+    void endOutput();
+    void touch();
+    void markUpdated();
+    size_t bufferedOutput() const;
+
+public:
+    CgiResponder();
+    virtual ~CgiResponder();
+
+    // Descriptors of its own to poll; a FastCGI request shares its pool's
+    virtual void getPollFds(std::vector<pollfd>& fds) const = 0;
+    // Handles poll events on fd; returns false if fd is not one of its own
+    virtual bool handleEvent(int fd, short revents) = 0;
+    // Checks whether it has ended on its own (a child that exited)
+    virtual void reap() = 0;
+    virtual bool isOutputComplete() const = 0;
+    virtual bool isFinished() const = 0;
+    virtual bool succeeded() const = 0;
+    virtual int getErrorStatus() const = 0;
+    virtual void abort() = 0;
+    virtual std::string describe() const = 0;
+
+    bool hasHeaders() const;
+    const std::vector<HeaderField>& getHeaders() const;
+    std::string takeOutput();
+    time_t getLastActivityTime() const;
+    bool takeUpdate();
+    void setOutputPaused(bool paused);
+    bool isOutputPaused() const;
+};
+
+#endif
@@ -1,17 +1,25 @@
 #ifndef CLIENTDATA_HPP
 #define CLIENTDATA_HPP
 
+#include "SharedBuffer.hpp"
+#include "VirtualHostTable.hpp"
 #include <string>
+#include <deque>
 #include <ctime>
+#include <sys/uio.h>
 
 class ClientData {
 private:
     std::string _read_buffer;
-    std::string _write_buffer;
-    size_t _bytes_sent;
+    std::deque<SharedBuffer> _output_queue; // response segments waiting to be sent
+    size_t _output_offset;                  // bytes of the front segment already sent
+    size_t _output_size;                    // unsent bytes across the whole queue
     time_t _connection_time;
     time_t _last_activity_time;
     bool _keep_alive;
+    const VirtualHostTable* _virtual_hosts; // server blocks on the listener it arrived on
+    size_t _server_index;                   // server block handling the current request
+    std::string _remote_addr;               // peer IP address, for CGI
 
 public:
     ClientData();
@@ -19,17 +27,21 @@ public:
     
     // Getters
     const std::string& getReadBuffer() const;
-    const std::string& getWriteBuffer() const;
-    size_t getBytesSent() const;
+    bool hasPendingOutput() const;
+    size_t getPendingOutputSize() const;
     time_t getConnectionTime() const;
     time_t getLastActivityTime() const;
     bool isKeepAlive() const;
+    const VirtualHostTable* getVirtualHosts() const;
+    size_t getServerIndex() const;
+    const std::string& getRemoteAddr() const;
     
     // Setters
     void setReadBuffer(const std::string& buffer);
-    void setWriteBuffer(const std::string& buffer);
-    void setBytesSent(size_t bytes_sent);
     void setKeepAlive(bool keep_alive);
+    void setVirtualHosts(const VirtualHostTable* virtual_hosts);
+    void setServerIndex(size_t server_index);
+    void setRemoteAddr(const std::string& remote_addr);
     void resetConnectionTime();
     void updateLastActivity();
     
@@ -37,7 +49,12 @@ public:
     void appendToReadBuffer(const std::string& data);
     void appendToReadBuffer(const char* data, size_t size);
     void clearReadBuffer();
-    void clearWriteBuffer();
+    
+    // Output queue operations
+    void queueOutput(const SharedBuffer& buffer);
+    size_t fillOutputVector(struct iovec* iov, size_t max_segments) const;
+    void consumeOutput(size_t bytes);
+    void clearOutput();
 };
 
 #endif
\ No newline at end of file
@@ -7,11 +7,15 @@
 #include "ConfigValidator.hpp"
 #include <string>
 #include <vector>
+#include <map>
 
 class ConfigParser {
 private:
     ConfigTokenizer _tokenizer;
     ConfigValidator _validator;
+    std::string _config_dir;                          // base for relative include paths
+    size_t _include_count;
+    std::map<std::string, std::string> _global_types; // top-level types, for every server
     
     bool expectToken(const std::string& expected);
     void skipExtraSemicolons();
@@ -22,6 +26,9 @@ private:
     Location parseLocationBlock();
     std::vector<std::string> parseStringList();
     std::vector<std::string> parseHttpMethods();
+    bool parseTypesBlock(std::map<std::string, std::string>& types);
+    bool parseInclude();
+    static bool parseSize(const std::string& value, size_t& size);
     
     std::string getCurrentToken();
     std::string getNextToken();
@@ -29,6 +29,7 @@ public:
     const std::vector<std::string>& getTokens() const;
     size_t getCurrentPosition() const;
     void setPosition(size_t position);
+    void insertTokens(const std::vector<std::string>& tokens);
 };
 
 #endif
\ No newline at end of file
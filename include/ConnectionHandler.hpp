@@ -6,27 +6,113 @@
 #include "HttpRequest.hpp"
 #include "HttpResponse.hpp"
 #include "ServerConfig.hpp"
+#include "ServerContext.hpp"
+#include "FileCache.hpp"
+#include "DirectoryListingCache.hpp"
+#include "FileWatcher.hpp"
+#include "StatCache.hpp"
+#include "IndexCache.hpp"
+#include "NegativeCache.hpp"
+#include "BodySink.hpp"
+#include "ContentHash.hpp"
+#include "CgiProcess.hpp"
+#include "FastCgiPool.hpp"
+#include "CgiPool.hpp"
 #include <map>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <poll.h>
 
 class ConnectionHandler {
 private:
+    // Request body consumed while it arrives instead of being buffered
+    struct BodyStream {
+        BodySink* sink;        // NULL once the request failed; the rest is discarded
+        size_t remaining;      // body bytes still expected
+        bool keep_alive;
+    };
+    
+    // CGI script or FastCGI request answering a parked client
+    struct CgiJob {
+        CgiResponder* responder;
+        int client_sock;       // -1 once the client is gone; a child still has to be reaped
+        bool keep_alive;
+        bool can_chunk;        // client speaks HTTP/1.1
+        bool head_sent;        // status line and headers are queued, body follows
+        bool chunked;
+        bool has_length;       // script sent Content-Length, passed through
+        size_t remaining;      // body bytes still allowed with has_length
+    };
+    
     std::map<int, ClientData> _clients;
     SocketManager _socket_manager;
     const std::vector<ServerConfig>* _server_configs;
+    std::vector<ServerContext*> _server_contexts; // One per server config, same order
+    ServerContext* _active_server;                // server block of the request being handled
+    const ClientData* _active_client;             // client whose request is being handled
+    std::map<int, VirtualHostTable*> _listeners;  // server blocks per listening socket
+    FileCache _file_cache;
+    DirectoryListingCache _listing_cache;
+    FileWatcher _file_watcher;                    // reports changes under the location roots
+    StatCache _stat_cache;                        // valid until the watcher says otherwise
+    IndexCache _index_cache;                      // index file per directory version
+    NegativeCache _missing_paths;                 // recent misses, answered with the prepared 404
+    std::map<int, BodyStream> _body_streams;      // uploads in progress, per client socket
+    std::map<unsigned long, CgiJob> _cgi_jobs;    // running scripts and FastCGI requests, by job number
+    std::map<int, unsigned long> _cgi_clients;    // parked client -> job it waits for
+    unsigned long _next_cgi_job;
+    CgiResponder* _started_cgi;                   // set by executeCgiScript/passToFastCgi, parked by processClientData
+    FastCgiPool _fastcgi;                         // connections to fastcgi_pass workers
+    std::map<const Location*, CgiPool*> _cgi_pools; // warm workers of cgi_pool locations
+    int _child_signal_fd;                         // signalfd for SIGCHLD, -1 if there is none
+    
+    void clearServerContexts();
+    void watchDocumentRoots();
+    void invalidatePath(const std::string& path);
+    bool statPath(const std::string& path, struct stat& st);
+    void selectServer(const ClientData& client);
+    void selectVirtualHost(ClientData& client, const HttpRequest& request);
     
     HttpResponse processHttpRequest(const HttpRequest& request);
     void processClientData(int client_sock, const char* buffer, ssize_t bytes_read);
+    BodySink* createBodySink(const HttpRequest& request);
+    bool startBodyStream(int client_sock, const HttpRequest& request, const std::string& accumulated_data);
+    void feedBodyStream(int client_sock, const char* data, size_t size);
+    void spliceBodyStream(int client_sock, BodyStream& stream);
+    void finishBodyStream(int client_sock);
+    void failBodyStream(int client_sock, BodyStream& stream);
+    void dropBodyStream(int client_sock);
+    void parkClient(int client_sock, const HttpRequest& request, bool keep_alive);
+    void sendCgiHead(CgiJob& job, ClientData& client);
+    void pumpCgiJob(std::map<unsigned long, CgiJob>::iterator job, std::vector<int>& ready_clients);
+    void dropCgiJob(int client_sock);
+    void finishCgiJob(std::map<unsigned long, CgiJob>::iterator job);
+    HttpResponse buildCgiHead(const CgiResponder& responder) const;
     const Location* findMatchingLocation(const std::string& uri) const;
     std::string sanitizePath(const std::string& path) const;
-    std::string getMimeType(const std::string& path) const;
+    std::string buildFilePath(const Location* location, const std::string& uri) const;
     const ServerConfig* getCurrentServerConfig(int client_sock) const;
-    HttpResponse executeCgiScript(const std::string& script_path, const std::string& interpreter_path, 
-                                  const HttpRequest& request, const std::string& file_path) const;
+    bool findCgiScript(const Location* location, const std::string& uri,
+                       std::string& script_uri, std::string& path_info);
+    HttpResponse executeCgiScript(const Location* location, const std::string& script_uri,
+                                  const std::string& path_info, const HttpRequest& request);
+    HttpResponse passToFastCgi(const Location* location, const HttpRequest& request, const std::string& uri);
     HttpResponse handleFileUpload(const HttpRequest& request, const Location* location, const std::string& uri);
+    std::string uploadTarget(const Location* location, const std::string& uri) const;
+    static std::string generateUploadName(const std::string& prefix, const std::string& suffix);
+    static ExpectedDigest expectedDigest(const HttpRequest& request);
+    std::map<std::string, std::string> requestVariables(const Location* location, const std::string& script_uri,
+                                                        const std::string& path_info,
+                                                        const HttpRequest& request) const;
     HttpResponse createErrorResponse(int error_code) const;
+    HttpResponse serveFile(const std::string& path, const struct stat& st);
+    bool resolveIndex(const std::string& dir_path, const struct stat& dir_st, const Location* location,
+                      std::string& index_path, struct stat& index_st);
+    HttpResponse serveBundled(const StaticBundle& bundle, const Location* location,
+                              const HttpRequest& request, const std::string& uri);
+    void queueResponse(ClientData& client, const HttpResponse& response);
     std::string urlDecode(const std::string& encoded) const;
 
 public:
@@ -34,6 +120,7 @@ public:
     ~ConnectionHandler();
     
     void setServerConfigs(const std::vector<ServerConfig>& configs);
+    void addListenerServer(int listen_sock, size_t server_index);
     
     int acceptNewConnection(int listen_sock);
     void handleClientRead(int client_sock);
@@ -42,6 +129,14 @@ public:
     void closeAllClients(); // New method for cleanup
     std::vector<int> checkEmptyRequestTimeouts(); // Check for clients with empty/incomplete request timeouts, returns clients needing POLLOUT
     
+    int getWatcherFd() const;
+    void handleFileEvents();
+    
+    int getChildSignalFd() const;
+    void getCgiPollFds(std::vector<pollfd>& fds);
+    std::vector<int> handleCgiEvent(int fd, short revents);
+    std::vector<int> reapCgiChildren();
+    
     bool hasClient(int client_sock) const;
     ClientData& getClient(int client_sock);
     const ClientData& getClient(int client_sock) const;
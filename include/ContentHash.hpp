@@ -0,0 +1,130 @@
+#ifndef CONTENTHASH_HPP
+#define CONTENTHASH_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * SHA-256 (FIPS 180-4), fed incrementally
+ * Uses the x86 SHA extensions when the CPU has them
+ */
+class Sha256 {
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+private:
+    uint32_t _state[8];
+    unsigned char _block[64];
+    size_t _block_size;           // bytes waiting in _block
+    uint64_t _length;             // bytes fed so far
+
+    void compress(const unsigned char* data, size_t count);
+
+public:
+    Sha256();
+    void update(const char* data, size_t size);
+    void finish(unsigned char digest[DIGEST_SIZE]);
+};
+
+/*
+ * MD5 (RFC 1321), only kept to check Content-MD5
+ */
+class Md5 {
+public:
+    static const size_t DIGEST_SIZE = 16;
+
+private:
+    uint32_t _state[4];
+    unsigned char _block[64];
+    size_t _block_size;
+    uint64_t _length;
+
+    void compress(const unsigned char* block);
+
+public:
+    Md5();
+    void update(const char* data, size_t size);
+    void finish(unsigned char digest[DIGEST_SIZE]);
+};
+
+/*
+ * CRC-32C (Castagnoli), with the SSE4.2 crc32 instruction or else eight
+ * bytes at a time with slicing-by-8 tables
+ */
+class Crc32c {
+private:
+    uint32_t _crc;
+
+    static uint32_t _table[8][256];
+    static bool _table_ready;
+    static void buildTable();
+
+public:
+    Crc32c();
+    void update(const char* data, size_t size);
+    uint32_t value() const;
+};
+
+/*
+ * The hashes the server reports for an uploaded byte stream: SHA-256 and
+ * CRC-32C, plus MD5 when the client sent a Content-MD5 to check against.
+ * Bytes are fed while they are stored, so nothing has to be read again
+ * once the upload is complete.
+ */
+class ContentHash {
+private:
+    Sha256 _sha256;
+    Crc32c _crc32c;
+    Md5 _md5;
+    bool _with_md5;
+    bool _finished;
+    uint64_t _size;
+    unsigned char _sha256_digest[Sha256::DIGEST_SIZE];
+    unsigned char _md5_digest[Md5::DIGEST_SIZE];
+
+public:
+    explicit ContentHash(bool with_md5 = false);
+
+    void reset(bool with_md5);
+    void update(const char* data, size_t size);
+    void finish();
+
+    bool isFinished() const;
+    uint64_t getSize() const;
+    std::string sha256Hex() const;
+    std::string crc32cHex() const;
+    std::string digest(const std::string& algorithm) const;
+
+    std::string etag() const;
+    std::string digestHeader() const;
+
+    static std::string toHex(const unsigned char* data, size_t size);
+    static std::string base64Encode(const unsigned char* data, size_t size);
+    static bool base64Decode(const std::string& text, std::string& bytes);
+};
+
+/*
+ * Digests a client sent for the content of its request, from
+ * Content-Digest (RFC 9530: sha-256, crc32c or md5, other algorithms are
+ * ignored) and Content-MD5. Values are kept as raw bytes.
+ */
+class ExpectedDigest {
+private:
+    std::map<std::string, std::string> _digests;    // algorithm -> bytes
+    bool _valid;
+
+    bool add(const std::string& algorithm, const std::string& encoded);
+
+public:
+    ExpectedDigest();
+    ExpectedDigest(const std::string& content_digest, const std::string& content_md5);
+
+    bool isValid() const;
+    bool isEmpty() const;
+    bool wantsMd5() const;
+    bool matches(const ContentHash& hash) const;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef DIRECTORYLISTINGCACHE_HPP
+#define DIRECTORYLISTINGCACHE_HPP
+
+#include "SharedBuffer.hpp"
+#include "Location.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <sys/stat.h>
+
+/*
+ * Cache of rendered autoindex listings
+ * Directories are read with getdents64 in large batches and rendered
+ * once into shared chunks of about CHUNK_SIZE bytes, which responses queue
+ * by reference. An entry is keyed by directory, format, sort order and
+ * request URI, and is dropped when the directory's mtime changes.
+ */
+class DirectoryListingCache {
+public:
+    static const size_t CHUNK_SIZE = 32 * 1024;
+    static const size_t MAX_LISTINGS = 256;
+    static const size_t MAX_TOTAL_SIZE = 32 * 1024 * 1024;
+
+private:
+    typedef std::pair<std::string, bool> DirEntry; // name, is directory
+
+    struct Entry {
+        std::vector<SharedBuffer> chunks;
+        size_t size;
+        dev_t device;
+        ino_t inode;
+        time_t mtime;
+        long mtime_nsec;
+    };
+
+    std::map<std::string, Entry> _entries;
+    size_t _total_size;
+
+    static bool readEntries(const std::string& dir_path, std::vector<DirEntry>& entries);
+    static void renderHtml(const std::vector<DirEntry>& entries, const std::string& uri,
+                           std::vector<SharedBuffer>& chunks);
+    static void renderJson(const std::vector<DirEntry>& entries, std::vector<SharedBuffer>& chunks);
+    static void flushChunk(std::string& batch, std::vector<SharedBuffer>& chunks);
+    static void appendHtmlEscaped(std::string& out, const std::string& text);
+    static void appendJsonEscaped(std::string& out, const std::string& text);
+    static bool matches(const Entry& entry, const struct stat& st);
+    void erase(std::map<std::string, Entry>::iterator it);
+    void evictFor(size_t size);
+
+    DirectoryListingCache(const DirectoryListingCache& other);
+    DirectoryListingCache& operator=(const DirectoryListingCache& other);
+
+public:
+    DirectoryListingCache();
+    ~DirectoryListingCache();
+
+    bool load(const std::string& dir_path, const struct stat& st, const std::string& uri,
+              Location::AutoindexFormat format, bool sorted, std::vector<SharedBuffer>& chunks);
+    void invalidate(const std::string& dir_path);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ERRORPAGECACHE_HPP
+#define ERRORPAGECACHE_HPP
+
+#include "HttpResponse.hpp"
+#include "ServerConfig.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * Error responses for one server block, prepared once at startup
+ * Configured error_page files are read here instead of on every error,
+ * and built-in pages are serialized once so serving them only copies
+ * shared buffer references.
+ */
+class ErrorPageCache {
+private:
+    static const int FIRST_CODE = 400;
+    static const int LAST_CODE = 599;
+    
+    std::vector<HttpResponse> _pages;   // indexed by status code - FIRST_CODE
+    std::vector<bool> _present;
+    
+    static HttpResponse createBuiltinResponse(int error_code);
+    static bool loadFile(const std::string& path, std::string& content);
+    void store(int error_code, HttpResponse& response);
+
+public:
+    ErrorPageCache();
+    ~ErrorPageCache();
+    
+    void build(const ServerConfig& config);
+    const HttpResponse* find(int error_code) const;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef FASTCGIPOOL_HPP
+#define FASTCGIPOOL_HPP
+
+#include "CgiResponder.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <ctime>
+#include <poll.h>
+
+class FastCgiConnection;
+class FastCgiPool;
+
+/*
+ * One request handed to a FastCGI worker in the responder role
+ * Parameters and body are framed into records as the connection takes
+ * them; stdout records feed the CGI output parser as they arrive.
+ */
+class FastCgiRequest : public CgiResponder {
+private:
+    FastCgiPool* _pool;
+    std::string _address;
+    FastCgiConnection* _connection;   // NULL while waiting for one, and once ended
+    std::string _params;              // encoded FCGI_PARAMS content
+    std::string _body;
+    size_t _body_sent;
+    bool _stdin_done;                 // empty FCGI_STDIN sent
+    bool _received;                   // any record arrived for it
+    bool _ended;
+    int _error_status;                // 502/503 when the worker failed it, else 0
+    unsigned int _app_status;
+    bool _reused_connection;          // sent on a connection that served others before
+    bool _retried;
+
+public:
+    FastCgiRequest(FastCgiPool* pool, const std::string& address,
+                   const std::string& params, const std::string& body);
+    ~FastCgiRequest();
+
+    void getPollFds(std::vector<pollfd>& fds) const;
+    bool handleEvent(int fd, short revents);
+    void reap();
+    bool isOutputComplete() const;
+    bool isFinished() const;
+    bool succeeded() const;
+    int getErrorStatus() const;
+    void abort();
+    std::string describe() const;
+
+    // Used by the connection carrying the request
+    const std::string& getAddress() const;
+    const std::string& getParams() const;
+    bool nextStdin(std::string& data, size_t max_size);
+    void attach(FastCgiConnection* connection, bool reused);
+    bool canRetry() const;
+    void retry();
+    void receiveStdout(const char* data, size_t size);
+    void end(unsigned int app_status, int protocol_status);
+    void fail(int error_status);
+
+    static void addParam(std::string& params, const std::string& name, const std::string& value);
+};
+
+/*
+ * A keep-alive connection to a FastCGI worker
+ * It asks the worker whether it multiplexes (FCGI_MPXS_CONNS); until it
+ * knows, and for workers that do not, it carries one request at a time.
+ */
+class FastCgiConnection {
+public:
+    static const size_t OUTPUT_LOW_WATER = 65536;   // stdin is framed while less is queued
+
+private:
+    int _fd;
+    bool _connecting;             // non-blocking connect in progress
+    bool _closed;
+    bool _multiplexed;
+    size_t _max_requests;         // FCGI_MAX_REQS, for multiplexing workers
+    bool _reused;                 // served a request before
+    std::string _output;          // records waiting to be written
+    size_t _output_sent;
+    std::string _input;           // start of a record not complete yet
+    std::map<unsigned short, FastCgiRequest*> _requests;
+    std::set<unsigned short> _aborted;   // ids still owed an end record
+    time_t _idle_since;
+
+    void queueRecord(unsigned char type, unsigned short id, const char* data, size_t size);
+    void queueStdin();
+    void writeOutput();
+    void readInput();
+    void handleRecord(unsigned char type, unsigned short id, const char* content, size_t size);
+    void handleValues(const char* content, size_t size);
+    unsigned short freeId() const;
+
+    FastCgiConnection(const FastCgiConnection& other);
+    FastCgiConnection& operator=(const FastCgiConnection& other);
+
+public:
+    FastCgiConnection(int fd, bool connecting);
+    ~FastCgiConnection();
+
+    static FastCgiConnection* open(const std::string& address);
+
+    int getFd() const;
+    short getEvents() const;
+    bool canTake() const;
+    bool isIdle() const;
+    bool isClosed() const;
+    bool isReadPaused() const;
+    time_t getIdleSince() const;
+
+    void add(FastCgiRequest* request);
+    void remove(FastCgiRequest* request);
+    void handleEvent(short revents);
+    void close(std::vector<FastCgiRequest*>& orphans);
+};
+
+/*
+ * Connections to FastCGI workers, per fastcgi_pass address
+ * Requests wait in line when all MAX_CONNECTIONS connections are busy;
+ * idle connections are kept for IDLE_TIMEOUT seconds.
+ */
+class FastCgiPool {
+public:
+    static const size_t MAX_CONNECTIONS = 8;    // per address
+    static const time_t IDLE_TIMEOUT = 60;
+
+private:
+    struct Upstream {
+        std::vector<FastCgiConnection*> connections;
+        std::deque<FastCgiRequest*> waiting;
+    };
+
+    std::map<std::string, Upstream> _upstreams;
+
+    void dispatch(const std::string& address, Upstream& upstream);
+    void collect(const std::string& address, Upstream& upstream);
+
+    FastCgiPool(const FastCgiPool& other);
+    FastCgiPool& operator=(const FastCgiPool& other);
+
+public:
+    FastCgiPool();
+    ~FastCgiPool();
+
+    FastCgiRequest* start(const std::string& address, const std::string& params, const std::string& body);
+    void release(FastCgiRequest* request);
+
+    void getPollFds(std::vector<pollfd>& fds) const;
+    bool handleEvent(int fd, short revents);
+    void closeIdle(time_t now);
+
+    static bool isValidAddress(const std::string& address);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include "SharedBuffer.hpp"
+#include "MimeTypes.hpp"
+#include <string>
+#include <map>
+#include <sys/stat.h>
+
+/*
+ * In-memory cache of small static files
+ * Bodies are kept as shared buffers, so every client downloading the
+ * same file references one copy. Entries are validated against the stat()
+ * result the caller already has (device, inode, size, mtime), which keeps
+ * hits free of extra syscalls. The Content-Type is resolved once per entry
+ * and reused while the same MIME table asks for it.
+ */
+class FileCache {
+public:
+    static const size_t MAX_FILE_SIZE = 256 * 1024;
+    static const size_t MAX_TOTAL_SIZE = 64 * 1024 * 1024;
+
+private:
+    struct Entry {
+        SharedBuffer body;
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        time_t mtime;
+        const MimeTypes* mime_source;     // table content_type was looked up in
+        const std::string* content_type;
+    };
+    
+    std::map<std::string, Entry> _entries;
+    size_t _total_size;
+    
+    static bool matches(const Entry& entry, const struct stat& st);
+    static bool readFile(const std::string& path, size_t size, std::string& content);
+    void evictFor(size_t size);
+    
+    FileCache(const FileCache& other);
+    FileCache& operator=(const FileCache& other);
+
+public:
+    FileCache();
+    ~FileCache();
+    
+    bool load(const std::string& path, const struct stat& st, const MimeTypes& mime_types,
+              SharedBuffer& body, const std::string*& content_type);
+    void invalidate(const std::string& path);
+    void invalidateTree(const std::string& dir);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+ * inotify watcher over the document roots
+ * Every directory below a watched root gets its own watch, so a change
+ * anywhere in the tree is reported as the path that changed. New
+ * subdirectories are picked up as they appear. The descriptor is polled
+ * by the event loop next to the sockets.
+ */
+class FileWatcher {
+public:
+    static const size_t MAX_WATCHES = 8192;
+
+private:
+    int _fd;
+    bool _complete;                        // false once a directory could not be watched
+    std::map<int, std::string> _paths;     // watch descriptor -> directory
+    std::map<std::string, int> _watches;   // directory -> watch descriptor
+
+    bool addWatch(const std::string& dir);
+    void removeWatch(int wd);
+    void removeTree(const std::string& dir);
+
+    FileWatcher(const FileWatcher& other);
+    FileWatcher& operator=(const FileWatcher& other);
+
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    bool start();
+    void stop();
+    void watchTree(const std::string& root);
+    bool isWatched(const std::string& dir) const;
+    bool coversTree(const std::string& path) const;
+    bool readChanges(std::vector<std::string>& paths);
+    int getFd() const;
+
+    static std::string normalize(const std::string& path);
+};
+
+#endif
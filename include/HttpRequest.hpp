@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <sstream>
 
 class HttpRequest {
 private:
@@ -21,6 +22,7 @@ private:
     std::string trim(const std::string& str) const;
     bool parseRequestLine(const std::string& line);
     bool parseHeader(const std::string& line);
+    bool parseHead(const std::string& raw_request, std::istringstream& stream);
     bool isValidMethod(const std::string& method) const;
     bool isValidVersion(const std::string& version) const;
     bool validatePostRequest() const;
@@ -30,11 +32,14 @@ public:
     ~HttpRequest();
     
     bool parse(const std::string& raw_request);
+    bool parseHeaders(const std::string& raw_request);
     void clear();
     
     // Getters
     const std::string& getMethod() const;
     const std::string& getUri() const;
+    std::string getPath() const;          // URI up to the '?'
+    std::string getQueryString() const;   // URI after the '?'
     const std::string& getVersion() const;
     const std::map<std::string, std::string>& getHeaders() const;
     const std::string& getBody() const;
@@ -46,6 +51,7 @@ public:
     bool hasHeader(const std::string& name) const;
     size_t getContentLength() const;
     bool isKeepAlive() const;
+    bool acceptsEncoding(const std::string& coding) const;
     int getErrorCode() const;
     size_t getBytesConsumed() const;
 };
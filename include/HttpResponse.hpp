@@ -1,21 +1,46 @@
 #ifndef HTTPRESPONSE_HPP
 #define HTTPRESPONSE_HPP
 
+#include "SharedBuffer.hpp"
 #include <string>
-#include <map>
-#include <sstream>
 #include <vector>
+#include <utility>
 
 class HttpResponse {
+public:
+    // Well-known headers live in fixed slots, serialized in this order
+    enum HeaderSlot {
+        HEADER_CONTENT_TYPE,
+        HEADER_CONTENT_LENGTH,
+        HEADER_TRANSFER_ENCODING,
+        HEADER_LOCATION,
+        HEADER_ALLOW,
+        HEADER_CONNECTION,
+        HEADER_SLOT_COUNT
+    };
+
 private:
+    typedef std::pair<std::string, std::string> HeaderField;
+    
     int _status_code;
-    std::string _status_message;
     std::string _version;
-    std::map<std::string, std::string> _headers;
+    std::string _slot_values[HEADER_SLOT_COUNT];
+    unsigned int _slot_mask;                 // bit n set when slot n holds a value
+    std::vector<HeaderField> _extra_headers; // any other header, in insertion order
     std::string _body;
     bool _is_head_response;
+    bool _is_chunked;
+    bool _is_prepared;
+    SharedBuffer _prepared_head;   // status line and static headers, serialized once
+    std::vector<SharedBuffer> _shared_body; // body segments shared with caches, sent after _body
     
-    std::string getStatusMessage(int status_code) const;
+    static const char* getStatusMessage(int status_code);
+    static int findHeaderSlot(const std::string& name);
+    static const char* getHeaderSlotName(HeaderSlot slot);
+    size_t headersSize(bool with_generated) const;
+    size_t writeHeaders(char* out, bool with_generated) const;
+    size_t sharedBodySize() const;
+    static size_t formatChunkSize(char* out, size_t length);
 
 public:
     HttpResponse();
@@ -24,22 +49,41 @@ public:
     void setStatusCode(int status_code);
     void setVersion(const std::string& version);
     void setHeader(const std::string& name, const std::string& value);
+    void setHeader(HeaderSlot slot, const std::string& value);
+    void removeHeader(HeaderSlot slot);
     void setBody(const std::string& body);
+    void setBody(const SharedBuffer& body);
     void setContentType(const std::string& content_type);
     void setContentLength(size_t length);
     void setConnection(bool keep_alive);
+    void setChunked(bool chunked);
+    void appendChunk(const std::string& data);
+    void appendChunk(const SharedBuffer& data);
+    void prepare();
     
     // Getters
     int getStatusCode() const;
     const std::string& getVersion() const;
     const std::string& getBody() const;
     std::string getHeader(const std::string& name) const;
+    bool isChunked() const;
+    bool isPrepared() const;
     
     // Generate response
     std::string toString() const;
+    std::string headersToString() const;
+    void serialize(std::vector<SharedBuffer>& segments) const;
+    
+    // Writes value in decimal to buffer (at least 20 bytes), returns length
+    static size_t formatNumber(char* buffer, size_t value);
+    
+    // Chunked transfer coding helpers for streaming producers
+    static std::string formatChunk(const char* data, size_t length);
+    static const std::string& lastChunk();
     
     // Static factory methods for common responses
     static HttpResponse createOkResponse(const std::string& body, const std::string& content_type = "text/plain");
+    static HttpResponse createOkResponse(const SharedBuffer& body, const std::string& content_type);
     static HttpResponse createHeadResponse(const std::string& content_type = "text/plain", size_t content_length = 0);
     static HttpResponse createNotFoundResponse();
     static HttpResponse createForbiddenResponse();
@@ -51,8 +95,9 @@ public:
     static HttpResponse createRequestTimeoutResponse();
     static HttpResponse createRequestEntityTooLargeResponse();
     static HttpResponse createRedirectResponse(const std::string& redirect_info);
+    static HttpResponse createStatusResponse(int status_code);
     
     void clear();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,48 @@
+#ifndef INDEXCACHE_HPP
+#define INDEXCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/stat.h>
+
+/*
+ * Cache of which index file, if any, answers a directory request
+ * Keyed by directory and index list, and kept while the directory's
+ * mtime is unchanged: adding, removing or renaming an index file always
+ * touches it. Directories without any index file are remembered too, so
+ * autoindex and 403 answers skip the probing as well.
+ */
+class IndexCache {
+public:
+    static const size_t MAX_ENTRIES = 4096;
+
+private:
+    struct Entry {
+        std::string index_name;   // empty when the directory has no index file
+        dev_t device;
+        ino_t inode;
+        time_t mtime;
+        long mtime_nsec;
+    };
+
+    std::map<std::string, Entry> _entries;
+
+    static std::string makeKey(const std::string& dir_path, const std::vector<std::string>& index_files);
+    static bool matches(const Entry& entry, const struct stat& dir_st);
+
+    IndexCache(const IndexCache& other);
+    IndexCache& operator=(const IndexCache& other);
+
+public:
+    IndexCache();
+    ~IndexCache();
+
+    bool lookup(const std::string& dir_path, const struct stat& dir_st,
+                const std::vector<std::string>& index_files, std::string& index_name) const;
+    void store(const std::string& dir_path, const struct stat& dir_st,
+               const std::vector<std::string>& index_files, const std::string& index_name);
+    void clear();
+};
+
+#endif
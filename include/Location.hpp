@@ -6,15 +6,49 @@
 #include <map>
 
 class Location {
+public:
+    static const size_t DEFAULT_PRELOAD_MAX_SIZE = 64 * 1024;
+
+    // Location modifiers, matched in nginx order
+    enum MatchType {
+        MATCH_PREFIX,           // location /path
+        MATCH_EXACT,            // location = /path
+        MATCH_PREFIX_NO_REGEX,  // location ^~ /path, skips regex locations
+        MATCH_REGEX,            // location ~ pattern
+        MATCH_REGEX_CASELESS    // location ~* pattern
+    };
+
+    enum AutoindexFormat {
+        AUTOINDEX_HTML,
+        AUTOINDEX_JSON
+    };
+
+    // When uploaded bytes are forced to disk
+    enum UploadFsync {
+        UPLOAD_FSYNC_OFF,       // left to the kernel
+        UPLOAD_FSYNC_COMMIT,    // before a finished upload is renamed into place
+        UPLOAD_FSYNC_ALWAYS     // also before each partial upload is acknowledged
+    };
+
 private:
     std::string _path;
+    MatchType _match_type;
     std::vector<std::string> _methods;
     std::string _root;
     bool _autoindex;
+    AutoindexFormat _autoindex_format;
+    bool _autoindex_sort;
+    bool _preload;
+    size_t _preload_max_size;
     std::vector<std::string> _index_files;
     std::string _upload_path;
+    UploadFsync _upload_fsync;
     std::map<std::string, std::string> _cgi_extensions;
     std::string _redirect;
+    std::string _bundle;
+    std::string _fastcgi_pass;
+    size_t _cgi_pool_size;        // 0 without cgi_pool
+    size_t _cgi_pool_idle;
 
 public:
     Location();
@@ -22,23 +56,43 @@ public:
     
     // Getters
     const std::string& getPath() const;
+    MatchType getMatchType() const;
+    bool isRegex() const;
     const std::vector<std::string>& getMethods() const;
     const std::string& getRoot() const;
     bool getAutoindex() const;
+    AutoindexFormat getAutoindexFormat() const;
+    bool getAutoindexSort() const;
+    bool getPreload() const;
+    size_t getPreloadMaxSize() const;
     const std::vector<std::string>& getIndexFiles() const;
     const std::string& getUploadPath() const;
+    UploadFsync getUploadFsync() const;
     const std::map<std::string, std::string>& getCgiExtensions() const;
     const std::string& getRedirect() const;
+    const std::string& getBundle() const;
+    const std::string& getFastcgiPass() const;
+    size_t getCgiPoolSize() const;
+    size_t getCgiPoolIdle() const;
     
     // Setters
     void setPath(const std::string& path);
+    void setMatchType(MatchType match_type);
     void setMethods(const std::vector<std::string>& methods);
     void setRoot(const std::string& root);
     void setAutoindex(bool autoindex);
+    void setAutoindexFormat(AutoindexFormat format);
+    void setAutoindexSort(bool sort);
+    void setPreload(bool preload);
+    void setPreloadMaxSize(size_t max_size);
     void setIndexFiles(const std::vector<std::string>& index_files);
     void setUploadPath(const std::string& upload_path);
+    void setUploadFsync(UploadFsync upload_fsync);
     void setCgiExtensions(const std::map<std::string, std::string>& cgi_extensions);
     void setRedirect(const std::string& redirect);
+    void setBundle(const std::string& bundle);
+    void setFastcgiPass(const std::string& address);
+    void setCgiPool(size_t size, size_t idle);
     void addCgiExtension(const std::string& extension, const std::string& path);
     
     void print() const;
@@ -0,0 +1,52 @@
+#ifndef LOCATIONTRIE_HPP
+#define LOCATIONTRIE_HPP
+
+#include "Location.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * Radix trie over the '/'-separated segments of location paths
+ * Chains of segments without a location are collapsed into one edge, and
+ * the children of a node are kept sorted by their first segment so a
+ * lookup is one binary search per edge. Matching follows the linear scan
+ * it replaces: a location matches on a segment boundary and the longest
+ * match wins, "/" matching everything.
+ */
+class LocationTrie {
+private:
+    struct Node;
+
+    struct Edge {
+        std::string label;        // one or more segments joined by '/'
+        size_t first_length;      // length of the first segment of label
+        Node* child;
+    };
+
+    struct Node {
+        const Location* location; // location ending at this node, if any
+        std::vector<Edge> children;
+
+        Node();
+        ~Node();
+    };
+
+    Node* _root;
+
+    static Node* insertSegment(Node* node, const char* segment, size_t length);
+    static void compress(Node* node);
+    static int compareSegment(const char* a, size_t a_length, const char* b, size_t b_length);
+
+    LocationTrie(const LocationTrie& other);
+    LocationTrie& operator=(const LocationTrie& other);
+
+public:
+    LocationTrie();
+    ~LocationTrie();
+
+    void build(const std::vector<Location>& locations);
+    const Location* match(const std::string& uri) const;
+    void clear();
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MIMETYPES_HPP
+#define MIMETYPES_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+ * Extension to Content-Type table of one server block
+ * Built once from the built-in defaults plus the server's types blocks.
+ * Lookups lowercase the extension into a stack buffer and probe a hash
+ * table, returning a reference to the stored type without allocating.
+ */
+class MimeTypes {
+private:
+    static const size_t MAX_EXTENSION_LENGTH = 32;
+
+    struct Entry {
+        std::string extension;   // lowercase, without the dot
+        size_t hash;
+        size_t type;             // index into _types
+    };
+
+    std::vector<std::string> _types;               // distinct type strings
+    std::vector<std::vector<Entry> > _buckets;     // power-of-two count
+
+    static size_t hashExtension(const char* extension, size_t length);
+    size_t internType(const std::string& type);
+
+public:
+    MimeTypes();
+    ~MimeTypes();
+
+    void build(const std::map<std::string, std::string>& configured);
+    const std::string& lookup(const std::string& path) const;
+
+    static const std::string& defaultType();
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef MULTIPARTPARSER_HPP
+#define MULTIPARTPARSER_HPP
+
+#include <string>
+#include <map>
+
+/*
+ * Receives the parts of a multipart body as the parser finds them
+ * Returning false from a callback stops the parser
+ */
+class MultipartHandler {
+public:
+    virtual ~MultipartHandler() {}
+    virtual bool onPartBegin(const std::map<std::string, std::string>& headers) = 0;
+    virtual bool onPartData(const char* data, size_t size) = 0;
+    virtual bool onPartEnd() = 0;
+};
+
+/*
+ * Incremental multipart/form-data parser
+ * Bytes are fed as they arrive; part content is handed to the handler
+ * straight away, only a delimiter-sized tail is held back in case the
+ * boundary straddles two reads. Delimiters are found with a
+ * Boyer-Moore-Horspool search, so large parts cost a fraction of a
+ * byte-by-byte scan and memory stays bounded whatever the body size.
+ */
+class MultipartParser {
+public:
+    static const size_t MAX_BOUNDARY_LENGTH = 70;     // RFC 2046
+    static const size_t MAX_HEADER_SIZE = 8192;       // per part
+
+private:
+    enum State {
+        PREAMBLE,
+        AFTER_DELIMITER,
+        HEADERS,
+        BODY,
+        DONE,
+        FAILED
+    };
+
+    State _state;
+    std::string _delimiter;        // CRLF "--" boundary
+    size_t _skip[256];             // Horspool shift per byte value
+    std::string _buffer;           // bytes not yet handed out
+
+    size_t findDelimiter(const char* data, size_t size) const;
+    bool parseHeaders(const std::string& block, std::map<std::string, std::string>& headers) const;
+    bool step(MultipartHandler& handler, size_t& offset);
+
+    MultipartParser(const MultipartParser& other);
+    MultipartParser& operator=(const MultipartParser& other);
+
+public:
+    MultipartParser();
+    ~MultipartParser();
+
+    bool setBoundary(const std::string& boundary);
+    bool feed(const char* data, size_t size, MultipartHandler& handler);
+    bool isDone() const;
+    bool hasFailed() const;
+
+    static std::string boundaryFromContentType(const std::string& content_type);
+    static std::string headerParameter(const std::string& value, const std::string& name, bool* found = NULL);
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef MULTIPARTUPLOAD_HPP
+#define MULTIPARTUPLOAD_HPP
+
+#include "BodySink.hpp"
+#include "MultipartParser.hpp"
+#include "Location.hpp"
+#include "ContentHash.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * Stores the file parts of a multipart/form-data upload in upload_path
+ * Each part is written to a hidden temporary file while it arrives and
+ * renamed to its final name when its closing delimiter is seen, so a
+ * listing never shows a half-written upload. Plain form fields are kept
+ * in memory up to MAX_FIELDS_SIZE and reported back with the files,
+ * which carry the SHA-256 and CRC-32C computed while they were written.
+ * A digest the client sent covers the whole body and is checked over it.
+ */
+class MultipartUpload : public BodySink, private MultipartHandler {
+public:
+    static const size_t MAX_FIELDS = 256;
+    static const size_t MAX_FIELDS_SIZE = 64 * 1024;   // names and values together
+
+    struct StoredFile {
+        std::string field;        // form field the file was sent as
+        std::string name;
+        std::string path;
+        size_t size;
+        std::string sha256;       // lowercase hex
+        std::string crc32c;
+    };
+
+private:
+    std::string _upload_path;
+    bool _html_summary;           // HTML page for browsers, JSON otherwise
+    Location::UploadFsync _fsync;
+    ExpectedDigest _expected;
+    ContentHash _body_hash;       // whole request body, only to check _expected
+    MultipartParser _parser;
+    std::vector<StoredFile> _files;
+    std::vector<std::pair<std::string, std::string> > _fields;
+    size_t _fields_size;
+    int _error_code;
+
+    int _fd;                      // file of the part being received, -1 if none
+    std::string _temp_path;
+    StoredFile _current;
+    ContentHash _current_hash;
+    bool _in_field;               // current part is a form field
+
+    static unsigned long _serial;
+
+    static std::string sanitizeFilename(const std::string& filename);
+    static std::string escapeHtml(const std::string& text);
+    static void appendJsonString(std::string& out, const std::string& text);
+    HttpResponse buildHtmlResponse() const;
+    HttpResponse buildJsonResponse() const;
+    void discardCurrent();
+
+    virtual bool onPartBegin(const std::map<std::string, std::string>& headers);
+    virtual bool onPartData(const char* data, size_t size);
+    virtual bool onPartEnd();
+
+    MultipartUpload(const MultipartUpload& other);
+    MultipartUpload& operator=(const MultipartUpload& other);
+
+public:
+    MultipartUpload(const std::string& upload_path, const std::string& boundary, bool html_summary,
+                    Location::UploadFsync fsync, const ExpectedDigest& expected);
+    virtual ~MultipartUpload();
+
+    virtual bool write(const char* data, size_t size);
+    virtual bool finish();
+    virtual void abort();
+
+    virtual int getErrorCode() const;
+    virtual HttpResponse buildResponse() const;
+
+    const std::vector<StoredFile>& getFiles() const;
+    const std::vector<std::pair<std::string, std::string> >& getFields() const;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef NEGATIVECACHE_HPP
+#define NEGATIVECACHE_HPP
+
+#include <string>
+#include <map>
+#include <ctime>
+
+/*
+ * Bounded cache of file paths that recently did not exist
+ * Requests for them go straight to the prepared 404 without a stat().
+ * Paths covered by the file watcher stay until a change is reported
+ * under them; other paths expire after TTL_SECONDS.
+ */
+class NegativeCache {
+public:
+    static const size_t MAX_ENTRIES = 8192;
+    static const time_t TTL_SECONDS = 2;
+
+private:
+    std::map<std::string, time_t> _entries;   // path -> expiry, 0 for none
+
+    NegativeCache(const NegativeCache& other);
+    NegativeCache& operator=(const NegativeCache& other);
+
+public:
+    NegativeCache();
+    ~NegativeCache();
+
+    bool contains(const std::string& path);
+    void store(const std::string& path, bool watched);
+    void invalidate(const std::string& path);
+    void invalidateTree(const std::string& dir);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef PRELOADCACHE_HPP
+#define PRELOADCACHE_HPP
+
+#include "HttpResponse.hpp"
+#include "Location.hpp"
+#include "SharedBuffer.hpp"
+#include <string>
+#include <vector>
+#include <map>
+
+class ServerContext;
+
+/*
+ * Responses for the files of `preload on` locations, built at startup
+ * Every eligible file is read into one read-only arena and wrapped in a
+ * prepared response whose status line and headers are already serialized,
+ * so a hit costs a map lookup and reference count bumps. Entries are keyed
+ * by request URI; directories are keyed too when their index file is
+ * preloaded. A change reported for a file drops its entries, and the
+ * request then takes the regular path.
+ */
+class PreloadCache {
+public:
+    static const size_t MAX_TOTAL_SIZE = 64 * 1024 * 1024;
+    static const size_t MAX_FILES = 4096;
+
+private:
+    struct Candidate {
+        std::string path;
+        std::vector<std::string> uris;
+        std::vector<std::string> dirs;   // directories served by this file as their index
+        size_t size;
+        size_t offset;
+    };
+
+    SharedBuffer _arena;
+    std::map<std::string, HttpResponse> _responses;           // URI -> prepared response
+    std::multimap<std::string, std::string> _uris_by_path;    // file or directory -> URIs
+
+    static bool readInto(const std::string& path, char* out, size_t size);
+    static bool isCgiFile(const Location& location, const std::string& name);
+    static std::string joinUri(const std::string& base, const std::string& name);
+    void collect(const Location& location, ServerContext& context, std::vector<Candidate>& candidates,
+                 size_t& total_size);
+
+    PreloadCache(const PreloadCache& other);
+    PreloadCache& operator=(const PreloadCache& other);
+
+public:
+    PreloadCache();
+    ~PreloadCache();
+
+    void build(const std::vector<Location>& locations, ServerContext& context);
+    const HttpResponse* find(const std::string& uri) const;
+    void invalidate(const std::string& path);
+    void clear();
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PUTUPLOAD_HPP
+#define PUTUPLOAD_HPP
+
+#include "BodySink.hpp"
+#include "Location.hpp"
+#include "ContentHash.hpp"
+#include <string>
+#include <sys/types.h>
+
+/*
+ * Stores the body of a PUT at its target path, resumably
+ * Bytes go to "<target>.part" with pwrite() at the offset given by
+ * Content-Range, so an interrupted upload continues where the committed
+ * bytes end instead of starting over. The part file is renamed over the
+ * target once the full length is in, which makes the new content appear
+ * atomically. Only one upload writes a part file at a time: it is
+ * locked with flock(), and a second PUT to the same target gets 409.
+ * A Content-Range whose range is "*", sent with an empty body, asks how
+ * many bytes are committed. Until the file is complete every answer is
+ * 204 with "Range: bytes=0-<last>" naming the committed bytes, or no
+ * Range header when there are none. HTTP defines no response header
+ * for this, so the request header's syntax is borrowed, as resumable
+ * upload APIs commonly do.
+ * Body bytes still in the socket are spliced through a pipe into the
+ * file, so they never pass through user space; where splice() is
+ * refused they are read with recv() and written with pwrite() instead.
+ * The request that
+ * completes the file hashes it as it is stored and answers with the
+ * SHA-256 as ETag; a digest the client sent for its body is checked
+ * before the file is renamed into place.
+ */
+class PutUpload : public BodySink {
+private:
+    std::string _target_path;
+    std::string _part_path;
+    bool _ranged;                 // request carried a Content-Range
+    bool _status_query;           // Content-Range: bytes */total
+    off_t _start;                 // offset of the first body byte
+    off_t _end;                   // offset past the last body byte
+    off_t _total;                 // full length, -1 if not known yet
+    off_t _offset;                // where the next body byte goes
+    off_t _committed;             // bytes in the part file, written without gaps
+    bool _complete;
+    bool _created;                // target did not exist before
+    Location::UploadFsync _fsync;
+    int _fd;
+    int _pipe[2];                 // socket to file, created on first splice
+    bool _splice_refused;         // rest of the body comes through write()
+    int _error_code;
+
+    ExpectedDigest _expected;
+    ContentHash _file_hash;       // whole file, when this request completes it
+    ContentHash _content_hash;    // this request's body, to check _expected
+    bool _hashing;                // _file_hash is being fed
+    off_t _hashed;                // bytes of the file in _file_hash
+
+    static const size_t PIPE_SIZE = 1024 * 1024;
+
+    static bool parseOffset(const std::string& text, off_t& value);
+    bool parseContentRange(const std::string& value, size_t content_length);
+    bool openPartFile();
+    bool commit();
+    bool openPipe();
+    bool drainPipe(size_t size);
+    bool hashFileUpTo(off_t end);
+    bool hashStored(off_t offset, const char* data, size_t size);
+    void discardBody();
+
+    PutUpload(const PutUpload& other);
+    PutUpload& operator=(const PutUpload& other);
+
+public:
+    PutUpload(const std::string& target_path, const std::string& content_range, size_t content_length,
+              Location::UploadFsync fsync, const ExpectedDigest& expected);
+    virtual ~PutUpload();
+
+    virtual bool write(const char* data, size_t size);
+    virtual bool finish();
+    virtual void abort();
+
+    virtual int getErrorCode() const;
+    virtual HttpResponse buildResponse() const;
+
+    virtual bool canSplice() const;
+    virtual ssize_t spliceFrom(int socket_fd, size_t max_bytes);
+};
+
+#endif
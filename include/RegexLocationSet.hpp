@@ -0,0 +1,56 @@
+#ifndef REGEXLOCATIONSET_HPP
+#define REGEXLOCATIONSET_HPP
+
+#include "Location.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <utility>
+#include <regex.h>
+
+/*
+ * The ~ and ~* locations of a server block, compiled once at startup
+ * Patterns are tried in config order and the first match wins. Each one
+ * carries literals extracted from the pattern (an anchored prefix and a
+ * substring every match must contain) so most URIs are rejected without
+ * running the regex, and recent results are memoized per URI in an LRU.
+ */
+class RegexLocationSet {
+private:
+    static const size_t MEMO_CAPACITY = 512;
+
+    struct Pattern {
+        regex_t regex;
+        const Location* location;
+        bool caseless;
+        std::string prefix;    // literal the URI must start with, if anchored
+        std::string required;  // literal the URI must contain
+    };
+
+    typedef std::list<std::pair<std::string, const Location*> > MemoList;
+
+    std::vector<Pattern*> _patterns;
+    MemoList _memo;                                     // most recent first
+    std::map<std::string, MemoList::iterator> _memo_index;
+
+    static void extractLiterals(const std::string& pattern, std::string& prefix, std::string& required);
+    static size_t skipBracket(const std::string& pattern, size_t start);
+    static bool startsWith(const std::string& uri, const std::string& prefix, bool caseless);
+    static bool contains(const std::string& uri, const std::string& literal, bool caseless);
+    const Location* evaluate(const std::string& uri) const;
+
+    RegexLocationSet(const RegexLocationSet& other);
+    RegexLocationSet& operator=(const RegexLocationSet& other);
+
+public:
+    RegexLocationSet();
+    ~RegexLocationSet();
+
+    void build(const std::vector<Location>& locations);
+    const Location* match(const std::string& uri);
+    bool empty() const;
+    void clear();
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SERVERCLOCK_HPP
+#define SERVERCLOCK_HPP
+
+#include <string>
+#include <ctime>
+
+/*
+ * Event loop clock shared by the whole server
+ * The loop calls tick() once per iteration; everything else reads the
+ * cached timestamp and HTTP-date instead of calling time()/strftime().
+ */
+class ServerClock {
+private:
+    static time_t _now;
+    static time_t _date_time;      // second the cached date was formatted for
+    static std::string _http_date;
+    static const std::string _server_token;
+    
+    static void formatHttpDate();
+
+public:
+    static void tick();
+    static time_t now();
+    static const std::string& httpDate();
+    static const std::string& serverToken();
+};
+
+#endif
@@ -14,6 +14,7 @@ private:
     std::map<int, std::string> _error_pages;
     size_t _max_body_size;
     std::vector<Location> _locations;
+    std::map<std::string, std::string> _mime_types; // lowercase extension -> type
 
 public:
     ServerConfig();
@@ -26,6 +27,7 @@ public:
     const std::map<int, std::string>& getErrorPages() const;
     size_t getMaxBodySize() const;
     const std::vector<Location>& getLocations() const;
+    const std::map<std::string, std::string>& getMimeTypes() const;
     
     // Setters
     void setHost(const std::string& host);
@@ -37,6 +39,7 @@ public:
     void addServerName(const std::string& server_name);
     void addErrorPage(int code, const std::string& page);
     void addLocation(const Location& location);
+    void addMimeType(const std::string& extension, const std::string& type, bool replace);
     
     void print() const;
 };
@@ -0,0 +1,52 @@
+#ifndef SERVERCONTEXT_HPP
+#define SERVERCONTEXT_HPP
+
+#include "ServerConfig.hpp"
+#include "ErrorPageCache.hpp"
+#include "LocationTrie.hpp"
+#include "RegexLocationSet.hpp"
+#include "MimeTypes.hpp"
+#include "PreloadCache.hpp"
+#include "StaticBundle.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Runtime state derived from one server block
+ * Built once when the server starts so request handling only performs
+ * lookups. Holds a pointer to the config, which must outlive it.
+ */
+class ServerContext {
+private:
+    const ServerConfig* _config;
+    ErrorPageCache _error_pages;
+    std::map<std::string, const Location*> _exact_locations;
+    LocationTrie _locations;
+    RegexLocationSet _regex_locations;
+    MimeTypes _mime_types;
+    PreloadCache _preloaded;
+    std::map<const Location*, StaticBundle*> _bundles;  // locations served from a bundle
+    std::map<const Location*, std::vector<std::string> > _cgi_environments; // request-independent CGI variables
+    
+    void buildCgiEnvironment(const Location& location);
+    
+    ServerContext(const ServerContext& other);
+    ServerContext& operator=(const ServerContext& other);
+
+public:
+    explicit ServerContext(const ServerConfig& config);
+    ~ServerContext();
+    
+    const ServerConfig& getConfig() const;
+    const ErrorPageCache& getErrorPages() const;
+    const MimeTypes& getMimeTypes() const;
+    const Location* findLocation(const std::string& uri);
+    const HttpResponse* findPreloaded(const std::string& uri) const;
+    const StaticBundle* findBundle(const Location* location) const;
+    const std::vector<std::string>* findCgiEnvironment(const Location* location) const;
+    void invalidatePreloaded(const std::string& path);
+    void clearPreloaded();
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+ * Reference-counted immutable byte buffer
+ * Copies share the same storage, so cached content is paid for once
+ * no matter how many responses reference it. Not thread-safe: the
+ * server runs a single event loop.
+ */
+class SharedBuffer {
+private:
+    struct Storage {
+        size_t refs;
+        std::string bytes;
+        Storage() : refs(1) {}
+    };
+    
+    Storage* _storage;
+    const char* _data;
+    size_t _size;
+    
+    void release();
+
+public:
+    SharedBuffer();
+    explicit SharedBuffer(const std::string& data);
+    SharedBuffer(const SharedBuffer& other);
+    SharedBuffer& operator=(const SharedBuffer& other);
+    ~SharedBuffer();
+    
+    // Takes the contents of data without copying, leaving it empty
+    static SharedBuffer adopt(std::string& data);
+    
+    // Refers to memory owned elsewhere (e.g. a mapping) that outlives every copy
+    static SharedBuffer borrow(const char* data, size_t size);
+    
+    // Returns a view of length bytes from offset that shares this storage
+    SharedBuffer slice(size_t offset, size_t length) const;
+    
+    const char* data() const;
+    size_t size() const;
+    bool empty() const;
+    size_t useCount() const;
+    std::string toString() const;
+};
+
+#endif
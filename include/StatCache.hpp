@@ -0,0 +1,34 @@
+#ifndef STATCACHE_HPP
+#define STATCACHE_HPP
+
+#include <string>
+#include <map>
+#include <sys/stat.h>
+
+/*
+ * Cache of stat() results for paths under watched directories
+ * Entries carry no expiry: they stay valid until the file watcher reports
+ * a change to the path, its directory or a directory above it.
+ */
+class StatCache {
+public:
+    static const size_t MAX_ENTRIES = 16384;
+
+private:
+    std::map<std::string, struct stat> _entries;
+
+    StatCache(const StatCache& other);
+    StatCache& operator=(const StatCache& other);
+
+public:
+    StatCache();
+    ~StatCache();
+
+    bool lookup(const std::string& path, struct stat& st) const;
+    void store(const std::string& path, const struct stat& st);
+    void invalidate(const std::string& path);
+    void invalidateTree(const std::string& dir);
+    void clear();
+};
+
+#endif
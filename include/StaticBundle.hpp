@@ -0,0 +1,46 @@
+#ifndef STATICBUNDLE_HPP
+#define STATICBUNDLE_HPP
+
+#include "BundleFormat.hpp"
+#include "SharedBuffer.hpp"
+#include <string>
+#include <cstddef>
+
+/*
+ * Read-only view of a bundle made by webserv-pack
+ * The whole file is mapped once and validated; lookups binary-search the
+ * sorted index and bodies are handed out as buffers pointing into the
+ * mapping, so serving a bundled file touches neither the file system nor
+ * the heap for its contents. The mapping lives as long as this object.
+ */
+class StaticBundle {
+private:
+    std::string _path;
+    const char* _map;
+    size_t _map_size;
+    const BundleFormat::Header* _header;
+    const BundleFormat::Entry* _entries;
+    const char* _strings;
+
+    bool validate() const;
+    int comparePath(const BundleFormat::Entry& entry, const char* path, size_t length) const;
+
+    StaticBundle(const StaticBundle& other);
+    StaticBundle& operator=(const StaticBundle& other);
+
+public:
+    StaticBundle();
+    ~StaticBundle();
+
+    bool open(const std::string& path);
+    void close();
+    const BundleFormat::Entry* find(const std::string& path) const;
+
+    SharedBuffer body(const BundleFormat::Entry& entry) const;
+    SharedBuffer gzipBody(const BundleFormat::Entry& entry) const;
+    std::string contentType(const BundleFormat::Entry& entry) const;
+    std::string etag(const BundleFormat::Entry& entry) const;
+    size_t size() const;
+};
+
+#endif
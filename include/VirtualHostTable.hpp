@@ -0,0 +1,55 @@
+#ifndef VIRTUALHOSTTABLE_HPP
+#define VIRTUALHOSTTABLE_HPP
+
+#include "ServerConfig.hpp"
+#include <string>
+#include <vector>
+
+/*
+ * The server blocks sharing one listening socket, keyed by server_name
+ * Exact names live in one hash table, "*.example.com" names in a suffix
+ * table and "www.example.*" names in a prefix table. A Host value is
+ * resolved like nginx does: exact name, longest leading wildcard, longest
+ * trailing wildcard, then the first server block on the listener.
+ */
+class VirtualHostTable {
+private:
+    // Open hash table of lowercase names to server indexes
+    class NameTable {
+    private:
+        struct Entry {
+            std::string name;
+            size_t hash;
+            size_t server_index;
+        };
+
+        std::vector<std::vector<Entry> > _buckets;
+        size_t _count;
+
+        void grow();
+
+    public:
+        NameTable();
+
+        static size_t hashName(const char* name, size_t length);
+        bool insert(const std::string& name, size_t server_index);
+        bool find(const char* name, size_t length, size_t& server_index) const;
+        bool empty() const;
+    };
+
+    std::vector<size_t> _servers;   // indexes into the server configs, config order
+    NameTable _exact_names;
+    NameTable _suffix_names;        // "*.example.com" stored as ".example.com"
+    NameTable _prefix_names;        // "www.example.*" stored as "www.example."
+
+public:
+    VirtualHostTable();
+    ~VirtualHostTable();
+
+    void addServer(size_t server_index, const ServerConfig& config);
+    size_t resolve(const std::string& host) const;
+    size_t getDefaultServer() const;
+    const std::vector<size_t>& getServers() const;
+};
+
+#endif
@@ -20,6 +20,10 @@ private:
     void setupSockets();
     void handleNewConnection(int listen_sock);
     void updatePollEvents(int client_sock, short events);
+    void updateClientEvents(int client_sock);
+    void removePollFd(int fd);
+    void handleCgiEvents(const std::vector<pollfd>& cgi_fds);
+    void reapCgiChildren();
     bool isListenSocket(int fd) const;
     void cleanup();
     
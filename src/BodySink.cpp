@@ -0,0 +1,35 @@
+#include "BodySink.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Returns whether spliceFrom() may be used instead of write()
+ */
+bool BodySink::canSplice() const {
+    return false;
+}
+
+/*
+ * Moves up to max_bytes of body from the socket straight to storage
+ * Returns the bytes taken off the socket, 0 if the peer closed it and
+ * -1 if nothing was moved; storage errors show up in getErrorCode()
+ */
+ssize_t BodySink::spliceFrom(int /* socket_fd */, size_t /* max_bytes */) {
+    return -1;
+}
+
+/*
+ * Flushes the directory entry of path's parent, so a file renamed into
+ * it survives a crash together with its contents
+ */
+bool BodySink::syncDirectory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
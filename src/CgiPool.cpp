@@ -0,0 +1,185 @@
+#include "CgiPool.hpp"
+#include <iostream>
+#include <algorithm>
+#include <sys/wait.h>
+
+namespace {
+    /*
+     * Returns a monotonic time in milliseconds, for waiting times
+     */
+    long monotonicMillis() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+    }
+}
+
+/*
+ * Creates the pool for the location at name and starts its idle workers
+ */
+CgiPool::CgiPool(const std::string& name, size_t size, size_t idle)
+    : _name(name), _size(size), _idle_target(idle), _started(0), _warm_starts(0), _waited(0),
+      _wait_total(0), _wait_max(0), _peak_running(0), _peak_waiting(0), _last_report(0) {
+    fill();
+}
+
+/*
+ * Destructor for CgiPool
+ * Retires the idle workers; running scripts belong to their jobs
+ */
+CgiPool::~CgiPool() {
+    for (size_t i = 0; i < _idle.size(); ++i) {
+        CgiProcess::retireWorker(_idle[i]);
+    }
+}
+
+/*
+ * Runs script for process now if a slot is free, else queues it
+ * Returns false if it could not be started; a queued process that
+ * cannot be started later is aborted instead
+ */
+bool CgiPool::submit(CgiProcess* process, const std::string& interpreter, const std::string& script,
+                     const CgiProcess::Environment& env, const std::string& body) {
+    if (_running.size() < _size) {
+        return launch(process, interpreter, script, env, body);
+    }
+    Launch waiting;
+    waiting.process = process;
+    waiting.interpreter = interpreter;
+    waiting.script = script;
+    waiting.env = env;
+    waiting.body = body;
+    waiting.queued_at = monotonicMillis();
+    _waiting.push_back(waiting);
+    _peak_waiting = std::max(_peak_waiting, _waiting.size());
+    return true;
+}
+
+/*
+ * Frees the slot of a finished script, or takes a request that is still
+ * waiting out of line; the next waiting request starts in the slot
+ */
+void CgiPool::release(const CgiResponder* responder) {
+    std::set<const CgiResponder*>::iterator running = _running.find(responder);
+    if (running != _running.end()) {
+        _running.erase(running);
+        dispatch();
+        return;
+    }
+    for (std::deque<Launch>::iterator it = _waiting.begin(); it != _waiting.end(); ++it) {
+        if (it->process == responder) {
+            _waiting.erase(it);
+            return;
+        }
+    }
+}
+
+/*
+ * Starts idle workers until there are as many as configured, as long as
+ * they fit in the pool next to the running scripts
+ */
+void CgiPool::fill() {
+    while (_idle.size() < _idle_target && _running.size() + _idle.size() < _size) {
+        CgiProcess::Worker worker;
+        if (!CgiProcess::spawnWorker(worker)) {
+            std::cerr << "Warning: cannot start CGI worker for " << _name << std::endl;
+            return;
+        }
+        _idle.push_back(worker);
+    }
+}
+
+/*
+ * Forgets idle workers that died while waiting; fill() replaces them
+ */
+void CgiPool::reap() {
+    for (size_t i = 0; i < _idle.size(); ) {
+        if (waitpid(_idle[i].pid, NULL, WNOHANG) == _idle[i].pid) {
+            _idle[i].pid = -1;
+            CgiProcess::retireWorker(_idle[i]);
+            _idle.erase(_idle.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+/*
+ * Logs occupancy and waiting times once per REPORT_INTERVAL while the
+ * pool is in use, to help size it
+ */
+void CgiPool::report(time_t now) {
+    if (now - _last_report < REPORT_INTERVAL) {
+        return;
+    }
+    _last_report = now;
+    if (_started == 0 && _running.empty() && _waiting.empty()) {
+        return;
+    }
+    std::cout << "CGI pool " << _name << ": " << _running.size() << "/" << _size
+              << " running (peak " << _peak_running << "), " << _idle.size() << " idle, "
+              << _waiting.size() << " waiting (peak " << _peak_waiting << "); "
+              << _started << " started, " << _warm_starts << " warm; " << _waited << " waited";
+    if (_waited > 0) {
+        std::cout << ", avg " << _wait_total / static_cast<long>(_waited) << " ms, max " << _wait_max << " ms";
+    }
+    std::cout << std::endl;
+    _started = 0;
+    _warm_starts = 0;
+    _waited = 0;
+    _wait_total = 0;
+    _wait_max = 0;
+    _peak_running = _running.size();
+    _peak_waiting = _waiting.size();
+}
+
+/*
+ * Starts script for process on an idle worker, or spawns it if none is
+ * left
+ * The worker taken is replaced by fill() on the next event loop pass,
+ * not here, so the request does not wait for a second spawn
+ */
+bool CgiPool::launch(CgiProcess* process, const std::string& interpreter, const std::string& script,
+                     const CgiProcess::Environment& env, const std::string& body) {
+    CgiProcess::Worker worker;
+    bool warm = false;
+    while (!_idle.empty() && !warm) {
+        worker = _idle.back();
+        _idle.pop_back();
+        if (waitpid(worker.pid, NULL, WNOHANG) == 0) {
+            warm = true;
+        } else {
+            worker.pid = -1;    // died while waiting
+            CgiProcess::retireWorker(worker);
+        }
+    }
+    bool started = warm ? process->start(worker, interpreter, script, env, body)
+                        : process->start(interpreter, script, env, body);
+    if (!started) {
+        return false;
+    }
+    _running.insert(process);
+    ++_started;
+    if (warm) {
+        ++_warm_starts;
+    }
+    _peak_running = std::max(_peak_running, _running.size());
+    return true;
+}
+
+/*
+ * Starts waiting requests while there are free slots
+ */
+void CgiPool::dispatch() {
+    while (!_waiting.empty() && _running.size() < _size) {
+        Launch next = _waiting.front();
+        _waiting.pop_front();
+        long waited = monotonicMillis() - next.queued_at;
+        ++_waited;
+        _wait_total += waited;
+        _wait_max = std::max(_wait_max, waited);
+        if (!launch(next.process, next.interpreter, next.script, next.env, next.body)) {
+            next.process->abort();
+        }
+    }
+}
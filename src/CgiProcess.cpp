@@ -0,0 +1,482 @@
+#include "CgiProcess.hpp"
+#include "ServerClock.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+
+const char* const CgiProcess::WORKER_FLAG = "--cgi-worker";
+
+/*
+ * Default constructor for CgiProcess
+ */
+CgiProcess::CgiProcess()
+    : _pid(-1), _input_fd(-1), _output_fd(-1), _input_sent(0), _exited(false), _status(0) {}
+
+/*
+ * Destructor for CgiProcess
+ * Closes the pipes; a child that has not been reaped yet is killed and
+ * waited for, which only happens at shutdown
+ */
+CgiProcess::~CgiProcess() {
+    abort();
+    if (_pid > 0 && !_exited) {
+        waitpid(_pid, NULL, 0);
+    }
+}
+
+/*
+ * Closes the script's stdin, which tells it the body is complete
+ */
+void CgiProcess::closeInput() {
+    if (_input_fd >= 0) {
+        close(_input_fd);
+        _input_fd = -1;
+    }
+}
+
+/*
+ * Closes the script's stdout
+ */
+void CgiProcess::closeOutput() {
+    if (_output_fd >= 0) {
+        close(_output_fd);
+        _output_fd = -1;
+    }
+}
+
+/*
+ * Spawns interpreter with script, env as its environment and body
+ * waiting to be written to its stdin
+ * posix_spawn() starts the child without copying the server's memory,
+ * so starting a script does not get slower as the server grows. The
+ * pipes are close-on-exec; only the child's copies on stdin and stdout
+ * survive, and nothing else of the server stays open in the script.
+ */
+bool CgiProcess::start(const std::string& interpreter, const std::string& script,
+                       const Environment& env, const std::string& body) {
+    int pipefd_in[2];   // for sending data to CGI
+    int pipefd_out[2];  // for receiving data from CGI
+
+    if (pipe2(pipefd_in, O_CLOEXEC) == -1) {
+        return false;
+    }
+    if (pipe2(pipefd_out, O_CLOEXEC) == -1) {
+        close(pipefd_in[0]);
+        close(pipefd_in[1]);
+        return false;
+    }
+
+    std::vector<char*> env_array;
+    if (env.shared) {
+        for (size_t i = 0; i < env.shared->size(); ++i) {
+            env_array.push_back(const_cast<char*>((*env.shared)[i].c_str()));
+        }
+    }
+    for (size_t i = 0; i < env.request.size(); ++i) {
+        env_array.push_back(const_cast<char*>(env.request[i].c_str()));
+    }
+    env_array.push_back(NULL);
+    char* args[] = {const_cast<char*>(interpreter.c_str()), const_cast<char*>(script.c_str()), NULL};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipefd_in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipefd_out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+
+    // The server blocks SIGCHLD and ignores SIGPIPE; the script must not inherit that
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    int result = posix_spawn(&_pid, interpreter.c_str(), &actions, &attr, args, &env_array[0]);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(pipefd_in[0]);
+    close(pipefd_out[1]);
+    if (result != 0) {
+        _pid = -1;
+        close(pipefd_in[1]);
+        close(pipefd_out[0]);
+        return false;
+    }
+    _input_fd = pipefd_in[1];
+    _output_fd = pipefd_out[0];
+    fcntl(_input_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_output_fd, F_SETFL, O_NONBLOCK);
+    _input = body;
+    touch();
+
+    // Most bodies fit in the pipe and are written right away
+    writeInput();
+    return true;
+}
+
+/*
+ * Tells worker to execute interpreter with script and env as its
+ * environment; body waits to be written to its stdin
+ * The process takes over the worker's pipes, even if this fails
+ */
+bool CgiProcess::start(Worker& worker, const std::string& interpreter, const std::string& script,
+                       const Environment& env, const std::string& body) {
+    _pid = worker.pid;
+    _input_fd = worker.input_fd;
+    _output_fd = worker.output_fd;
+
+    std::string message = interpreter + '\0' + script + '\0';
+    if (env.shared) {
+        for (size_t i = 0; i < env.shared->size(); ++i) {
+            message += (*env.shared)[i];
+            message += '\0';
+        }
+    }
+    for (size_t i = 0; i < env.request.size(); ++i) {
+        message += env.request[i];
+        message += '\0';
+    }
+    size_t sent = 0;
+    while (sent < message.size()) {
+        ssize_t written = write(worker.control_fd, message.data() + sent, message.size() - sent);
+        if (written <= 0) {
+            break;    // the worker is gone
+        }
+        sent += written;
+    }
+    close(worker.control_fd);
+    worker.control_fd = -1;
+    if (sent < message.size()) {
+        abort();
+        return false;
+    }
+
+    _input = body;
+    touch();
+
+    // Most bodies fit in the pipe and are written right away
+    writeInput();
+    return true;
+}
+
+/*
+ * Starts a worker with its stdin, stdout and control pipes in place
+ * The worker is the server binary run again with WORKER_FLAG, spawned
+ * like a script: nothing of the server's memory is copied, however much
+ * it has grown, and only the worker's copies of the pipes stay open.
+ */
+bool CgiProcess::spawnWorker(Worker& worker) {
+    int fds[6] = { -1, -1, -1, -1, -1, -1 };   // stdin, stdout and control pipes
+    for (int i = 0; i < 6; i += 2) {
+        if (pipe2(fds + i, O_CLOEXEC) == -1) {
+            for (int j = 0; j < i; ++j) {
+                close(fds[j]);
+            }
+            return false;
+        }
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[3], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[4], WORKER_CONTROL_FD);
+    posix_spawn_file_actions_addclosefrom_np(&actions, WORKER_CONTROL_FD + 1);
+
+    // Neither the waiting worker nor the script may inherit the server's
+    // blocked SIGCHLD and ignored SIGPIPE; caught signals reset on exec
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    char* args[] = { const_cast<char*>("webserv"), const_cast<char*>(WORKER_FLAG), NULL };
+    char* env[] = { NULL };
+    pid_t pid;
+    int result = posix_spawn(&pid, "/proc/self/exe", &actions, &attr, args, env);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(fds[0]);
+    close(fds[3]);
+    close(fds[4]);
+    if (result != 0) {
+        close(fds[1]);
+        close(fds[2]);
+        close(fds[5]);
+        return false;
+    }
+    worker.pid = pid;
+    worker.input_fd = fds[1];
+    worker.output_fd = fds[2];
+    worker.control_fd = fds[5];
+    fcntl(worker.input_fd, F_SETFL, O_NONBLOCK);
+    fcntl(worker.output_fd, F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+/*
+ * Body of a worker, which main() runs when given WORKER_FLAG: waits for
+ * the interpreter, script and environment, each NUL-terminated, on
+ * WORKER_CONTROL_FD and executes them
+ * End of file without them retires the worker. Returns the exit status.
+ */
+int CgiProcess::runWorker() {
+    std::string message;
+    char buffer[4096];
+    ssize_t bytes_read;
+    while ((bytes_read = read(WORKER_CONTROL_FD, buffer, sizeof(buffer))) > 0) {
+        message.append(buffer, bytes_read);
+    }
+    close(WORKER_CONTROL_FD);
+
+    std::vector<char*> fields;
+    size_t field_start = 0;
+    size_t field_end;
+    while ((field_end = message.find('\0', field_start)) != std::string::npos) {
+        fields.push_back(&message[field_start]);
+        field_start = field_end + 1;
+    }
+    if (fields.size() < 2) {
+        return 0;
+    }
+    char* args[] = { fields[0], fields[1], NULL };
+    std::vector<char*> env_array(fields.begin() + 2, fields.end());
+    env_array.push_back(NULL);
+    execve(fields[0], args, &env_array[0]);
+    return 1;
+}
+
+/*
+ * Closes the pipes of a worker that is not needed any more and waits for
+ * it, unless it was reaped already (pid -1); a worker exits as soon as
+ * its control pipe closes
+ */
+void CgiProcess::retireWorker(Worker& worker) {
+    int fds[3] = { worker.input_fd, worker.output_fd, worker.control_fd };
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    worker.input_fd = -1;
+    worker.output_fd = -1;
+    worker.control_fd = -1;
+    if (worker.pid > 0) {
+        waitpid(worker.pid, NULL, 0);
+    }
+}
+
+/*
+ * Writes as much of the body as the pipe takes; closes stdin once all
+ * of it is written or the script stopped reading
+ */
+void CgiProcess::writeInput() {
+    if (_input_fd < 0) {
+        return;
+    }
+    while (_input_sent < _input.size()) {
+        ssize_t written = write(_input_fd, _input.data() + _input_sent, _input.size() - _input_sent);
+        if (written < 0) {
+            return;    // pipe full, poll reports when it drains; a closed pipe reports POLLERR
+        }
+        _input_sent += written;
+    }
+    closeInput();
+    _input.clear();
+}
+
+/*
+ * Reads what the script has written so far, until OUTPUT_BUFFER bytes
+ * wait to be taken; the rest stays in the pipe and holds the script up
+ */
+void CgiProcess::readOutput() {
+    char buffer[65536];
+    while (_output_fd >= 0 && bufferedOutput() < OUTPUT_BUFFER) {
+        ssize_t bytes_read = read(_output_fd, buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            return;    // nothing more for now
+        }
+        if (bytes_read == 0) {
+            closeOutput();
+            endOutput();
+            return;
+        }
+        appendOutput(buffer, bytes_read);
+    }
+}
+
+/*
+ * Adds the pipes still open; stdout only while the client keeps up
+ */
+void CgiProcess::getPollFds(std::vector<pollfd>& fds) const {
+    pollfd pfd;
+    pfd.revents = 0;
+    if (_input_fd >= 0) {
+        pfd.fd = _input_fd;
+        pfd.events = POLLOUT;
+        fds.push_back(pfd);
+    }
+    if (_output_fd >= 0 && !isOutputPaused()) {
+        pfd.fd = _output_fd;
+        pfd.events = POLLIN;
+        fds.push_back(pfd);
+    }
+}
+
+/*
+ * Handles poll events on one of the pipes
+ * An error on stdin means the script exited or closed it without
+ * reading the whole body; the rest is dropped
+ */
+bool CgiProcess::handleEvent(int fd, short revents) {
+    if (fd < 0) {
+        return false;
+    }
+    if (fd == _input_fd) {
+        if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            closeInput();
+        } else {
+            writeInput();
+        }
+        return true;
+    }
+    if (fd == _output_fd) {
+        readOutput();
+        if (_output_fd < 0) {
+            // The exit usually comes with end of output; SIGCHLD covers the rest
+            reap();
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Collects the child's exit status if it has exited
+ */
+void CgiProcess::reap() {
+    if (!_exited && _pid > 0) {
+        int status;
+        if (waitpid(_pid, &status, WNOHANG) == _pid) {
+            setExitStatus(status);
+        }
+    }
+}
+
+/*
+ * Records the status waitpid() reported for the child
+ */
+void CgiProcess::setExitStatus(int status) {
+    _exited = true;
+    _status = status;
+    markUpdated();
+}
+
+/*
+ * Stops the script and closes its pipes
+ * The child still has to be reaped; a process that never got to start
+ * is finished as failed right away
+ */
+void CgiProcess::abort() {
+    if (_pid <= 0 && !_exited) {
+        setExitStatus(W_EXITCODE(127, 0));
+    }
+    if (_pid > 0 && !_exited) {
+        ::kill(_pid, SIGKILL);
+    }
+    closeInput();
+    closeOutput();
+}
+
+/*
+ * Returns the process id of the child
+ */
+pid_t CgiProcess::getPid() const {
+    return _pid;
+}
+
+/*
+ * Returns whether the script closed its output
+ */
+bool CgiProcess::isOutputComplete() const {
+    return _output_fd < 0;
+}
+
+/*
+ * Returns whether the script closed its output and exited
+ */
+bool CgiProcess::isFinished() const {
+    return _output_fd < 0 && _exited;
+}
+
+/*
+ * Returns whether the script exited with status 0
+ */
+bool CgiProcess::succeeded() const {
+    return _exited && WIFEXITED(_status) && WEXITSTATUS(_status) == 0;
+}
+
+/*
+ * A script that failed is answered with 500
+ */
+int CgiProcess::getErrorStatus() const {
+    return 500;
+}
+
+/*
+ * Names the child for log messages; a script still waiting for a pool
+ * slot has no process yet
+ */
+std::string CgiProcess::describe() const {
+    if (_pid <= 0) {
+        return _exited ? "Failed CGI" : "Queued CGI";
+    }
+    std::ostringstream name;
+    name << "CGI " << _pid;
+    return name.str();
+}
+
+/*
+ * Blocks SIGCHLD and returns a signalfd that reports it, or -1
+ * The event loop polls it to learn when a script has exited
+ */
+int CgiProcess::openChildSignalFd() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+        return -1;
+    }
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Warning: no signalfd, CGI children are reaped on a timer" << std::endl;
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
+    return fd;
+}
+
+/*
+ * Reads the pending SIGCHLD notifications; several exits may be merged
+ * into one, so the caller checks every running child afterwards
+ */
+void CgiProcess::drainChildSignals(int fd) {
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) > 0) {
+    }
+}
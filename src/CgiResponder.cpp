@@ -0,0 +1,166 @@
+#include "CgiResponder.hpp"
+#include "ServerClock.hpp"
+
+/*
+ * Default constructor for CgiResponder
+ */
+CgiResponder::CgiResponder()
+    : _header_scan(0), _headers_done(false), _activity_time(ServerClock::now()),
+      _updated(false), _output_paused(false) {}
+
+/*
+ * Destructor for CgiResponder
+ */
+CgiResponder::~CgiResponder() {}
+
+/*
+ * Adds output the script produced: to the header block until that ends,
+ * to the body after
+ */
+void CgiResponder::appendOutput(const char* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    touch();
+    markUpdated();
+    if (_headers_done) {
+        _output.append(data, size);
+    } else {
+        _header_block.append(data, size);
+        parseHeaderLines();
+    }
+}
+
+/*
+ * Called at the end of the output
+ * Output without a blank line at all was body
+ */
+void CgiResponder::endOutput() {
+    markUpdated();
+    if (!_headers_done) {
+        endHeaders(0);
+    }
+}
+
+/*
+ * Parses the header lines completed so far; a blank line ends the block
+ * Output that does not look like CGI headers is taken as body, the way
+ * scripts that print no headers were always served
+ */
+void CgiResponder::parseHeaderLines() {
+    size_t line_end;
+    while ((line_end = _header_block.find('\n', _header_scan)) != std::string::npos) {
+        size_t length = line_end - _header_scan;
+        if (length > 0 && _header_block[line_end - 1] == '\r') {
+            --length;
+        }
+        if (length == 0) {
+            endHeaders(line_end + 1);
+            return;
+        }
+        size_t colon = _header_block.find(':', _header_scan);
+        if (colon == std::string::npos || colon >= _header_scan + length || colon == _header_scan) {
+            endHeaders(0);
+            return;
+        }
+        size_t value_start = colon + 1;
+        while (value_start < _header_scan + length &&
+               (_header_block[value_start] == ' ' || _header_block[value_start] == '\t')) {
+            ++value_start;
+        }
+        _headers.push_back(HeaderField(_header_block.substr(_header_scan, colon - _header_scan),
+                                       _header_block.substr(value_start, _header_scan + length - value_start)));
+        _header_scan = line_end + 1;
+    }
+    if (_header_block.size() > MAX_HEADER_SIZE) {
+        endHeaders(0);
+    }
+}
+
+/*
+ * Ends the header block; output from body_start on is body
+ * body_start 0 means there were no headers after all
+ */
+void CgiResponder::endHeaders(size_t body_start) {
+    if (body_start == 0) {
+        _headers.clear();
+    }
+    _output.assign(_header_block, body_start, std::string::npos);
+    _header_block.clear();
+    _headers_done = true;
+}
+
+/*
+ * Records activity, which holds off the timeout
+ */
+void CgiResponder::touch() {
+    _activity_time = ServerClock::now();
+}
+
+/*
+ * Flags a change the connection handler has to look at
+ */
+void CgiResponder::markUpdated() {
+    _updated = true;
+}
+
+/*
+ * Returns how much output is read but not taken yet
+ */
+size_t CgiResponder::bufferedOutput() const {
+    return _header_block.size() + _output.size();
+}
+
+/*
+ * Returns whether the header block is complete
+ * Body output is only handed out after that
+ */
+bool CgiResponder::hasHeaders() const {
+    return _headers_done;
+}
+
+/*
+ * Returns the header fields the script printed, in order
+ */
+const std::vector<CgiResponder::HeaderField>& CgiResponder::getHeaders() const {
+    return _headers;
+}
+
+/*
+ * Returns the body output read since the last call and forgets it
+ */
+std::string CgiResponder::takeOutput() {
+    std::string output;
+    output.swap(_output);
+    return output;
+}
+
+/*
+ * Returns when the script last produced output, or was started
+ */
+time_t CgiResponder::getLastActivityTime() const {
+    return _activity_time;
+}
+
+/*
+ * Returns whether output arrived or the request ended since the last call
+ */
+bool CgiResponder::takeUpdate() {
+    bool updated = _updated;
+    _updated = false;
+    return updated;
+}
+
+/*
+ * Stops or resumes reading output while the client catches up
+ */
+void CgiResponder::setOutputPaused(bool paused) {
+    _output_paused = paused;
+}
+
+/*
+ * Returns whether output reading is paused
+ */
+bool CgiResponder::isOutputPaused() const {
+    return _output_paused;
+}
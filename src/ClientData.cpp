@@ -1,11 +1,11 @@
 #include "ClientData.hpp"
-#include <ctime>
+#include "ServerClock.hpp"
 
 /*
  * Default constructor for ClientData
  * Initializes with empty buffers and zero bytes sent
  */
-ClientData::ClientData() : _bytes_sent(0), _connection_time(time(NULL)), _last_activity_time(time(NULL)), _keep_alive(false) {}
+ClientData::ClientData() : _output_offset(0), _output_size(0), _connection_time(ServerClock::now()), _last_activity_time(ServerClock::now()), _keep_alive(false), _virtual_hosts(NULL), _server_index(0) {}
 
 /*
  * Destructor for ClientData
@@ -23,19 +23,19 @@ const std::string& ClientData::getReadBuffer() const {
 }
 
 /*
- * Returns the write buffer containing data to be sent to the client
- * Used for accessing outgoing HTTP response data
+ * Returns whether response data is still waiting to be sent
+ * Used for deciding whether the client needs POLLOUT
  */
-const std::string& ClientData::getWriteBuffer() const {
-    return _write_buffer;
+bool ClientData::hasPendingOutput() const {
+    return _output_size > 0;
 }
 
 /*
- * Returns the number of bytes already sent to the client
- * Used for tracking partial write progress
+ * Returns the number of unsent bytes in the output queue
+ * Used for backpressure and progress reporting
  */
-size_t ClientData::getBytesSent() const {
-    return _bytes_sent;
+size_t ClientData::getPendingOutputSize() const {
+    return _output_size;
 }
 
 /*
@@ -63,22 +63,6 @@ void ClientData::setReadBuffer(const std::string& buffer) {
     _read_buffer = buffer;
 }
 
-/*
- * Sets the write buffer with new data
- * Used for preparing HTTP response data for sending
- */
-void ClientData::setWriteBuffer(const std::string& buffer) {
-    _write_buffer = buffer;
-}
-
-/*
- * Sets the number of bytes sent to the client
- * Used for tracking write progress during partial sends
- */
-void ClientData::setBytesSent(size_t bytes_sent) {
-    _bytes_sent = bytes_sent;
-}
-
 // Buffer operations
 /*
  * Appends string data to the read buffer
@@ -104,12 +88,61 @@ void ClientData::clearReadBuffer() {
     _read_buffer.clear();
 }
 
+// Output queue operations
+/*
+ * Appends a buffer to the output queue
+ * Only a reference is taken, so shared content is never copied per client
+ */
+void ClientData::queueOutput(const SharedBuffer& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+    _output_queue.push_back(buffer);
+    _output_size += buffer.size();
+}
+
 /*
- * Clears the write buffer
- * Used for resetting the client's outgoing data buffer
+ * Describes the unsent data as up to max_segments iovecs for writev()
+ * Returns the number of iovecs filled
  */
-void ClientData::clearWriteBuffer() {
-    _write_buffer.clear();
+size_t ClientData::fillOutputVector(struct iovec* iov, size_t max_segments) const {
+    size_t count = 0;
+    for (std::deque<SharedBuffer>::const_iterator it = _output_queue.begin();
+         it != _output_queue.end() && count < max_segments; ++it) {
+        size_t skip = (count == 0) ? _output_offset : 0;
+        iov[count].iov_base = const_cast<char*>(it->data() + skip);
+        iov[count].iov_len = it->size() - skip;
+        ++count;
+    }
+    return count;
+}
+
+/*
+ * Drops bytes that were written to the socket from the front of the queue
+ * Fully sent buffers release their reference
+ */
+void ClientData::consumeOutput(size_t bytes) {
+    _output_size -= bytes;
+    while (bytes > 0 && !_output_queue.empty()) {
+        size_t remaining = _output_queue.front().size() - _output_offset;
+        if (bytes < remaining) {
+            _output_offset += bytes;
+            return;
+        }
+        bytes -= remaining;
+        _output_queue.pop_front();
+        _output_offset = 0;
+    }
+}
+
+/*
+ * Discards all queued output
+ * Used when a response is abandoned
+ */
+void ClientData::clearOutput() {
+    _output_queue.clear();
+    _output_offset = 0;
+    _output_size = 0;
 }
 
 /*
@@ -128,12 +161,59 @@ void ClientData::setKeepAlive(bool keep_alive) {
     _keep_alive = keep_alive;
 }
 
+/*
+ * Returns the server blocks of the listener this connection arrived on
+ * Used for resolving the Host header of each request
+ */
+const VirtualHostTable* ClientData::getVirtualHosts() const {
+    return _virtual_hosts;
+}
+
+/*
+ * Returns the index of the server block handling the current request
+ * Used for picking locations and error pages
+ */
+size_t ClientData::getServerIndex() const {
+    return _server_index;
+}
+
+/*
+ * Returns the IP address the client connected from
+ */
+const std::string& ClientData::getRemoteAddr() const {
+    return _remote_addr;
+}
+
+/*
+ * Caches the listener's server blocks on the connection
+ * Set once when the connection is accepted
+ */
+void ClientData::setVirtualHosts(const VirtualHostTable* virtual_hosts) {
+    _virtual_hosts = virtual_hosts;
+}
+
+/*
+ * Sets the index of the server block handling the current request
+ * Starts as the listener's default and follows each request's Host
+ */
+void ClientData::setServerIndex(size_t server_index) {
+    _server_index = server_index;
+}
+
+/*
+ * Sets the IP address the client connected from
+ * Called when the connection is accepted
+ */
+void ClientData::setRemoteAddr(const std::string& remote_addr) {
+    _remote_addr = remote_addr;
+}
+
 /*
  * Resets the connection time to current time
  * Used for keep-alive connections to restart timeout counter
  */
 void ClientData::resetConnectionTime() {
-    _connection_time = time(NULL);
+    _connection_time = ServerClock::now();
 }
 
 /*
@@ -141,5 +221,5 @@ void ClientData::resetConnectionTime() {
  * Used to track when the client last sent data or we processed a request
  */
 void ClientData::updateLastActivity() {
-    _last_activity_time = time(NULL);
+    _last_activity_time = ServerClock::now();
 }
\ No newline at end of file
@@ -1,15 +1,18 @@
 #include "ConfigParser.hpp"
+#include "FastCgiPool.hpp"
+#include "CgiPool.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cctype>
 #include <cstdlib>
+#include <regex.h>
 
 /*
  * Default constructor for ConfigParser
  * Initializes the parser with empty state
  */
-ConfigParser::ConfigParser() {}
+ConfigParser::ConfigParser() : _include_count(0) {}
 
 /*
  * Destructor for ConfigParser
@@ -49,6 +52,41 @@ bool ConfigParser::expectToken(const std::string& expected) {
     return true;
 }
 
+/*
+ * Parses a byte count with an optional k or m suffix (64k, 1m)
+ * Returns false if value is not a well-formed size
+ */
+bool ConfigParser::parseSize(const std::string& value, size_t& size) {
+    size_t digits = 0;
+    size_t result = 0;
+    while (digits < value.length() && value[digits] >= '0' && value[digits] <= '9') {
+        if (result > (static_cast<size_t>(-1) - 9) / 10) {
+            return false;
+        }
+        result = result * 10 + (value[digits] - '0');
+        ++digits;
+    }
+    if (digits == 0 || value.length() - digits > 1) {
+        return false;
+    }
+    size_t multiplier = 1;
+    if (digits < value.length()) {
+        char suffix = value[digits];
+        if (suffix == 'k' || suffix == 'K') {
+            multiplier = 1024;
+        } else if (suffix == 'm' || suffix == 'M') {
+            multiplier = 1024 * 1024;
+        } else {
+            return false;
+        }
+    }
+    if (result > static_cast<size_t>(-1) / multiplier) {
+        return false;
+    }
+    size = result * multiplier;
+    return true;
+}
+
 /*
  * Checks for multiple consecutive semicolons in the token stream
  * Returns true if multiple semicolons are found, false otherwise
@@ -204,6 +242,103 @@ std::vector<std::string> ConfigParser::parseHttpMethods() {
     return result;
 }
 
+/*
+ * Parses a types block: "type ext1 ext2 ...;" entries between braces
+ * Later entries for the same extension replace earlier ones
+ * Returns false on a syntax error
+ */
+bool ConfigParser::parseTypesBlock(std::map<std::string, std::string>& types) {
+    if (!hasNextToken() || getCurrentToken() != "{") {
+        std::cerr << "Error: Expected '{' after 'types'" << std::endl;
+        _validator.addError("Expected '{' after 'types'");
+        return false;
+    }
+    skipToken();
+    
+    while (hasNextToken() && getCurrentToken() != "}") {
+        std::string type = getNextToken();
+        if (type == "include") {
+            if (!parseInclude()) {
+                return false;
+            }
+            continue;
+        }
+        if (type == ";" || type == "{" || type.find('/') == std::string::npos) {
+            std::cerr << "Error: Expected MIME type in types block but found '" << type << "'" << std::endl;
+            _validator.addError("Expected MIME type in types block but found '" + type + "'");
+            return false;
+        }
+        
+        bool has_extension = false;
+        while (hasNextToken() && getCurrentToken() != ";" && getCurrentToken() != "}" && getCurrentToken() != "{") {
+            std::string extension = getNextToken();
+            for (size_t i = 0; i < extension.length(); ++i) {
+                extension[i] = std::tolower(static_cast<unsigned char>(extension[i]));
+            }
+            types[extension] = type;
+            has_extension = true;
+        }
+        if (!has_extension) {
+            std::cerr << "Error: Expected extensions after MIME type '" << type << "'" << std::endl;
+            _validator.addError("Expected extensions after MIME type '" + type + "'");
+            return false;
+        }
+        if (!expectToken(";")) {
+            _validator.addError("Expected ';' after MIME type entry");
+            return false;
+        }
+    }
+    
+    if (!hasNextToken()) {
+        std::cerr << "Error: Expected '}' at end of types block" << std::endl;
+        _validator.addError("Expected '}' at end of types block");
+        return false;
+    }
+    skipToken();
+    return true;
+}
+
+/*
+ * Handles "include path;" by splicing the file's tokens into the stream
+ * Relative paths are resolved against the main config file's directory
+ * Returns false if the file cannot be read or includes nest too deeply
+ */
+bool ConfigParser::parseInclude() {
+    if (!hasNextToken() || getCurrentToken() == ";") {
+        std::cerr << "Error: Expected file path after 'include'" << std::endl;
+        _validator.addError("Expected file path after 'include'");
+        return false;
+    }
+    std::string path = getNextToken();
+    if (!expectToken(";")) {
+        _validator.addError("Expected ';' after include directive");
+        return false;
+    }
+    
+    if (++_include_count > 64) {
+        std::cerr << "Error: Too many include directives (recursive include?)" << std::endl;
+        _validator.addError("Too many include directives");
+        return false;
+    }
+    
+    if (path[0] != '/') {
+        path = _config_dir + path;
+    }
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open included file: " << path << std::endl;
+        _validator.addError("Could not open included file: " + path);
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    
+    ConfigTokenizer included;
+    included.tokenize(buffer.str());
+    _tokenizer.insertTokens(included.getTokens());
+    return true;
+}
+
 /*
  * Parses a location block from the configuration file
  * Handles location path and all location-specific directives
@@ -212,9 +347,42 @@ std::vector<std::string> ConfigParser::parseHttpMethods() {
 Location ConfigParser::parseLocationBlock() {
     Location location;
     
-    // Parse location path
+    // Parse optional modifier and location path
     if (hasNextToken()) {
-        location.setPath(getNextToken());
+        std::string token = getNextToken();
+        if (token == "=" || token == "^~" || token == "~" || token == "~*") {
+            if (token == "=") {
+                location.setMatchType(Location::MATCH_EXACT);
+            } else if (token == "^~") {
+                location.setMatchType(Location::MATCH_PREFIX_NO_REGEX);
+            } else if (token == "~") {
+                location.setMatchType(Location::MATCH_REGEX);
+            } else {
+                location.setMatchType(Location::MATCH_REGEX_CASELESS);
+            }
+            if (!hasNextToken() || getCurrentToken() == "{") {
+                std::cerr << "Error: Expected location path after '" << token << "'" << std::endl;
+                _validator.addError("Expected location path after '" + token + "'");
+                return location;
+            }
+            token = getNextToken();
+        }
+        location.setPath(token);
+    }
+    
+    // Regex locations are compiled here once to reject bad patterns at load
+    if (location.isRegex()) {
+        regex_t compiled;
+        int flags = REG_EXTENDED | REG_NOSUB;
+        if (location.getMatchType() == Location::MATCH_REGEX_CASELESS) {
+            flags |= REG_ICASE;
+        }
+        if (regcomp(&compiled, location.getPath().c_str(), flags) != 0) {
+            std::cerr << "Error: Invalid regular expression in location: " << location.getPath() << std::endl;
+            _validator.addError("Invalid regular expression in location: " + location.getPath());
+            return location;
+        }
+        regfree(&compiled);
     }
     
     // Expect opening brace
@@ -285,6 +453,138 @@ Location ConfigParser::parseLocationBlock() {
                 return location;
             }
             skipToken();
+        } else if (directive == "autoindex_format") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (value == "html") {
+                location.setAutoindexFormat(Location::AUTOINDEX_HTML);
+            } else if (value == "json") {
+                location.setAutoindexFormat(Location::AUTOINDEX_JSON);
+            } else {
+                std::cerr << "Error: autoindex_format must be 'html' or 'json'" << std::endl;
+                _validator.addError("autoindex_format must be 'html' or 'json'");
+                return location;
+            }
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after autoindex_format directive");
+                return location;
+            }
+        } else if (directive == "upload_fsync") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (value == "off") {
+                location.setUploadFsync(Location::UPLOAD_FSYNC_OFF);
+            } else if (value == "commit") {
+                location.setUploadFsync(Location::UPLOAD_FSYNC_COMMIT);
+            } else if (value == "always") {
+                location.setUploadFsync(Location::UPLOAD_FSYNC_ALWAYS);
+            } else {
+                std::cerr << "Error: upload_fsync must be 'off', 'commit' or 'always'" << std::endl;
+                _validator.addError("upload_fsync must be 'off', 'commit' or 'always'");
+                return location;
+            }
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after upload_fsync directive");
+                return location;
+            }
+        } else if (directive == "autoindex_sort") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (value != "on" && value != "off") {
+                std::cerr << "Error: autoindex_sort must be 'on' or 'off'" << std::endl;
+                _validator.addError("autoindex_sort must be 'on' or 'off'");
+                return location;
+            }
+            location.setAutoindexSort(value == "on");
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after autoindex_sort directive");
+                return location;
+            }
+        } else if (directive == "bundle") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (value.empty() || value == ";") {
+                std::cerr << "Error: Expected bundle file after 'bundle'" << std::endl;
+                _validator.addError("Expected bundle file after 'bundle'");
+                return location;
+            }
+            location.setBundle(value);
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after bundle directive");
+                return location;
+            }
+        } else if (directive == "fastcgi_pass") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (!FastCgiPool::isValidAddress(value)) {
+                std::cerr << "Error: fastcgi_pass must be unix:/path or host:port" << std::endl;
+                _validator.addError("fastcgi_pass must be unix:/path or host:port");
+                return location;
+            }
+            location.setFastcgiPass(value);
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after fastcgi_pass directive");
+                return location;
+            }
+        } else if (directive == "cgi_pool") {
+            size_t size = 0;
+            size_t idle = 0;
+            bool idle_set = false;
+            bool valid = true;
+            while (valid && hasNextToken() && getCurrentToken() != ";") {
+                std::string option = getNextToken();
+                size_t equals = option.find('=');
+                if (equals == std::string::npos) {
+                    valid = false;
+                    break;
+                }
+                char* end;
+                const char* number = option.c_str() + equals + 1;
+                unsigned long value = std::strtoul(number, &end, 10);
+                std::string name = option.substr(0, equals);
+                if (end == number || *end != '\0') {
+                    valid = false;
+                } else if (name == "size") {
+                    size = value;
+                } else if (name == "idle") {
+                    idle = value;
+                    idle_set = true;
+                } else {
+                    valid = false;
+                }
+            }
+            if (!idle_set) {
+                idle = size;
+            }
+            if (!valid || size == 0 || size > CgiPool::MAX_SIZE || idle > size) {
+                std::cerr << "Error: cgi_pool expects size=N (1-256) and optionally idle=M (at most N)" << std::endl;
+                _validator.addError("cgi_pool expects size=N (1-256) and optionally idle=M (at most N)");
+                return location;
+            }
+            location.setCgiPool(size, idle);
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after cgi_pool directive");
+                return location;
+            }
+        } else if (directive == "preload") {
+            std::string value = hasNextToken() ? getNextToken() : "";
+            if (value != "on" && value != "off") {
+                std::cerr << "Error: preload must be 'on' or 'off'" << std::endl;
+                _validator.addError("preload must be 'on' or 'off'");
+                return location;
+            }
+            location.setPreload(value == "on");
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after preload directive");
+                return location;
+            }
+        } else if (directive == "preload_max_size") {
+            size_t max_size = 0;
+            if (!hasNextToken() || !parseSize(getNextToken(), max_size)) {
+                std::cerr << "Error: preload_max_size expects a size such as 65536, 64k or 1m" << std::endl;
+                _validator.addError("preload_max_size expects a size such as 65536, 64k or 1m");
+                return location;
+            }
+            location.setPreloadMaxSize(max_size);
+            if (!expectToken(";")) {
+                _validator.addError("Expected ';' after preload_max_size directive");
+                return location;
+            }
         } else if (directive == "index") {
             std::vector<std::string> indexFiles = parseStringList();
             // Check for errors after parsing string list
@@ -568,6 +868,18 @@ ServerConfig ConfigParser::parseServerBlock() {
                 return config;
             }
             skipToken();
+        } else if (directive == "types") {
+            std::map<std::string, std::string> types;
+            if (!parseTypesBlock(types)) {
+                return config;
+            }
+            for (std::map<std::string, std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+                config.addMimeType(it->first, it->second, true);
+            }
+        } else if (directive == "include") {
+            if (!parseInclude()) {
+                return config;
+            }
         } else if (directive == "location") {
             Location loc = parseLocationBlock();
             // Check for errors after parsing location block
@@ -614,6 +926,11 @@ std::vector<ServerConfig> ConfigParser::parse(const std::string& config_file) {
     std::string content = buffer.str();
     file.close();
     
+    size_t slash = config_file.rfind('/');
+    _config_dir = (slash == std::string::npos) ? "" : config_file.substr(0, slash + 1);
+    _include_count = 0;
+    _global_types.clear();
+    
     _tokenizer.tokenize(content);
     _validator.resetErrors();
     
@@ -631,6 +948,16 @@ std::vector<ServerConfig> ConfigParser::parse(const std::string& config_file) {
                 servers.clear();
                 return servers;
             }
+        } else if (token == "types") {
+            if (!parseTypesBlock(_global_types)) {
+                servers.clear();
+                return servers;
+            }
+        } else if (token == "include") {
+            if (!parseInclude()) {
+                servers.clear();
+                return servers;
+            }
         } else {
             std::cerr << "Error: Unknown top-level directive '" << token << "'" << std::endl;
             _validator.addError("Unknown top-level directive '" + token + "'");
@@ -639,5 +966,13 @@ std::vector<ServerConfig> ConfigParser::parse(const std::string& config_file) {
         }
     }
     
+    // Top-level types apply to every server, under the server's own types
+    for (size_t i = 0; i < servers.size(); ++i) {
+        for (std::map<std::string, std::string>::const_iterator it = _global_types.begin();
+             it != _global_types.end(); ++it) {
+            servers[i].addMimeType(it->first, it->second, false);
+        }
+    }
+    
     return servers;
-}
\ No newline at end of file
+}
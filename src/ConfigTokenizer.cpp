@@ -164,4 +164,12 @@ size_t ConfigTokenizer::getCurrentPosition() const {
  */
 void ConfigTokenizer::setPosition(size_t position) {
     _current_token = position;
-}
\ No newline at end of file
+}
+
+/*
+ * Inserts tokens at the current position so they are read next
+ * Used for splicing in the contents of included files
+ */
+void ConfigTokenizer::insertTokens(const std::vector<std::string>& tokens) {
+    _tokens.insert(_tokens.begin() + _current_token, tokens.begin(), tokens.end());
+}
@@ -31,7 +31,12 @@ bool ConfigValidator::isKnownDirective(const std::string& directive) const {
             directive == "methods" || directive == "allow_methods" || directive == "upload_path" || 
             directive == "cgi_extension" || directive == "cgi_extensions" || directive == "return" || 
             directive == "listen" || directive == "server_name" || directive == "error_page" || 
-            directive == "client_max_body_size" || directive == "location");
+            directive == "client_max_body_size" || directive == "location" ||
+            directive == "types" || directive == "include" ||
+            directive == "autoindex_format" || directive == "autoindex_sort" ||
+            directive == "preload" || directive == "preload_max_size" || directive == "bundle" ||
+            directive == "upload_fsync" || directive == "fastcgi_pass" ||
+            directive == "cgi_pool");
 }
 
 /*
@@ -1,4 +1,7 @@
 #include "ConnectionHandler.hpp"
+#include "ServerClock.hpp"
+#include "MultipartUpload.hpp"
+#include "PutUpload.hpp"
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -8,17 +11,19 @@
 #include <ctime>
 #include <map>
 #include <sys/stat.h>
-#include <dirent.h>
 #include <sys/wait.h>
 #include <cstdlib>
 #include <cstdio>
+#include <algorithm>
 
 
 /*
  * Default constructor for ConnectionHandler
  * Initializes the connection handler with empty client map
  */
-ConnectionHandler::ConnectionHandler() : _server_configs(NULL) {}
+ConnectionHandler::ConnectionHandler()
+    : _server_configs(NULL), _active_server(NULL), _active_client(NULL), _next_cgi_job(0), _started_cgi(NULL),
+      _child_signal_fd(CgiProcess::openChildSignalFd()) {}
 
 /*
  * Destructor for ConnectionHandler
@@ -26,13 +31,205 @@ ConnectionHandler::ConnectionHandler() : _server_configs(NULL) {}
  */
 ConnectionHandler::~ConnectionHandler() {
     closeAllClients();
+    for (std::map<unsigned long, CgiJob>::iterator it = _cgi_jobs.begin(); it != _cgi_jobs.end(); ++it) {
+        delete it->second.responder;
+    }
+    _cgi_jobs.clear();
+    if (_child_signal_fd >= 0) {
+        close(_child_signal_fd);
+    }
+    clearServerContexts();
 }
 
 /*
  * Sets the server configurations for location matching
+ * Builds the per-server runtime state (prepared error pages, ...) once
  */
 void ConnectionHandler::setServerConfigs(const std::vector<ServerConfig>& configs) {
+    clearServerContexts();
+    _file_cache.clear(); // entries point into the old MIME tables
     _server_configs = &configs;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        _server_contexts.push_back(new ServerContext(configs[i]));
+        const std::vector<Location>& locations = configs[i].getLocations();
+        for (size_t j = 0; j < locations.size(); ++j) {
+            if (locations[j].getCgiPoolSize() > 0) {
+                _cgi_pools[&locations[j]] = new CgiPool(locations[j].getPath(), locations[j].getCgiPoolSize(),
+                                                        locations[j].getCgiPoolIdle());
+            }
+        }
+    }
+    watchDocumentRoots();
+}
+
+/*
+ * Starts watching every location root for changes
+ * Cached stat results, files and listings under a watched directory are
+ * then kept until the watcher reports a change instead of being re-checked
+ */
+void ConnectionHandler::watchDocumentRoots() {
+    _file_watcher.stop();
+    _stat_cache.clear();
+    _listing_cache.clear();
+    _index_cache.clear();
+    _missing_paths.clear();
+    if (!_server_configs || !_file_watcher.start()) {
+        return;
+    }
+    for (size_t i = 0; i < _server_configs->size(); ++i) {
+        const std::vector<Location>& locations = (*_server_configs)[i].getLocations();
+        for (size_t j = 0; j < locations.size(); ++j) {
+            std::string root = FileWatcher::normalize(locations[j].getRoot());
+            if (!root.empty() && !_file_watcher.isWatched(root)) {
+                _file_watcher.watchTree(root);
+            }
+        }
+    }
+}
+
+/*
+ * Returns the watcher descriptor for the event loop, or -1 if there is none
+ */
+int ConnectionHandler::getWatcherFd() const {
+    return _file_watcher.getFd();
+}
+
+/*
+ * Applies the changes reported by the file watcher to every cache
+ * If events were lost, all cached state is dropped
+ */
+void ConnectionHandler::handleFileEvents() {
+    std::vector<std::string> paths;
+    if (!_file_watcher.readChanges(paths)) {
+        _missing_paths.clear();
+        _stat_cache.clear();
+        _file_cache.clear();
+        _listing_cache.clear();
+        _index_cache.clear();
+        for (size_t i = 0; i < _server_contexts.size(); ++i) {
+            _server_contexts[i]->clearPreloaded();
+        }
+        return;
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        invalidatePath(paths[i]);
+    }
+}
+
+/*
+ * Forgets everything cached about path, its directory and anything below it
+ * A change inside a directory also changes the directory's own stat and listing
+ */
+void ConnectionHandler::invalidatePath(const std::string& path) {
+    _missing_paths.invalidate(path);
+    _missing_paths.invalidateTree(path);
+    _stat_cache.invalidate(path);
+    _stat_cache.invalidateTree(path);
+    _file_cache.invalidate(path);
+    _file_cache.invalidateTree(path);
+    _listing_cache.invalidate(path);
+    for (size_t i = 0; i < _server_contexts.size(); ++i) {
+        _server_contexts[i]->invalidatePreloaded(path);
+    }
+    
+    size_t slash = path.rfind('/');
+    if (slash != std::string::npos && slash > 0) {
+        std::string parent = path.substr(0, slash);
+        _stat_cache.invalidate(parent);
+        _listing_cache.invalidate(parent);
+    }
+}
+
+/*
+ * stat() for files being served, answered from the stat cache when the
+ * containing directory is watched and from the negative cache for paths
+ * that recently did not exist
+ * Returns false if the path does not exist
+ */
+bool ConnectionHandler::statPath(const std::string& path, struct stat& st) {
+    std::string key = FileWatcher::normalize(path);
+    size_t slash = key.rfind('/');
+    bool watched = slash != std::string::npos && slash > 0 &&
+                   _file_watcher.isWatched(key.substr(0, slash));
+    
+    if (watched && _stat_cache.lookup(key, st)) {
+        return true;
+    }
+    if (_missing_paths.contains(key)) {
+        return false;
+    }
+    if (stat(key.c_str(), &st) != 0) {
+        _missing_paths.store(key, _file_watcher.coversTree(key));
+        return false;
+    }
+    if (watched) {
+        _stat_cache.store(key, st);
+    }
+    return true;
+}
+
+/*
+ * Frees the per-server runtime state and the per-listener server sets
+ */
+void ConnectionHandler::clearServerContexts() {
+    for (size_t i = 0; i < _server_contexts.size(); ++i) {
+        delete _server_contexts[i];
+    }
+    _server_contexts.clear();
+    _active_server = NULL;
+    _active_client = NULL;
+    
+    for (std::map<const Location*, CgiPool*>::iterator it = _cgi_pools.begin(); it != _cgi_pools.end(); ++it) {
+        delete it->second;
+    }
+    _cgi_pools.clear();
+    
+    for (std::map<int, VirtualHostTable*>::iterator it = _listeners.begin(); it != _listeners.end(); ++it) {
+        delete it->second;
+    }
+    _listeners.clear();
+}
+
+/*
+ * Registers a server block as listening on listen_sock
+ * Several server blocks may share one socket; the first is the default
+ */
+void ConnectionHandler::addListenerServer(int listen_sock, size_t server_index) {
+    if (!_server_configs || server_index >= _server_configs->size()) {
+        return;
+    }
+    VirtualHostTable*& virtual_hosts = _listeners[listen_sock];
+    if (!virtual_hosts) {
+        virtual_hosts = new VirtualHostTable();
+    }
+    virtual_hosts->addServer(server_index, (*_server_configs)[server_index]);
+}
+
+/*
+ * Resolves the request's Host header among the listener's server blocks
+ * The result is kept on the client for the rest of this request
+ */
+void ConnectionHandler::selectVirtualHost(ClientData& client, const HttpRequest& request) {
+    const VirtualHostTable* virtual_hosts = client.getVirtualHosts();
+    if (virtual_hosts) {
+        client.setServerIndex(virtual_hosts->resolve(request.getHeader("host")));
+    }
+    selectServer(client);
+}
+
+/*
+ * Makes the client's server block the one used for locations and error pages
+ * Called before handling anything on behalf of that client
+ */
+void ConnectionHandler::selectServer(const ClientData& client) {
+    _active_client = &client;
+    if (client.getServerIndex() < _server_contexts.size()) {
+        _active_server = _server_contexts[client.getServerIndex()];
+    } else if (!_server_contexts.empty()) {
+        _active_server = _server_contexts[0];
+    } else {
+        _active_server = NULL;
+    }
 }
 
 /*
@@ -43,6 +240,8 @@ void ConnectionHandler::closeAllClients() {
     
     for (std::map<int, ClientData>::iterator it = _clients.begin(); 
          it != _clients.end(); ++it) {
+        dropBodyStream(it->first);
+        dropCgiJob(it->first);
         _socket_manager.closeSocket(it->first);
     }
     _clients.clear();
@@ -54,32 +253,68 @@ void ConnectionHandler::closeAllClients() {
  * Returns list of clients that need POLLOUT events
  */
 std::vector<int> ConnectionHandler::checkEmptyRequestTimeouts() {
-    time_t current_time = time(NULL);
+    time_t current_time = ServerClock::now();
     std::vector<int> clients_needing_pollout;
     
     for (std::map<int, ClientData>::iterator it = _clients.begin(); 
          it != _clients.end(); ++it) {
         int client_sock = it->first;
         ClientData& client = it->second;
+        selectServer(client);
         
         time_t last_activity_time = client.getLastActivityTime();
         time_t elapsed_since_activity = current_time - last_activity_time;
         
+        if (_body_streams.find(client_sock) != _body_streams.end()) {
+            // Streaming uploads only time out when the body stops arriving
+            if (elapsed_since_activity >= 10 && !client.hasPendingOutput()) {
+                std::cout << "Upload timeout from client " << client_sock << std::endl;
+                dropBodyStream(client_sock);
+                HttpResponse response = createErrorResponse(408);
+                response.setConnection(false);
+                client.setKeepAlive(false);
+                queueResponse(client, response);
+                clients_needing_pollout.push_back(client_sock);
+            }
+            continue;
+        }
+        
+        std::map<int, unsigned long>::iterator parked = _cgi_clients.find(client_sock);
+        if (parked != _cgi_clients.end()) {
+            // Waiting for a script: it times out when its output stops,
+            // not while the client is slow to take it
+            const CgiJob& job = _cgi_jobs[parked->second];
+            if (!client.hasPendingOutput() &&
+                current_time - job.responder->getLastActivityTime() >= CgiResponder::TIMEOUT) {
+                std::cout << job.responder->describe() << " timed out for client " << client_sock << std::endl;
+                bool head_sent = job.head_sent;
+                dropCgiJob(client_sock);
+                client.setKeepAlive(false);
+                if (!head_sent) {
+                    HttpResponse response = createErrorResponse(504);
+                    response.setConnection(false);
+                    queueResponse(client, response);
+                }
+                clients_needing_pollout.push_back(client_sock);
+            }
+            continue;
+        }
+        
         // Check if client has been connected without sending data for too long
         // For keep-alive connections, don't timeout aggressively - they should wait for new requests
-        if (client.getReadBuffer().empty() && client.getWriteBuffer().empty() && !client.isKeepAlive()) {
+        if (client.getReadBuffer().empty() && !client.hasPendingOutput() && !client.isKeepAlive()) {
             // 10 second timeout for empty requests (only for non-keep-alive connections)
             if (elapsed_since_activity >= 10) {
                 std::cout << "Empty request timeout from client " << client_sock << std::endl;
                 
-                HttpResponse response = HttpResponse::createBadRequestResponse();
-                client.setWriteBuffer(response.toString());
-                client.setBytesSent(0);
+                HttpResponse response = createErrorResponse(400);
+                response.setConnection(false);
+                queueResponse(client, response);
                 
                 // This client now needs POLLOUT events to send the response
                 clients_needing_pollout.push_back(client_sock);
             }
-        } else if (!client.getReadBuffer().empty() && client.getWriteBuffer().empty()) {
+        } else if (!client.getReadBuffer().empty() && !client.hasPendingOutput()) {
             // Check for incomplete requests (have data but no response ready)
             // Try to parse the accumulated data to see if it's an incomplete request
             HttpRequest request;
@@ -95,9 +330,9 @@ std::vector<int> ConnectionHandler::checkEmptyRequestTimeouts() {
                     if (elapsed_since_activity >= 10) {
                         std::cout << "Incomplete request timeout from client " << client_sock << std::endl;
                         
-                        HttpResponse response = HttpResponse::createRequestTimeoutResponse();
-                        client.setWriteBuffer(response.toString());
-                        client.setBytesSent(0);
+                        HttpResponse response = createErrorResponse(408);
+                        response.setConnection(false);
+                        queueResponse(client, response);
                         
                         // This client now needs POLLOUT events to send the response
                         clients_needing_pollout.push_back(client_sock);
@@ -107,6 +342,22 @@ std::vector<int> ConnectionHandler::checkEmptyRequestTimeouts() {
         }
     }
     
+    // Worker connections left idle are closed and CGI pools topped up;
+    // requests failed along the way (a connection that could not be
+    // reopened, a queued script that could not be started) are answered here
+    _fastcgi.closeIdle(current_time);
+    for (std::map<const Location*, CgiPool*>::iterator it = _cgi_pools.begin(); it != _cgi_pools.end(); ++it) {
+        it->second->fill();
+        it->second->report(current_time);
+    }
+    std::map<unsigned long, CgiJob>::iterator job = _cgi_jobs.begin();
+    while (job != _cgi_jobs.end()) {
+        std::map<unsigned long, CgiJob>::iterator current = job++;
+        if (current->second.responder->takeUpdate()) {
+            pumpCgiJob(current, clients_needing_pollout);
+        }
+    }
+    
     return clients_needing_pollout;
 }
 
@@ -134,9 +385,16 @@ int ConnectionHandler::acceptNewConnection(int listen_sock) {
         return -1;
     }
     
-    _clients[client_sock] = ClientData();
+    ClientData& client = _clients[client_sock];
+    client = ClientData();
+    std::map<int, VirtualHostTable*>::const_iterator listener = _listeners.find(listen_sock);
+    if (listener != _listeners.end()) {
+        client.setVirtualHosts(listener->second);
+        client.setServerIndex(listener->second->getDefaultServer());
+    }
     
     std::string client_ip = SocketManager::ipToString(client_addr);
+    client.setRemoteAddr(client_ip);
     std::cout << "New connection from " << client_ip << ":" << ntohs(client_addr.sin_port) 
               << " (fd: " << client_sock << ")" << std::endl;
     
@@ -149,9 +407,24 @@ int ConnectionHandler::acceptNewConnection(int listen_sock) {
  * Creates appropriate HTTP response based on request
  */
 void ConnectionHandler::processClientData(int client_sock, const char* buffer, ssize_t bytes_read) {
+    if (_body_streams.find(client_sock) != _body_streams.end()) {
+        // Body of a streaming upload: straight to its sink, never buffered
+        _clients[client_sock].updateLastActivity();
+        selectServer(_clients[client_sock]);
+        feedBodyStream(client_sock, buffer, bytes_read);
+        return;
+    }
+    
+    if (_cgi_clients.find(client_sock) != _cgi_clients.end()) {
+        // Parked on a script: later requests wait until it has answered
+        _clients[client_sock].appendToReadBuffer(buffer, bytes_read);
+        return;
+    }
+    
     _clients[client_sock].appendToReadBuffer(buffer, bytes_read);
     // Update activity time when we receive data
     _clients[client_sock].updateLastActivity();
+    selectServer(_clients[client_sock]);
     
     std::cout << "Received " << bytes_read << " bytes from client " << client_sock << std::endl;
     
@@ -162,15 +435,26 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
     // Special handling for empty request (when client sends nothing and closes connection)
     if (bytes_read == 0 && accumulated_data.empty()) {
         std::cout << "Empty request from client " << client_sock << std::endl;
-        HttpResponse response = HttpResponse::createBadRequestResponse();
-        _clients[client_sock].setWriteBuffer(response.toString());
-        _clients[client_sock].setBytesSent(0);
+        HttpResponse response = createErrorResponse(400);
+        response.setConnection(false);
+        queueResponse(_clients[client_sock], response);
         _clients[client_sock].clearReadBuffer();
         return;
     }
     
+    // Uploads switch to streaming as soon as their headers are in
+    if ((accumulated_data.compare(0, 5, "POST ") == 0 || accumulated_data.compare(0, 4, "PUT ") == 0) &&
+        request.parseHeaders(accumulated_data)) {
+        selectVirtualHost(_clients[client_sock], request);
+        if (startBodyStream(client_sock, request, accumulated_data)) {
+            return;
+        }
+    }
+    
     if (request.parse(accumulated_data)) {
         if (request.isValid()) {
+            selectVirtualHost(_clients[client_sock], request);
+            
             // Check Content-Length against max_body_size before reading complete body
             if (request.hasHeader("Content-Length") || request.hasHeader("content-length")) {
                 size_t content_length = request.getContentLength();
@@ -180,9 +464,9 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
                               << " > " << server_config->getMaxBodySize() << std::endl;
                     
                     // Return 413 immediately without reading the body
-                    HttpResponse response = HttpResponse::createRequestEntityTooLargeResponse();
-                    _clients[client_sock].setWriteBuffer(response.toString());
-                    _clients[client_sock].setBytesSent(0);
+                    HttpResponse response = createErrorResponse(413);
+                    response.setConnection(false);
+                    queueResponse(_clients[client_sock], response);
                     _clients[client_sock].clearReadBuffer();
                     return;
                 }
@@ -197,7 +481,10 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
                 
                 // Handle keep-alive connections
                 bool should_keep_alive = request.isKeepAlive();
-                if (should_keep_alive) {
+                if (_started_cgi) {
+                    // The response comes once the script is done
+                    parkClient(client_sock, request, should_keep_alive);
+                } else if (should_keep_alive) {
                     response.setConnection(true);  // Set keep-alive
                     _clients[client_sock].setKeepAlive(true);
                 } else {
@@ -205,10 +492,9 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
                     _clients[client_sock].setKeepAlive(false);
                 }
                 
-                std::string response_str = response.toString();
-                
-                _clients[client_sock].setWriteBuffer(response_str);
-                _clients[client_sock].setBytesSent(0);
+                if (_cgi_clients.find(client_sock) == _cgi_clients.end()) {
+                    queueResponse(_clients[client_sock], response);
+                }
                 
                 // Remove only the consumed portion of the read buffer to handle pipelined requests
                 size_t consumed_bytes = request.getBytesConsumed();
@@ -241,13 +527,13 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
                 // Valid request but incomplete (waiting for body)
                 std::cout << "Valid but incomplete HTTP request, waiting for body..." << std::endl;
                 // Check for immediate timeout for testing purposes
-                time_t current_time = time(NULL);
+                time_t current_time = ServerClock::now();
                 time_t connection_time = _clients[client_sock].getConnectionTime();
                 if (current_time - connection_time >= 3) {
                     std::cout << "Incomplete request immediate timeout from client " << client_sock << std::endl;
-                    HttpResponse response = HttpResponse::createRequestTimeoutResponse();
-                    _clients[client_sock].setWriteBuffer(response.toString());
-                    _clients[client_sock].setBytesSent(0);
+                    HttpResponse response = createErrorResponse(408);
+                    response.setConnection(false);
+                    queueResponse(_clients[client_sock], response);
                     _clients[client_sock].clearReadBuffer();
                 }
                 // Timeout handling is also done in checkEmptyRequestTimeouts()
@@ -259,13 +545,13 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
             // Use specific error code from request parsing
             int error_code = request.getErrorCode();
             if (error_code == 411) {
-                response = HttpResponse::createLengthRequiredResponse();
+                response = createErrorResponse(411);
             } else {
-                response = HttpResponse::createBadRequestResponse();
+                response = createErrorResponse(400);
             }
+            response.setConnection(false);
             
-            _clients[client_sock].setWriteBuffer(response.toString());
-            _clients[client_sock].setBytesSent(0);
+            queueResponse(_clients[client_sock], response);
             
             // Remove consumed portion for invalid requests too, in case they're partially parseable
             size_t consumed_bytes = request.getBytesConsumed();
@@ -342,9 +628,9 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
         if (is_empty_request || is_malformed) {
             // This appears to be a malformed or empty request, not incomplete
             std::cout << "Malformed or empty HTTP request from client " << client_sock << std::endl;
-            HttpResponse response = HttpResponse::createBadRequestResponse();
-            _clients[client_sock].setWriteBuffer(response.toString());
-            _clients[client_sock].setBytesSent(0);
+            HttpResponse response = createErrorResponse(400);
+            response.setConnection(false);
+            queueResponse(_clients[client_sock], response);
             // For malformed requests that couldn't be parsed, clear entire buffer
             _clients[client_sock].clearReadBuffer();
         } else {
@@ -356,6 +642,221 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
     }
 }
 
+/*
+ * Returns a sink that stores the body of request while it arrives, or
+ * NULL if the request is not a POST or PUT that processHttpRequest would
+ * store in upload_path; those keep the buffered path
+ */
+BodySink* ConnectionHandler::createBodySink(const HttpRequest& request) {
+    const std::string& method = request.getMethod();
+    if ((method != "POST" && method != "PUT") || !request.hasHeader("Content-Length") ||
+        request.hasHeader("Transfer-Encoding")) {
+        return NULL;
+    }
+    std::string sanitized_uri = sanitizePath(request.getPath());
+    if (sanitized_uri.empty()) {
+        return NULL;
+    }
+    const Location* location = findMatchingLocation(sanitized_uri);
+    if (!location || !location->getRedirect().empty() || location->getUploadPath().empty() ||
+        !location->getFastcgiPass().empty()) {
+        return NULL;
+    }
+    const std::vector<std::string>& allowed_methods = location->getMethods();
+    if (std::find(allowed_methods.begin(), allowed_methods.end(), method) == allowed_methods.end()) {
+        return NULL;
+    }
+    if (method == "PUT") {
+        std::string target_path = uploadTarget(location, sanitized_uri);
+        if (target_path.empty()) {
+            return NULL;
+        }
+        return new PutUpload(target_path, request.getHeader("Content-Range"), request.getContentLength(),
+                             location->getUploadFsync(), expectedDigest(request));
+    }
+    
+    // A script, or a missing one, gets the body through processHttpRequest,
+    // also when extra path follows its name
+    std::string script_uri;
+    std::string path_info;
+    size_t dot_pos = sanitized_uri.find_last_of('.');
+    if ((dot_pos != std::string::npos &&
+         location->getCgiExtensions().count(sanitized_uri.substr(dot_pos)) > 0) ||
+        findCgiScript(location, sanitized_uri, script_uri, path_info)) {
+        return NULL;
+    }
+    std::string content_type = request.getHeader("Content-Type");
+    if (content_type.find("multipart/form-data") == std::string::npos) {
+        // A raw body is stored as is, under a generated name
+        if (request.getContentLength() == 0) {
+            return NULL;
+        }
+        return new PutUpload(location->getUploadPath() + "/" + generateUploadName("upload_", ".bin"), "",
+                             request.getContentLength(), location->getUploadFsync(), expectedDigest(request));
+    }
+    std::string boundary = MultipartParser::boundaryFromContentType(content_type);
+    if (boundary.empty()) {
+        return NULL;
+    }
+    bool html_summary = request.getHeader("Accept").find("text/html") != std::string::npos;
+    return new MultipartUpload(location->getUploadPath(), boundary, html_summary, location->getUploadFsync(),
+                               expectedDigest(request));
+}
+
+/*
+ * Switches a client to streaming its request body into a sink once the
+ * headers are in; the body bytes already received are fed right away
+ * Returns false if the request is handled the buffered way
+ */
+bool ConnectionHandler::startBodyStream(int client_sock, const HttpRequest& request,
+                                        const std::string& accumulated_data) {
+    size_t header_end = accumulated_data.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return false;
+    }
+    // Checked before the sink exists, which may already create its file
+    const ServerConfig* server_config = getCurrentServerConfig(client_sock);
+    if (server_config && request.getContentLength() > server_config->getMaxBodySize()) {
+        std::cout << "Request body too large: " << request.getContentLength()
+                  << " > " << server_config->getMaxBodySize() << std::endl;
+        HttpResponse response = createErrorResponse(413);
+        response.setConnection(false);
+        queueResponse(_clients[client_sock], response);
+        _clients[client_sock].clearReadBuffer();
+        return true;
+    }
+    BodySink* sink = createBodySink(request);
+    if (!sink) {
+        return false;
+    }
+    std::cout << "Streaming " << request.getMethod() << " " << request.getUri()
+              << " body (" << request.getContentLength() << " bytes)" << std::endl;
+
+    BodyStream& stream = _body_streams[client_sock];
+    stream.sink = sink;
+    stream.remaining = request.getContentLength();
+    stream.keep_alive = request.isKeepAlive();
+
+    std::string body = accumulated_data.substr(header_end + 4);
+    _clients[client_sock].clearReadBuffer();
+    feedBodyStream(client_sock, body.data(), body.size());
+    return true;
+}
+
+/*
+ * Hands the next body bytes of a streaming request to its sink
+ * When the last byte arrives the sink's response is queued and any bytes
+ * past the body are kept as the start of the next request
+ */
+void ConnectionHandler::feedBodyStream(int client_sock, const char* data, size_t size) {
+    std::map<int, BodyStream>::iterator it = _body_streams.find(client_sock);
+    BodyStream& stream = it->second;
+    size_t used = size < stream.remaining ? size : stream.remaining;
+    stream.remaining -= used;
+
+    if (stream.sink && used > 0 && !stream.sink->write(data, used)) {
+        failBodyStream(client_sock, stream);
+    }
+    if (stream.remaining > 0) {
+        return;
+    }
+    finishBodyStream(client_sock);
+
+    ClientData& client = _clients[client_sock];
+    for (size_t i = used; i < size; ++i) {
+        if (data[i] != '\r' && data[i] != '\n' && data[i] != ' ' && data[i] != '\t') {
+            client.appendToReadBuffer(data + used, size - used);
+            std::cout << "Pipelined request detected, keeping " << size - used << " bytes for next request" << std::endl;
+            break;
+        }
+    }
+}
+
+/*
+ * Reads the next part of a streaming body with splice(), straight from
+ * the socket into the sink's file; never reads past the body, so a
+ * pipelined request stays in the socket for recv()
+ * When nothing could be moved the bytes stay in the socket for the next
+ * poll, and go through recv() if the sink gave up on splicing
+ */
+void ConnectionHandler::spliceBodyStream(int client_sock, BodyStream& stream) {
+    ssize_t moved = stream.sink->spliceFrom(client_sock, stream.remaining);
+    if (moved == 0) {
+        std::cout << "Client " << client_sock << " disconnected during upload" << std::endl;
+        removeClient(client_sock);
+        return;
+    }
+    if (moved < 0) {
+        if (stream.sink->getErrorCode() != 0) {
+            failBodyStream(client_sock, stream);
+        }
+        return;
+    }
+    _clients[client_sock].updateLastActivity();
+    stream.remaining -= moved;
+    if (stream.sink->getErrorCode() != 0) {
+        failBodyStream(client_sock, stream);
+    }
+    if (stream.remaining == 0) {
+        finishBodyStream(client_sock);
+    }
+}
+
+/*
+ * Queues the sink's response once the whole body has been consumed
+ */
+void ConnectionHandler::finishBodyStream(int client_sock) {
+    std::map<int, BodyStream>::iterator it = _body_streams.find(client_sock);
+    BodyStream& stream = it->second;
+    ClientData& client = _clients[client_sock];
+    if (stream.sink) {
+        if (!stream.sink->finish()) {
+            failBodyStream(client_sock, stream);
+        } else {
+            HttpResponse response = stream.sink->buildResponse();
+            response.setConnection(stream.keep_alive);
+            client.setKeepAlive(stream.keep_alive);
+            queueResponse(client, response);
+            delete stream.sink;
+        }
+    }
+    _body_streams.erase(it);
+    client.updateLastActivity();
+}
+
+/*
+ * Answers a streaming request with the sink's error and closes the
+ * connection once it is sent; remaining body bytes are discarded
+ */
+void ConnectionHandler::failBodyStream(int client_sock, BodyStream& stream) {
+    int error_code = stream.sink->getErrorCode();
+    stream.sink->abort();
+    delete stream.sink;
+    stream.sink = NULL;
+
+    std::cout << "Streaming request from client " << client_sock << " failed with " << error_code << std::endl;
+    HttpResponse response = createErrorResponse(error_code ? error_code : 500);
+    response.setConnection(false);
+    _clients[client_sock].setKeepAlive(false);
+    queueResponse(_clients[client_sock], response);
+}
+
+/*
+ * Forgets the streaming request of a client that went away, removing
+ * whatever its sink had stored
+ */
+void ConnectionHandler::dropBodyStream(int client_sock) {
+    std::map<int, BodyStream>::iterator it = _body_streams.find(client_sock);
+    if (it == _body_streams.end()) {
+        return;
+    }
+    if (it->second.sink) {
+        it->second.sink->abort();
+        delete it->second.sink;
+    }
+    _body_streams.erase(it);
+}
+
 /*
  * Processes an HTTP request and generates an appropriate response
  * Handles different HTTP methods and creates proper responses
@@ -363,12 +864,12 @@ void ConnectionHandler::processClientData(int client_sock, const char* buffer, s
  */
 HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
     std::string method = request.getMethod();
-    std::string uri = request.getUri();
+    std::string uri = request.getPath();   // the query string only matters to scripts
     
     // Sanitize path to prevent directory traversal attacks
     std::string sanitized_uri = sanitizePath(uri);
     if (sanitized_uri.empty()) {
-        return HttpResponse::createBadRequestResponse();  // Malformed path - return 400 Bad Request
+        return createErrorResponse(400);  // Malformed path - return 400 Bad Request
     }
     
     // Find matching location
@@ -408,74 +909,66 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
         return HttpResponse::createMethodNotAllowedResponse(allowed_methods);
     }
     
+    // Everything under a fastcgi_pass location goes to the worker
+    if (!location->getFastcgiPass().empty()) {
+        return passToFastCgi(location, request, sanitized_uri);
+    }
+    
     // Handle GET and HEAD requests with proper file serving logic
     if (method == "GET" || method == "HEAD") {
-            // Construct the full file path
-            std::string file_path = location->getRoot();
-            if (file_path.empty() || file_path[file_path.length() - 1] != '/') {
-                file_path += "/";
+            // Pinned files were loaded at startup with their headers serialized
+            const HttpResponse* preloaded = _active_server ? _active_server->findPreloaded(sanitized_uri) : NULL;
+            if (preloaded) {
+                return *preloaded;
+            }
+            const StaticBundle* bundle = _active_server ? _active_server->findBundle(location) : NULL;
+            if (bundle) {
+                return serveBundled(*bundle, location, request, sanitized_uri);
             }
             
+            // Construct the full file path
             // Nginx-style path construction: simply concatenate root + URI
-            file_path += sanitized_uri;
+            std::string file_path = buildFilePath(location, sanitized_uri);
             
             // Check if the path exists
             struct stat path_stat;
-            if (stat(file_path.c_str(), &path_stat) == 0) {
+            if (statPath(file_path, path_stat)) {
                 // Path exists, check if it's a directory
                 if (S_ISDIR(path_stat.st_mode)) {
                     // It's a directory - check for index files or show directory listing
-                    std::string index_file_path = file_path;
-                    if (index_file_path[index_file_path.length() - 1] != '/') {
-                        index_file_path += "/";
-                    }
-                    
-                    // Check for index files
-                    const std::vector<std::string>& index_files = location->getIndexFiles();
-                    for (std::vector<std::string>::const_iterator it = index_files.begin(); 
-                         it != index_files.end(); ++it) {
-                        std::string index_path = index_file_path + *it;
-                        if (access(index_path.c_str(), F_OK) == 0) {
-                            // Index file found, serve it
-                            std::string detected_mime = getMimeType(*it);
-                            
-                            // Read the actual file content
-                            std::ifstream file(index_path.c_str(), std::ios::binary);
-                            if (file.is_open()) {
-                                std::string file_content((std::istreambuf_iterator<char>(file)),
-                                                        std::istreambuf_iterator<char>());
-                                file.close();
-                                return HttpResponse::createOkResponse(file_content, detected_mime);
-                            } else {
-                                return HttpResponse::createForbiddenResponse();
-                            }
-                        }
+                    std::string index_path;
+                    struct stat index_stat;
+                    if (resolveIndex(file_path, path_stat, location, index_path, index_stat)) {
+                        // Index file found, serve it
+                        return serveFile(index_path, index_stat);
                     }
                     
                     // No index file found - check if autoindex is enabled
                     if (location->getAutoindex()) {
-                        // Generate directory listing
-                        std::string body = "<html><head><title>Directory listing for " + sanitized_uri + "</title></head><body>";
-                        body += "<h1>Directory listing for " + sanitized_uri + "</h1><hr>";
-                        body += "<ul>";
-                        
-                        DIR* dir = opendir(file_path.c_str());
-                        if (dir) {
-                            struct dirent* entry;
-                            while ((entry = readdir(dir)) != NULL) {
-                                std::string name = entry->d_name;
-                                if (name != "." && name != "..") {
-                                    std::string href = sanitized_uri;
-                                    if (href[href.length() - 1] != '/') href += "/";
-                                    href += name;
-                                    body += "<li><a href=\"" + href + "\">" + name + "</a></li>";
-                                }
-                            }
-                            closedir(dir);
+                        // Listings are rendered once per directory version and
+                        // streamed from shared chunks, chunked for HTTP/1.1
+                        std::vector<SharedBuffer> chunks;
+                        if (!_listing_cache.load(file_path, path_stat, sanitized_uri,
+                                                 location->getAutoindexFormat(),
+                                                 location->getAutoindexSort(), chunks)) {
+                            return createErrorResponse(403);
                         }
                         
-                        body += "</ul><hr></body></html>";
-                        return HttpResponse::createOkResponse(body, "text/html");
+                        HttpResponse response;
+                        response.setStatusCode(200);
+                        if (location->getAutoindexFormat() == Location::AUTOINDEX_JSON) {
+                            response.setContentType("application/json");
+                        } else {
+                            response.setContentType("text/html");
+                        }
+                        response.setConnection(false);
+                        if (request.getVersion() == "HTTP/1.1") {
+                            response.setChunked(true);
+                        }
+                        for (size_t i = 0; i < chunks.size(); ++i) {
+                            response.appendChunk(chunks[i]);
+                        }
+                        return response;
                     } else {
                         return createErrorResponse(403);
                     }
@@ -493,40 +986,21 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
                     
                     if (cgi_it != cgi_extensions.end()) {
                         // This is a CGI request - execute the script
-                        return executeCgiScript(file_path, cgi_it->second, request, file_path);
+                        return executeCgiScript(location, sanitized_uri, "", request);
                     } else {
                         // It's a regular file - serve the actual file content
-                        std::string detected_mime = getMimeType(sanitized_uri);
-                        
-                        // Read the file content
-                        std::ifstream file(file_path.c_str(), std::ios::binary);
-                        if (file.is_open()) {
-                            std::string file_content((std::istreambuf_iterator<char>(file)),
-                                                    std::istreambuf_iterator<char>());
-                            file.close();
-                            return HttpResponse::createOkResponse(file_content, detected_mime);
-                        } else {
-                            // File exists but can't be read - return 403 Forbidden
-                            return HttpResponse::createForbiddenResponse();
-                        }
+                        return serveFile(file_path, path_stat);
                     }
                 }
             } else {
-                // Path does not exist, return custom 404
-                std::ifstream error_file("./www/404.html", std::ios::binary);
-                if (error_file.is_open()) {
-                    std::string file_content((std::istreambuf_iterator<char>(error_file)),
-                                            std::istreambuf_iterator<char>());
-                    error_file.close();
-                    HttpResponse response;
-                    response.setStatusCode(404);
-                    response.setContentType("text/html");
-                    response.setBody(file_content);
-                    response.setConnection(false);
-                    return response;
-                } else {
-                    return createErrorResponse(404);
+                // A script followed by extra path: the rest is PATH_INFO
+                std::string script_uri;
+                std::string path_info;
+                if (findCgiScript(location, sanitized_uri, script_uri, path_info)) {
+                    return executeCgiScript(location, script_uri, path_info, request);
                 }
+                // Path does not exist, return the prepared 404 page
+                return createErrorResponse(404);
             }
     } else if (method == "POST") {
         // Check if this is a CGI request
@@ -540,23 +1014,14 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
         const std::map<std::string, std::string>& cgi_extensions = location->getCgiExtensions();
         std::map<std::string, std::string>::const_iterator cgi_it = cgi_extensions.find(file_extension);
         
-        if (cgi_it != cgi_extensions.end()) {
+        std::string script_uri;
+        std::string path_info;
+        if (findCgiScript(location, sanitized_uri, script_uri, path_info)) {
             // This is a CGI request - execute the script
-            std::string file_path = location->getRoot();
-            if (file_path.empty() || file_path[file_path.length() - 1] != '/') {
-                file_path += "/";
-            }
-            
-            // Nginx-style path construction: simply concatenate root + URI
-            file_path += sanitized_uri;
-            
-            // Check if the CGI script file exists
-            if (access(file_path.c_str(), F_OK) == 0) {
-                // Execute CGI script
-                return executeCgiScript(file_path, cgi_it->second, request, file_path);
-            } else {
-                return createErrorResponse(404);
-            }
+            return executeCgiScript(location, script_uri, path_info, request);
+        } else if (cgi_it != cgi_extensions.end()) {
+            // Names a script that does not exist
+            return createErrorResponse(404);
         } else {
             // Check if this is a file upload request
             std::string upload_path = location->getUploadPath();
@@ -573,7 +1038,7 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
         // Handle DELETE request - delete file from upload path
         std::string upload_path = location->getUploadPath();
         if (upload_path.empty()) {
-            return HttpResponse::createBadRequestResponse();
+            return createErrorResponse(400);
         }
         
         // Construct the full file path
@@ -597,7 +1062,7 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
             filename.find("/") != std::string::npos || 
             filename.find("\\") != std::string::npos ||
             filename.empty()) {
-            return HttpResponse::createBadRequestResponse();
+            return createErrorResponse(400);
         }
         
         file_path += filename;
@@ -610,7 +1075,7 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
         
         // Check if it's a regular file (not a directory)
         if (!S_ISREG(st.st_mode)) {
-            return HttpResponse::createBadRequestResponse();
+            return createErrorResponse(400);
         }
         
         // Attempt to delete the file using remove
@@ -618,47 +1083,29 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
             std::string body = "File deleted successfully: " + filename;
             return HttpResponse::createOkResponse(body, "text/plain");
         } else {
-            return HttpResponse::createServerErrorResponse();
+            return createErrorResponse(500);
         }
     } else if (method == "PUT") {
-        // Handle PUT request - save file to upload path
+        // Bodies that were not streamed (e.g. chunked) are stored the same way
         std::string upload_path = location->getUploadPath();
         if (upload_path.empty()) {
-            return HttpResponse::createServerErrorResponse();
-        }
-        
-        // Create upload directory if it doesn't exist
-        struct stat st;
-        if (stat(upload_path.c_str(), &st) != 0) {
-            // Directory doesn't exist, try to create it using allowed functions
-            // We'll attempt to use the directory anyway and let the file creation fail if needed
-            // This is a limitation of using only allowed functions
+            return createErrorResponse(500);
         }
-        
-        // Generate filename or use URI path
-        std::ostringstream oss;
-        oss << "uploaded_file_" << time(NULL);
-        std::string filename = oss.str();
-        std::string full_path = upload_path + "/" + filename;
-        
-        // Write body content to file
-        std::ofstream file(full_path.c_str(), std::ios::binary);
-        if (!file.is_open()) {
-            return HttpResponse::createServerErrorResponse();
+        std::string target_path = uploadTarget(location, sanitized_uri);
+        if (target_path.empty()) {
+            return createErrorResponse(400);
         }
-        
         const std::string& body = request.getBody();
-        if (!body.empty()) {
-            file.write(body.c_str(), body.size());
+        PutUpload upload(target_path, request.getHeader("Content-Range"), body.size(), location->getUploadFsync(),
+                         expectedDigest(request));
+        if (!upload.write(body.data(), body.size()) || !upload.finish()) {
+            upload.abort();
+            return createErrorResponse(upload.getErrorCode());
         }
-        file.close();
-        
-        // Return success response
-        std::string response_body = "PUT request successful\nFile saved to: " + full_path;
-        return HttpResponse::createOkResponse(response_body, "text/plain");
+        return upload.buildResponse();
     }
     
-    return HttpResponse::createServerErrorResponse();
+    return createErrorResponse(500);
 }
 
 /*
@@ -667,6 +1114,13 @@ HttpResponse ConnectionHandler::processHttpRequest(const HttpRequest& request) {
  * Uses non-blocking I/O
  */
 void ConnectionHandler::handleClientRead(int client_sock) {
+    std::map<int, BodyStream>::iterator stream = _body_streams.find(client_sock);
+    if (stream != _body_streams.end() && stream->second.sink && stream->second.sink->canSplice()) {
+        selectServer(_clients[client_sock]);
+        spliceBodyStream(client_sock, stream->second);
+        return;
+    }
+    
     char buffer[65536];  // Increased to 64KB to handle larger bodies
     ssize_t bytes_read = recv(client_sock, buffer, sizeof(buffer) - 1, 0);
     
@@ -674,6 +1128,16 @@ void ConnectionHandler::handleClientRead(int client_sock) {
         buffer[bytes_read] = '\0';
         processClientData(client_sock, buffer, bytes_read);
     } else if (bytes_read == 0) {
+        if (_body_streams.find(client_sock) != _body_streams.end()) {
+            std::cout << "Client " << client_sock << " disconnected during upload" << std::endl;
+            removeClient(client_sock);
+            return;
+        }
+        if (_cgi_clients.find(client_sock) != _cgi_clients.end()) {
+            std::cout << "Client " << client_sock << " disconnected during CGI" << std::endl;
+            removeClient(client_sock);
+            return;
+        }
         // Client closed connection - check if we have any data to process
         std::string accumulated_data = _clients[client_sock].getReadBuffer();
         if (accumulated_data.empty()) {
@@ -697,28 +1161,36 @@ void ConnectionHandler::handleClientRead(int client_sock) {
  */
 void ConnectionHandler::handleClientWrite(int client_sock) {
     ClientData& client = _clients[client_sock];
+    bool parked = _cgi_clients.find(client_sock) != _cgi_clients.end();
     
-    if (client.getBytesSent() >= client.getWriteBuffer().size()) {
+    if (!client.hasPendingOutput()) {
+        if (!parked && !client.isKeepAlive()) {
+            // A response cut short has nothing left to send
+            removeClient(client_sock);
+        }
         return;
     }
     
-    ssize_t bytes_sent = send(client_sock, 
-                             client.getWriteBuffer().c_str() + client.getBytesSent(),
-                             client.getWriteBuffer().size() - client.getBytesSent(), 0);
+    // Gather queued segments so headers and shared bodies go out in one call
+    struct iovec iov[16];
+    size_t segments = client.fillOutputVector(iov, sizeof(iov) / sizeof(iov[0]));
+    ssize_t bytes_sent = writev(client_sock, iov, segments);
     
     if (bytes_sent > 0) {
-        client.setBytesSent(client.getBytesSent() + bytes_sent);
+        client.consumeOutput(bytes_sent);
         std::cout << "Sent " << bytes_sent << " bytes to client " << client_sock << std::endl;
         
-        if (client.getBytesSent() >= client.getWriteBuffer().size()) {
+        if (!client.hasPendingOutput() && parked) {
+            // The script is still producing the rest of the response
+            return;
+        }
+        if (!client.hasPendingOutput()) {
             std::cout << "Finished sending response to client " << client_sock << std::endl;
             
             if (client.isKeepAlive()) {
                 // Keep connection alive - reset buffers for next request
                 std::cout << "Keeping connection alive for client " << client_sock << std::endl;
                 client.clearReadBuffer();
-                client.clearWriteBuffer();
-                client.setBytesSent(0);
                 // Don't reset keep-alive flag - it should persist for the connection
             } else {
                 removeClient(client_sock);
@@ -728,7 +1200,7 @@ void ConnectionHandler::handleClientWrite(int client_sock) {
         std::cout << "Client " << client_sock << " closed connection during write" << std::endl;
         removeClient(client_sock);
     } else {
-        // send() returned -1, remove client without checking errno
+        // writev() returned -1, remove client without checking errno
         std::cerr << "Error writing to client " << client_sock << std::endl;
         removeClient(client_sock);
     }
@@ -739,6 +1211,8 @@ void ConnectionHandler::handleClientWrite(int client_sock) {
  * Closes the socket and erases client data from the map
  */
 void ConnectionHandler::removeClient(int client_sock) {
+    dropBodyStream(client_sock);
+    dropCgiJob(client_sock);
     _clients.erase(client_sock);
     _socket_manager.closeSocket(client_sock);
     std::cout << "Removed client " << client_sock << std::endl;
@@ -774,42 +1248,30 @@ const ClientData& ConnectionHandler::getClient(int client_sock) const {
  * Returns pointer to matching Location or NULL if no match found
  */
 const Location* ConnectionHandler::findMatchingLocation(const std::string& uri) const {
-    if (!_server_configs || _server_configs->empty()) {
+    if (!_active_server) {
         return NULL;
     }
-    
-    // For now, use the first server config (can be enhanced for virtual hosts)
-    const ServerConfig& config = (*_server_configs)[0];
-    const std::vector<Location>& locations = config.getLocations();
-    
-    const Location* best_match = NULL;
-    size_t best_match_length = 0;
-    
-    // Find the longest matching location path
-    for (size_t i = 0; i < locations.size(); ++i) {
-        const Location& location = locations[i];
-        const std::string& location_path = location.getPath();
-        
-        // Check if URI matches location path
-        if (location_path == "/") {
-            // Root location matches everything
-            best_match = &location;
-            best_match_length = location_path.length();
-        } else if (uri.find(location_path) == 0) {
-            // Non-root locations: exact match or followed by '/'
-            if (uri.length() == location_path.length() || 
-                (uri.length() > location_path.length() && uri[location_path.length()] == '/')) {
-                
-                // Keep the longest match (most specific)
-                if (location_path.length() > best_match_length) {
-                    best_match = &location;
-                    best_match_length = location_path.length();
-                }
-            }
-        }
+    return _active_server->findLocation(uri);
+}
+
+/*
+ * Joins the location root and a sanitized URI into a file system path
+ * Exactly one slash separates them, so every cache and the file watcher
+ * see the same spelling of a path
+ */
+std::string ConnectionHandler::buildFilePath(const Location* location, const std::string& uri) const {
+    std::string file_path = location->getRoot();
+    while (file_path.length() > 1 && file_path[file_path.length() - 1] == '/') {
+        file_path.erase(file_path.length() - 1);
     }
-    
-    return best_match;
+    if (file_path == "/") {
+        file_path.clear();
+    }
+    if (uri.empty() || uri[0] != '/') {
+        file_path += "/";
+    }
+    file_path += uri;
+    return file_path;
 }
 
 /*
@@ -875,206 +1337,391 @@ std::string ConnectionHandler::urlDecode(const std::string& encoded) const {
 }
 
 /*
- * Determines MIME type based on file extension
- * Returns the appropriate MIME type string
+ * Returns the server configuration handling the client's requests
+ * Resolved from the listener when the connection was accepted
  */
-std::string ConnectionHandler::getMimeType(const std::string& path) const {
-    // Find the last dot to get file extension
-    size_t dot_pos = path.find_last_of('.');
-    if (dot_pos == std::string::npos) {
-        return "text/plain";  // Default for files without extension
+const ServerConfig* ConnectionHandler::getCurrentServerConfig(int client_sock) const {
+    if (!_server_configs || _server_configs->empty()) {
+        return NULL;
     }
     
-    std::string extension = path.substr(dot_pos);
-    
-    // Convert to lowercase for comparison
-    for (size_t i = 0; i < extension.length(); ++i) {
-        if (extension[i] >= 'A' && extension[i] <= 'Z') {
-            extension[i] = extension[i] + 32;  // Convert to lowercase
-        }
+    std::map<int, ClientData>::const_iterator it = _clients.find(client_sock);
+    if (it == _clients.end() || it->second.getServerIndex() >= _server_configs->size()) {
+        return &(*_server_configs)[0];
     }
-    
-    // Basic MIME type mapping
-    if (extension == ".html" || extension == ".htm") {
-        return "text/html";
-    } else if (extension == ".css") {
-        return "text/css";
-    } else if (extension == ".js") {
-        return "application/javascript";
-    } else if (extension == ".png") {
-        return "image/png";
-    } else if (extension == ".jpg" || extension == ".jpeg") {
-        return "image/jpeg";
-    } else if (extension == ".gif") {
-        return "image/gif";
-    } else if (extension == ".txt") {
-        return "text/plain";
-    } else if (extension == ".json") {
-        return "application/json";
-    } else if (extension == ".xml") {
-        return "application/xml";
-    } else {
-        return "application/octet-stream";  // Default for unknown types
+    return &(*_server_configs)[it->second.getServerIndex()];
+}
+
+/*
+ * Finds the CGI script at the start of uri: the shortest prefix ending
+ * in one of the location's CGI extensions that is a regular file
+ * The rest of uri, if any, is its PATH_INFO
+ */
+bool ConnectionHandler::findCgiScript(const Location* location, const std::string& uri,
+                                      std::string& script_uri, std::string& path_info) {
+    const std::map<std::string, std::string>& cgi_extensions = location->getCgiExtensions();
+    if (cgi_extensions.empty()) {
+        return false;
     }
+    size_t end = 0;
+    while (end != uri.size()) {
+        end = uri.find('/', end + 1);
+        if (end == std::string::npos) {
+            end = uri.size();
+        }
+        std::string candidate = uri.substr(0, end);
+        size_t dot_pos = candidate.find_last_of('.');
+        if (dot_pos == std::string::npos || dot_pos < candidate.find_last_of('/') ||
+            cgi_extensions.find(candidate.substr(dot_pos)) == cgi_extensions.end()) {
+            continue;
+        }
+        struct stat st;
+        if (statPath(buildFilePath(location, candidate), st) && S_ISREG(st.st_mode)) {
+            script_uri = candidate;
+            path_info = uri.substr(end);
+            return true;
+        }
+    }
+    return false;
 }
 
 /*
- * Returns the current server configuration based on the client socket
- * Uses getsockname() to determine which server port the client connected to
+ * Starts the CGI script at script_uri for request
+ * The variables shared by the location's requests were prepared with the
+ * server context; only the request's own are built here. The script runs
+ * alongside the event loop; processClientData parks the client until it
+ * is done. Returns an error response if it cannot be started, otherwise
+ * a placeholder that is never sent.
  */
-const ServerConfig* ConnectionHandler::getCurrentServerConfig(int client_sock) const {
-    if (!_server_configs || _server_configs->empty()) {
-        return NULL;
+HttpResponse ConnectionHandler::executeCgiScript(const Location* location, const std::string& script_uri,
+                                                 const std::string& path_info, const HttpRequest& request) {
+    const std::map<std::string, std::string>& cgi_extensions = location->getCgiExtensions();
+    size_t dot_pos = script_uri.find_last_of('.');
+    std::map<std::string, std::string>::const_iterator interpreter =
+        cgi_extensions.find(dot_pos == std::string::npos ? "" : script_uri.substr(dot_pos));
+    if (interpreter == cgi_extensions.end()) {
+        return createErrorResponse(500);
     }
+    std::string script_path = buildFilePath(location, script_uri);
     
-    // Get the local address/port of the connected socket
-    struct sockaddr_in local_addr;
-    socklen_t addr_len = sizeof(local_addr);
-    if (getsockname(client_sock, (struct sockaddr*)&local_addr, &addr_len) < 0) {
-        // If we can't determine the port, default to first server config
-        return &(*_server_configs)[0];
+    CgiProcess::Environment env;
+    env.shared = _active_server ? _active_server->findCgiEnvironment(location) : NULL;
+    std::map<std::string, std::string> vars = requestVariables(location, script_uri, path_info, request);
+    for (std::map<std::string, std::string>::const_iterator it = vars.begin(); it != vars.end(); ++it) {
+        env.request.push_back(it->first + "=" + it->second);
     }
     
-    int local_port = ntohs(local_addr.sin_port);
+    CgiProcess* process = new CgiProcess();
+    std::map<const Location*, CgiPool*>::iterator pool = _cgi_pools.find(location);
+    bool started = pool != _cgi_pools.end()
+        ? pool->second->submit(process, interpreter->second, script_path, env, request.getBody())
+        : process->start(interpreter->second, script_path, env, request.getBody());
+    if (!started) {
+        delete process;
+        return createErrorResponse(500);
+    }
+    _started_cgi = process;
+    return HttpResponse();
+}
+
+/*
+ * Hands request to the FastCGI worker of location
+ * Like executeCgiScript, the client is parked until the worker answers;
+ * the placeholder response is never sent. The URI is the script unless
+ * the location's CGI extensions mark an earlier part of it as one.
+ */
+HttpResponse ConnectionHandler::passToFastCgi(const Location* location, const HttpRequest& request,
+                                              const std::string& uri) {
+    std::string script_uri = uri;
+    std::string path_info;
+    findCgiScript(location, uri, script_uri, path_info);   // leaves both as they are if none
+    std::string params;
+    std::map<std::string, std::string> vars = requestVariables(location, script_uri, path_info, request);
+    for (std::map<std::string, std::string>::const_iterator it = vars.begin(); it != vars.end(); ++it) {
+        FastCgiRequest::addParam(params, it->first, it->second);
+    }
+    FastCgiRequest::addParam(params, "DOCUMENT_ROOT", location->getRoot());
+    FastCgiRequest::addParam(params, "GATEWAY_INTERFACE", "CGI/1.1");
+    FastCgiRequest::addParam(params, "SERVER_SOFTWARE", ServerClock::serverToken());
+    if (_active_server) {
+        const ServerConfig& config = _active_server->getConfig();
+        std::ostringstream port;
+        port << config.getPort();
+        const std::vector<std::string>& names = config.getServerNames();
+        FastCgiRequest::addParam(params, "SERVER_NAME", names.empty() ? config.getHost() : names[0]);
+        FastCgiRequest::addParam(params, "SERVER_PORT", port.str());
+    }
     
-    // Find the server config that matches this port
-    for (size_t i = 0; i < _server_configs->size(); ++i) {
-        if ((*_server_configs)[i].getPort() == local_port) {
-            return &(*_server_configs)[i];
+    FastCgiRequest* fastcgi = _fastcgi.start(location->getFastcgiPass(), params, request.getBody());
+    if (fastcgi->isFinished()) {
+        int status = fastcgi->getErrorStatus();
+        delete fastcgi;
+        return createErrorResponse(status);
+    }
+    _started_cgi = fastcgi;
+    return HttpResponse();
+}
+
+/*
+ * Builds the status line and headers for the header block of a script
+ * Status picks the code, a Location without one redirects with 302;
+ * framing and connection headers are left to the server
+ */
+HttpResponse ConnectionHandler::buildCgiHead(const CgiResponder& responder) const {
+    HttpResponse response;
+    response.setStatusCode(200);
+    response.setContentType("text/html");
+    const std::vector<CgiResponder::HeaderField>& headers = responder.getHeaders();
+    bool has_status = false;
+    for (size_t i = 0; i < headers.size(); ++i) {
+        std::string name = headers[i].first;
+        for (size_t j = 0; j < name.size(); ++j) {
+            name[j] = std::tolower(static_cast<unsigned char>(name[j]));
+        }
+        if (name == "status") {
+            int code = std::atoi(headers[i].second.c_str());
+            if (code >= 100 && code <= 599) {
+                response.setStatusCode(code);
+                has_status = true;
+            }
+        } else if (name == "content-length") {
+            char* end;
+            unsigned long length = std::strtoul(headers[i].second.c_str(), &end, 10);
+            if (end != headers[i].second.c_str() && *end == '\0') {
+                response.setContentLength(length);
+            }
+        } else if (name == "location") {
+            response.setHeader(HttpResponse::HEADER_LOCATION, headers[i].second);
+            if (!has_status) {
+                response.setStatusCode(302);
+            }
+        } else if (name != "transfer-encoding" && name != "connection" && name != "keep-alive") {
+            response.setHeader(headers[i].first, headers[i].second);
         }
     }
-    
-    // If no match found, default to first server config
-    return &(*_server_configs)[0];
+    return response;
 }
 
 /*
- * Executes a CGI script and returns the HTTP response
- * Handles fork/exec, environment setup, and I/O communication
+ * Parks client_sock on the script executeCgiScript (or the request
+ * passToFastCgi) just started
+ * Its next requests wait in the read buffer until the script answers
  */
-HttpResponse ConnectionHandler::executeCgiScript(const std::string& script_path, 
-                                                 const std::string& interpreter_path,
-                                                 const HttpRequest& request, 
-                                                 const std::string& file_path) const {
-    int pipefd_in[2];   // for sending data to CGI
-    int pipefd_out[2];  // for receiving data from CGI
-    
-    // Create pipes for communication with CGI process
-    if (pipe(pipefd_in) == -1 || pipe(pipefd_out) == -1) {
-        return HttpResponse::createServerErrorResponse();
+void ConnectionHandler::parkClient(int client_sock, const HttpRequest& request, bool keep_alive) {
+    CgiJob job;
+    job.responder = _started_cgi;
+    job.client_sock = client_sock;
+    job.keep_alive = keep_alive;
+    job.can_chunk = request.getVersion() == "HTTP/1.1";
+    job.head_sent = false;
+    job.chunked = false;
+    job.has_length = false;
+    job.remaining = 0;
+    _started_cgi = NULL;
+    unsigned long id = ++_next_cgi_job;
+    _cgi_jobs[id] = job;
+    _cgi_clients[client_sock] = id;
+    std::cout << job.responder->describe() << " started for client " << client_sock << std::endl;
+}
+
+/*
+ * Sends the status line and headers once the script has printed them
+ * The body follows as it is produced: with the script's Content-Length,
+ * else chunked, else (HTTP/1.0) until the connection closes
+ */
+void ConnectionHandler::sendCgiHead(CgiJob& job, ClientData& client) {
+    HttpResponse response = buildCgiHead(*job.responder);
+    if (!response.getHeader("Content-Length").empty()) {
+        job.has_length = true;
+        job.remaining = std::strtoul(response.getHeader("Content-Length").c_str(), NULL, 10);
+    } else if (job.can_chunk) {
+        response.setChunked(true);
+        job.chunked = true;
+    } else {
+        job.keep_alive = false;
     }
-    
-    pid_t pid = fork();
-    if (pid == -1) {
-        close(pipefd_in[0]);
-        close(pipefd_in[1]);
-        close(pipefd_out[0]);
-        close(pipefd_out[1]);
-        return HttpResponse::createServerErrorResponse();
+    response.setConnection(job.keep_alive);
+    client.setKeepAlive(job.keep_alive);
+    client.queueOutput(SharedBuffer(response.headersToString()));
+    job.head_sent = true;
+}
+
+/*
+ * Forwards the output of a script to its client and, once the script is
+ * done, ends the response and forgets the job
+ * Returns the client in ready_clients when something was queued for it
+ */
+void ConnectionHandler::pumpCgiJob(std::map<unsigned long, CgiJob>::iterator job, std::vector<int>& ready_clients) {
+    CgiJob& cgi = job->second;
+    CgiResponder* process = cgi.responder;
+    std::map<int, ClientData>::iterator client = _clients.find(cgi.client_sock);
+    if (cgi.client_sock < 0 || client == _clients.end()) {
+        process->takeOutput();    // nobody wants it any more
+        if (process->isFinished()) {
+            finishCgiJob(job);
+        }
+        return;
     }
     
-    if (pid == 0) {
-        // Child process - execute CGI script
-        
-        // Set up pipes: stdin from parent, stdout to parent
-        dup2(pipefd_in[0], STDIN_FILENO);
-        dup2(pipefd_out[1], STDOUT_FILENO);
-        
-        // Close all pipe file descriptors
-        close(pipefd_in[0]);
-        close(pipefd_in[1]);
-        close(pipefd_out[0]);
-        close(pipefd_out[1]);
-        
-        // Create custom environment array for CGI
-        std::vector<std::string> env_strings;
-        env_strings.push_back("REQUEST_METHOD=" + request.getMethod());
-        env_strings.push_back("CONTENT_TYPE=" + request.getHeader("Content-Type"));
-        env_strings.push_back("CONTENT_LENGTH=" + request.getHeader("Content-Length"));
-        env_strings.push_back("SCRIPT_NAME=" + script_path);
-        env_strings.push_back("PATH_INFO=" + file_path);
-        env_strings.push_back("QUERY_STRING=");  // No query string for now
-        env_strings.push_back("SERVER_PROTOCOL=HTTP/1.1");
-        env_strings.push_back("GATEWAY_INTERFACE=CGI/1.1");
-        env_strings.push_back("SERVER_NAME=localhost");
-        env_strings.push_back("SERVER_PORT=8080");
-        env_strings.push_back("PATH=/usr/bin:/bin");
-        
-        // Convert to char* array
-        std::vector<char*> 
-        env_array;
-        for (size_t i = 0; i < env_strings.size(); ++i) {
-            env_array.push_back(const_cast<char*>(env_strings[i].c_str()));
+    bool finished = process->isFinished();
+    if (!cgi.head_sent && finished) {
+        // All of it is in: answer like any other complete response
+        selectServer(client->second);
+        HttpResponse response = createErrorResponse(process->getErrorStatus());
+        if (process->succeeded()) {
+            response = buildCgiHead(*process);
+            response.setBody(process->takeOutput());
         }
-        env_array.push_back(NULL);
-        
-        // Execute the CGI script
-        char* args[] = {const_cast<char*>(interpreter_path.c_str()), const_cast<char*>(script_path.c_str()), NULL};
-        execve(interpreter_path.c_str(), args, &env_array[0]);
-        
-        // If execve fails, exit
-        std::exit(1);
+        response.setConnection(cgi.keep_alive);
+        client->second.setKeepAlive(cgi.keep_alive);
+        queueResponse(client->second, response);
     } else {
-        // Parent process - communicate with CGI
-        
-        // Close unused pipe ends
-        close(pipefd_in[0]);
-        close(pipefd_out[1]);
-        
-        // Send request body to CGI if present
-        const std::string& body = request.getBody();
-        if (!body.empty()) {
-            write(pipefd_in[1], body.c_str(), body.length());
+        if (!cgi.head_sent) {
+            if (!process->hasHeaders() || process->isOutputComplete()) {
+                // Once all output is in, the exit status decides the answer
+                return;
+            }
+            sendCgiHead(cgi, client->second);
         }
-        close(pipefd_in[1]);  // Signal end of input
-        
-        // Read CGI output
-        std::string cgi_output;
-        char buffer[1024];
-        ssize_t bytes_read;
-        while ((bytes_read = read(pipefd_out[0], buffer, sizeof(buffer))) > 0) {
-            cgi_output.append(buffer, bytes_read);
-        }
-        close(pipefd_out[0]);
-        
-        // Wait for CGI process to finish
-        int status;
-        waitpid(pid, &status, 0);
-        
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-            // CGI executed successfully
-            // Parse CGI output to separate headers and body
-            size_t header_end = cgi_output.find("\r\n\r\n");
-            if (header_end == std::string::npos) {
-                header_end = cgi_output.find("\n\n");
-                if (header_end != std::string::npos) {
-                    header_end += 2;
-                } else {
-                    header_end = 0;
-                }
-            } else {
-                header_end += 4;
+        std::string output = process->takeOutput();
+        if (cgi.has_length) {
+            // Never send more than the script announced
+            if (output.size() > cgi.remaining) {
+                output.resize(cgi.remaining);
             }
-            
-            std::string cgi_body;
-            if (header_end < cgi_output.length()) {
-                cgi_body = cgi_output.substr(header_end);
-            } else {
-                cgi_body = cgi_output;
+            cgi.remaining -= output.size();
+        }
+        if (!output.empty()) {
+            if (cgi.chunked) {
+                output = HttpResponse::formatChunk(output.data(), output.size());
             }
-            
-            // Create response with CGI output
-            HttpResponse response;
-            response.setStatusCode(200);
-            response.setContentType("text/html");
-            response.setBody(cgi_body);
-            response.setConnection(false);
-            return response;
-        } else {
-            // CGI execution failed
-            return HttpResponse::createServerErrorResponse();
+            client->second.queueOutput(SharedBuffer::adopt(output));
+        }
+        if (finished && cgi.chunked && process->succeeded()) {
+            static const SharedBuffer last_chunk(HttpResponse::lastChunk());
+            client->second.queueOutput(last_chunk);
+        } else if (finished && (cgi.chunked || !process->succeeded() || (cgi.has_length && cgi.remaining > 0))) {
+            // Cut short: closing tells the client the body is incomplete
+            client->second.setKeepAlive(false);
+        }
+    }
+    client->second.updateLastActivity();
+    ready_clients.push_back(cgi.client_sock);
+    
+    if (!finished && cgi.has_length && cgi.remaining == 0) {
+        // The announced body is complete: the client may go on while the
+        // script exits on its own
+        _cgi_clients.erase(cgi.client_sock);
+        cgi.client_sock = -1;
+    } else if (finished) {
+        std::cout << process->describe() << " finished for client " << cgi.client_sock << std::endl;
+        _cgi_clients.erase(cgi.client_sock);
+        finishCgiJob(job);
+    }
+}
+
+/*
+ * Forgets a finished job; its slot in a CGI pool goes to the next
+ * script waiting there
+ */
+void ConnectionHandler::finishCgiJob(std::map<unsigned long, CgiJob>::iterator job) {
+    for (std::map<const Location*, CgiPool*>::iterator it = _cgi_pools.begin(); it != _cgi_pools.end(); ++it) {
+        it->second->release(job->second.responder);
+    }
+    delete job->second.responder;
+    _cgi_jobs.erase(job);
+}
+
+/*
+ * Stops the script a leaving client was waiting for
+ * The job stays until the child is reaped; an aborted FastCGI request,
+ * or a script still waiting for a pool slot, is finished right away
+ */
+void ConnectionHandler::dropCgiJob(int client_sock) {
+    std::map<int, unsigned long>::iterator parked = _cgi_clients.find(client_sock);
+    if (parked == _cgi_clients.end()) {
+        return;
+    }
+    std::map<unsigned long, CgiJob>::iterator job = _cgi_jobs.find(parked->second);
+    if (job != _cgi_jobs.end()) {
+        job->second.responder->abort();
+        job->second.client_sock = -1;
+        if (job->second.responder->isFinished()) {
+            finishCgiJob(job);
+        }
+    }
+    _cgi_clients.erase(parked);
+}
+
+/*
+ * Returns the signalfd that reports exited scripts, or -1
+ */
+int ConnectionHandler::getChildSignalFd() const {
+    return _child_signal_fd;
+}
+
+/*
+ * Appends the pipes of the running scripts and the FastCGI connections,
+ * with the events to poll for
+ * Output is not read while the client still has OUTPUT_BUFFER bytes to
+ * take, so a slow reader holds the script up instead of filling memory
+ */
+void ConnectionHandler::getCgiPollFds(std::vector<pollfd>& fds) {
+    for (std::map<unsigned long, CgiJob>::iterator it = _cgi_jobs.begin(); it != _cgi_jobs.end(); ++it) {
+        std::map<int, ClientData>::const_iterator client = _clients.find(it->second.client_sock);
+        it->second.responder->setOutputPaused(client != _clients.end() &&
+            client->second.getPendingOutputSize() >= CgiResponder::OUTPUT_BUFFER);
+        it->second.responder->getPollFds(fds);
+    }
+    _fastcgi.getPollFds(fds);
+}
+
+/*
+ * Moves the body into, or the output out of, the script or FastCGI
+ * connection owning fd
+ * Returns the clients that have new output queued
+ */
+std::vector<int> ConnectionHandler::handleCgiEvent(int fd, short revents) {
+    std::vector<int> ready_clients;
+    if (!_fastcgi.handleEvent(fd, revents)) {
+        for (std::map<unsigned long, CgiJob>::iterator it = _cgi_jobs.begin(); it != _cgi_jobs.end(); ++it) {
+            if (it->second.responder->handleEvent(fd, revents)) {
+                break;
+            }
+        }
+    }
+    // One connection can carry output for several requests
+    std::map<unsigned long, CgiJob>::iterator it = _cgi_jobs.begin();
+    while (it != _cgi_jobs.end()) {
+        std::map<unsigned long, CgiJob>::iterator job = it++;
+        if (job->second.responder->takeUpdate()) {
+            pumpCgiJob(job, ready_clients);
+        }
+    }
+    return ready_clients;
+}
+
+/*
+ * Collects the exit status of every script that has exited and ends the
+ * responses of the scripts that are done
+ */
+std::vector<int> ConnectionHandler::reapCgiChildren() {
+    std::vector<int> ready_clients;
+    if (_child_signal_fd >= 0) {
+        CgiProcess::drainChildSignals(_child_signal_fd);
+    }
+    for (std::map<const Location*, CgiPool*>::iterator it = _cgi_pools.begin(); it != _cgi_pools.end(); ++it) {
+        it->second->reap();
+    }
+    std::map<unsigned long, CgiJob>::iterator it = _cgi_jobs.begin();
+    while (it != _cgi_jobs.end()) {
+        std::map<unsigned long, CgiJob>::iterator job = it++;
+        job->second.responder->reap();
+        if (job->second.responder->takeUpdate()) {
+            pumpCgiJob(job, ready_clients);
         }
     }
+    return ready_clients;
 }
 
 /*
@@ -1099,125 +1746,249 @@ HttpResponse ConnectionHandler::handleFileUpload(const HttpRequest& request, con
         return createErrorResponse(400);
     }
     
-    std::string filename;
-    std::string file_content;
-    
-    // Check if this is multipart/form-data
+    // Multipart bodies that were not streamed (e.g. chunked) go through
+    // the same parser, so every part is stored
     std::string content_type = request.getHeader("Content-Type");
     if (content_type.find("multipart/form-data") != std::string::npos) {
-        // Extract boundary from Content-Type header
-        size_t boundary_pos = content_type.find("boundary=");
-        if (boundary_pos == std::string::npos) {
-            return createErrorResponse(400);
-        }
-        
-        std::string boundary = "--" + content_type.substr(boundary_pos + 9);
-        
-        // Simple multipart parsing - find file data
-        size_t start_pos = body.find(boundary);
-        if (start_pos == std::string::npos) {
+        std::string boundary = MultipartParser::boundaryFromContentType(content_type);
+        if (boundary.empty()) {
             return createErrorResponse(400);
         }
-        
-        // Find the file content between boundaries
-        size_t content_start = body.find("\r\n\r\n", start_pos);
-        if (content_start == std::string::npos) {
-            return createErrorResponse(400);
+        bool html_summary = request.getHeader("Accept").find("text/html") != std::string::npos;
+        MultipartUpload upload(upload_path, boundary, html_summary, location->getUploadFsync(),
+                               expectedDigest(request));
+        if (!upload.write(body.data(), body.size()) || !upload.finish()) {
+            upload.abort();
+            return createErrorResponse(upload.getErrorCode());
         }
-        content_start += 4; // Skip \r\n\r\n
-        
-        size_t content_end = body.find(boundary, content_start);
-        if (content_end == std::string::npos) {
-            return createErrorResponse(400);
+        return upload.buildResponse();
+    }
+    
+    // Regular POST body, stored under a generated name like a streamed one
+    PutUpload upload(upload_path + "/" + generateUploadName("upload_", ".bin"), "", body.size(),
+                     location->getUploadFsync(), expectedDigest(request));
+    if (!upload.write(body.data(), body.size()) || !upload.finish()) {
+        upload.abort();
+        return createErrorResponse(upload.getErrorCode());
+    }
+    return upload.buildResponse();
+}
+
+/*
+ * Returns the variables a CGI script or FastCGI worker gets from the
+ * request itself, for the script at script_uri with path_info after it
+ * Headers become HTTP_* variables; Content-Type and Content-Length have
+ * their own.
+ */
+std::map<std::string, std::string> ConnectionHandler::requestVariables(const Location* location,
+                                                                       const std::string& script_uri,
+                                                                       const std::string& path_info,
+                                                                       const HttpRequest& request) const {
+    std::map<std::string, std::string> variables;
+    std::ostringstream content_length;
+    content_length << request.getBody().size();
+    variables["REQUEST_METHOD"] = request.getMethod();
+    variables["REQUEST_URI"] = request.getUri();
+    variables["SCRIPT_NAME"] = script_uri;
+    variables["SCRIPT_FILENAME"] = buildFilePath(location, script_uri);
+    variables["PATH_INFO"] = path_info;
+    variables["QUERY_STRING"] = request.getQueryString();
+    variables["CONTENT_TYPE"] = request.getHeader("Content-Type");
+    variables["CONTENT_LENGTH"] = content_length.str();
+    variables["SERVER_PROTOCOL"] = request.getVersion();
+    variables["REMOTE_ADDR"] = _active_client ? _active_client->getRemoteAddr() : std::string();
+    const std::map<std::string, std::string>& headers = request.getHeaders();
+    for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (it->first == "content-type" || it->first == "content-length") {
+            continue;
         }
-        content_end -= 2; // Remove \r\n before boundary
-        
-        file_content = body.substr(content_start, content_end - content_start);
-        
-        // Extract filename from Content-Disposition header if present
-        size_t filename_pos = body.find("filename=\"", start_pos);
-        if (filename_pos != std::string::npos && filename_pos < content_start) {
-            filename_pos += 10; // Skip filename="
-            size_t filename_end = body.find("\"", filename_pos);
-            if (filename_end != std::string::npos) {
-                filename = body.substr(filename_pos, filename_end - filename_pos);
-            }
+        std::string name = "HTTP_";
+        for (size_t i = 0; i < it->first.size(); ++i) {
+            char c = it->first[i];
+            name += c == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
         }
+        variables[name] = it->second;
+    }
+    return variables;
+}
+
+/*
+ * Returns the digests the client sent for the body of request
+ */
+ExpectedDigest ConnectionHandler::expectedDigest(const HttpRequest& request) {
+    return ExpectedDigest(request.getHeader("Content-Digest"), request.getHeader("Content-MD5"));
+}
+
+/*
+ * Returns a file name no other upload of this process uses
+ */
+std::string ConnectionHandler::generateUploadName(const std::string& prefix, const std::string& suffix) {
+    static unsigned long serial = 0;
+    std::ostringstream oss;
+    oss << prefix << ServerClock::now() << "_" << ++serial << suffix;
+    return oss.str();
+}
+
+/*
+ * Returns the file a PUT to uri stores, below the location's upload_path
+ * The part of uri after the location path names the file; a PUT to the
+ * location itself gets a fresh generated name. Returns an empty string
+ * for names that cannot be stored, such as a directory or a ".part" file
+ */
+std::string ConnectionHandler::uploadTarget(const Location* location, const std::string& uri) const {
+    std::string name;
+    const std::string& location_path = location->getPath();
+    if (!location->isRegex() && uri.compare(0, location_path.length(), location_path) == 0) {
+        name = uri.substr(location_path.length());
     } else {
-        // Regular POST body
-        file_content = body;
+        name = uri.substr(uri.find_last_of('/') + 1);
     }
-    
-    // Generate filename if not extracted from multipart
-    if (filename.empty()) {
-        std::ostringstream oss;
-        oss << "upload_" << time(NULL) << ".bin";
-        filename = oss.str();
+    while (!name.empty() && name[0] == '/') {
+        name.erase(0, 1);
+    }
+    if (name.empty()) {
+        name = generateUploadName("uploaded_file_", "");
+    }
+    if (name[name.length() - 1] == '/' ||
+        (name.length() >= 5 && name.compare(name.length() - 5, 5, ".part") == 0)) {
+        return "";
+    }
+    return location->getUploadPath() + "/" + name;
+}
+
+/*
+ * Returns the error response prepared at startup for error_code
+ * Custom error_page files were loaded once by the server context, so this
+ * only copies shared buffer references
+ */
+HttpResponse ConnectionHandler::createErrorResponse(int error_code) const {
+    const ServerContext* server = _active_server;
+    if (!server && !_server_contexts.empty()) {
+        server = _server_contexts[0];
+    }
+    if (server) {
+        const ErrorPageCache& error_pages = server->getErrorPages();
+        const HttpResponse* prepared = error_pages.find(error_code);
+        if (!prepared) {
+            // Codes without a prepared page are reported as 500
+            prepared = error_pages.find(500);
+        }
+        if (prepared) {
+            return *prepared;
+        }
     }
     
-    std::string full_path = upload_path + "/" + filename;
-    
-    // Write file content
-    std::ofstream file(full_path.c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        return createErrorResponse(500);
+    return HttpResponse::createServerErrorResponse();
+}
+
+/*
+ * Finds the first configured index file present in a directory
+ * The outcome, including "none", is cached per directory version so
+ * repeated requests stat at most the file that will be served
+ * Returns false if the directory has no index file
+ */
+bool ConnectionHandler::resolveIndex(const std::string& dir_path, const struct stat& dir_st,
+                                     const Location* location, std::string& index_path, struct stat& index_st) {
+    std::string base = dir_path;
+    if (base.empty() || base[base.length() - 1] != '/') {
+        base += "/";
     }
+    const std::vector<std::string>& index_files = location->getIndexFiles();
     
-    file.write(file_content.c_str(), file_content.length());
-    file.close();
+    std::string index_name;
+    if (_index_cache.lookup(dir_path, dir_st, index_files, index_name)) {
+        if (index_name.empty()) {
+            return false;
+        }
+        index_path = base + index_name;
+        if (statPath(index_path, index_st)) {
+            return true;
+        }
+    }
     
-    // Return success response with redirect to upload directory
-    std::string response_body = "<!DOCTYPE html><html><head><title>Upload Success</title></head><body>";
-    response_body += "<h1>File Upload Successful</h1>";
-    response_body += "<p>File saved as: " + filename + "</p>";
-    std::ostringstream size_stream;
-    size_stream << file_content.length();
-    response_body += "<p>Size: " + size_stream.str() + " bytes</p>";
-    response_body += "<p><a href=\"/upload/\">View Uploaded Files</a></p>";
-    response_body += "<p><a href=\"/\">Back to Home</a></p>";
-    response_body += "</body></html>";
+    for (size_t i = 0; i < index_files.size(); ++i) {
+        index_path = base + index_files[i];
+        if (statPath(index_path, index_st)) {
+            _index_cache.store(dir_path, dir_st, index_files, index_files[i]);
+            return true;
+        }
+    }
+    _index_cache.store(dir_path, dir_st, index_files, "");
+    return false;
+}
+
+/*
+ * Serves a regular file through the file cache
+ * Small files are read once and shared by every response that sends them,
+ * together with the Content-Type resolved from the server's MIME table
+ */
+HttpResponse ConnectionHandler::serveFile(const std::string& path, const struct stat& st) {
+    static const MimeTypes builtin_types;
+    const MimeTypes& mime_types = _active_server ? _active_server->getMimeTypes() : builtin_types;
     
-    return HttpResponse::createOkResponse(response_body, "text/html");
+    SharedBuffer body;
+    const std::string* content_type = NULL;
+    if (!_file_cache.load(path, st, mime_types, body, content_type)) {
+        // File exists but can't be read - return 403 Forbidden
+        return createErrorResponse(403);
+    }
+    return HttpResponse::createOkResponse(body, *content_type);
 }
 
 /*
- * Creates an error response, checking for custom error pages in common locations
- * Falls back to default error response if no custom page is found
+ * Serves a request from a location's mapped bundle, never touching the disk
+ * Directories resolve to their index files; the ETag is answered with 304
+ * and a stored gzip variant is sent to clients that accept it
  */
-HttpResponse ConnectionHandler::createErrorResponse(int error_code) const {
-    // Try to get custom error page from server configuration
-    if (_server_configs && !_server_configs->empty()) {
-        const ServerConfig& config = (*_server_configs)[0];
-        const std::map<int, std::string>& error_pages = config.getErrorPages();
-        
-        std::map<int, std::string>::const_iterator it = error_pages.find(error_code);
-        if (it != error_pages.end()) {
-            std::string error_page_path = it->second;
-            
-            // Try to load the custom error page
-            std::ifstream error_file(error_page_path.c_str(), std::ios::binary);
-            if (error_file.is_open()) {
-                std::string file_content((std::istreambuf_iterator<char>(error_file)),
-                                        std::istreambuf_iterator<char>());
-                error_file.close();
-                
-                HttpResponse response;
-                response.setStatusCode(error_code);
-                response.setContentType("text/html");
-                response.setBody(file_content);
-                response.setConnection(false);
-                return response;
-            }
+HttpResponse ConnectionHandler::serveBundled(const StaticBundle& bundle, const Location* location,
+                                             const HttpRequest& request, const std::string& uri) {
+    const BundleFormat::Entry* entry = bundle.find(uri);
+    if (!entry) {
+        std::string base = uri;
+        if (base.empty() || base[base.length() - 1] != '/') {
+            base += "/";
+        }
+        const std::vector<std::string>& index_files = location->getIndexFiles();
+        for (size_t i = 0; i < index_files.size() && !entry; ++i) {
+            entry = bundle.find(base + index_files[i]);
         }
     }
+    if (!entry) {
+        return createErrorResponse(404);
+    }
     
-    // Fallback to default error responses
-    if (error_code == 404) {
-        return HttpResponse::createNotFoundResponse();
-    } else if (error_code == 500) {
-        return HttpResponse::createServerErrorResponse();
-    } else if (error_code == 403) {
-        return HttpResponse::createForbiddenResponse();
+    // The gzip variant is a different representation and gets its own ETag
+    bool use_gzip = entry->gzip_size > 0 && request.acceptsEncoding("gzip");
+    std::string etag = bundle.etag(*entry);
+    if (use_gzip && etag.length() > 1) {
+        etag.insert(etag.length() - 1, "-gzip");
+    }
+    
+    HttpResponse response;
+    std::string if_none_match = request.getHeader("if-none-match");
+    if (!if_none_match.empty() && (if_none_match == "*" || if_none_match.find(etag) != std::string::npos)) {
+        response.setStatusCode(304);
+    } else if (use_gzip) {
+        response = HttpResponse::createOkResponse(bundle.gzipBody(*entry), bundle.contentType(*entry));
+        response.setHeader("Content-Encoding", "gzip");
+    } else {
+        response = HttpResponse::createOkResponse(bundle.body(*entry), bundle.contentType(*entry));
+    }
+    response.setHeader("ETag", etag);
+    if (entry->gzip_size > 0) {
+        response.setHeader("Vary", "Accept-Encoding");
+    }
+    return response;
+}
+
+/*
+ * Serializes a response onto the client's output queue
+ * Shared bodies are queued by reference, not copied
+ */
+void ConnectionHandler::queueResponse(ClientData& client, const HttpResponse& response) {
+    std::vector<SharedBuffer> segments;
+    response.serialize(segments);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        client.queueOutput(segments[i]);
     }
-    return HttpResponse::createServerErrorResponse();
 }
@@ -0,0 +1,687 @@
+#include "ContentHash.hpp"
+#include <cctype>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CONTENTHASH_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const unsigned int MD5_SHIFT[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+inline uint32_t rotateRight(uint32_t value, unsigned int count) {
+    return (value >> count) | (value << (32 - count));
+}
+
+inline uint32_t rotateLeft(uint32_t value, unsigned int count) {
+    return (value << count) | (value >> (32 - count));
+}
+
+/*
+ * Pads the last block the way SHA-256 and MD5 both do: a 0x80 byte,
+ * zeros, then the length in bits in the last eight bytes
+ * Returns how many bytes of tail, one block or two, are left to compress
+ */
+size_t padMessage(unsigned char tail[128], const unsigned char* block, size_t block_size, uint64_t length,
+                  bool big_endian) {
+    size_t total = block_size + 9 > 64 ? 128 : 64;
+    uint64_t bits = length * 8;
+    std::memcpy(tail, block, block_size);
+    tail[block_size] = 0x80;
+    std::memset(tail + block_size + 1, 0, total - block_size - 1);
+    for (int i = 0; i < 8; ++i) {
+        tail[big_endian ? total - 1 - i : total - 8 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    return total;
+}
+
+
+/*
+ * Runs the SHA-256 compression function over count 64-byte blocks
+ */
+void sha256Portable(uint32_t state[8], const unsigned char* data, size_t count) {
+    for (; count > 0; --count, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) | (static_cast<uint32_t>(data[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(data[i * 4 + 2]) << 8) | static_cast<uint32_t>(data[i * 4 + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + SHA256_K[i] + w[i];
+            uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef CONTENTHASH_X86
+/*
+ * SHA-256 compression with the SHA extensions, several times faster than
+ * the portable rounds. Each group of four rounds takes four message
+ * words; the schedule for later groups is built with msg1/msg2 while
+ * the rounds run.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256ShaNi(uint32_t state[8], const unsigned char* data, size_t count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);     // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);         // CDGH
+
+    for (; count > 0; --count, data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i words[4];
+        // Unrolled, words[] stays in registers
+#if defined(__clang__) || __GNUC__ >= 8
+#pragma GCC unroll 16
+#endif
+        for (int group = 0; group < 16; ++group) {
+            if (group < 4) {
+                words[group] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + group * 16)), byte_swap);
+            }
+            __m128i message = _mm_add_epi32(words[group & 3],
+                                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHA256_K + group * 4)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            if (group >= 3 && group <= 14) {
+                __m128i shifted = _mm_alignr_epi8(words[group & 3], words[(group - 1) & 3], 4);
+                words[(group + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(words[(group + 1) & 3], shifted),
+                                                              words[group & 3]);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0e));
+            if (group >= 1 && group <= 12) {
+                words[(group - 1) & 3] = _mm_sha256msg1_epu32(words[(group - 1) & 3], words[group & 3]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+/*
+ * CRC-32C with the SSE4.2 crc32 instruction, eight bytes per step
+ */
+__attribute__((target("sse4.2")))
+uint32_t crc32cSse42(uint32_t crc, const unsigned char* data, size_t size) {
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+/*
+ * Returns whether the CPU has the SHA extensions and SSE4.2
+ */
+bool cpuHasShaNi() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+/*
+ * Returns whether the CPU has the SSE4.2 crc32 instruction
+ */
+bool cpuHasSse42() {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+
+const bool HAS_SHA_NI = cpuHasShaNi();
+const bool HAS_SSE42 = cpuHasSse42();
+#endif
+}
+
+/*
+ * Default constructor for Sha256
+ */
+Sha256::Sha256() : _block_size(0), _length(0) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(_state, initial, sizeof(_state));
+}
+
+/*
+ * Runs the compression function over count 64-byte blocks, with the SHA
+ * extensions when the CPU has them
+ */
+void Sha256::compress(const unsigned char* data, size_t count) {
+#ifdef CONTENTHASH_X86
+    if (HAS_SHA_NI) {
+        sha256ShaNi(_state, data, count);
+        return;
+    }
+#endif
+    sha256Portable(_state, data, count);
+}
+
+/*
+ * Hashes the next bytes; whole blocks are compressed straight from data
+ */
+void Sha256::update(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    _length += size;
+    if (_block_size > 0) {
+        size_t take = 64 - _block_size < size ? 64 - _block_size : size;
+        std::memcpy(_block + _block_size, bytes, take);
+        _block_size += take;
+        bytes += take;
+        size -= take;
+        if (_block_size < 64) {
+            return;
+        }
+        compress(_block, 1);
+        _block_size = 0;
+    }
+    compress(bytes, size / 64);
+    bytes += size - size % 64;
+    size %= 64;
+    std::memcpy(_block, bytes, size);
+    _block_size = size;
+}
+
+/*
+ * Pads the message and writes the big-endian digest
+ */
+void Sha256::finish(unsigned char digest[DIGEST_SIZE]) {
+    unsigned char tail[128];
+    size_t tail_size = padMessage(tail, _block, _block_size, _length, true);
+    compress(tail, tail_size / 64);
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = static_cast<unsigned char>(_state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(_state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(_state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(_state[i]);
+    }
+}
+
+/*
+ * Default constructor for Md5
+ */
+Md5::Md5() : _block_size(0), _length(0) {
+    _state[0] = 0x67452301;
+    _state[1] = 0xefcdab89;
+    _state[2] = 0x98badcfe;
+    _state[3] = 0x10325476;
+}
+
+/*
+ * Runs the four MD5 rounds over one 64-byte block
+ */
+void Md5::compress(const unsigned char* block) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = static_cast<uint32_t>(block[i * 4]) | (static_cast<uint32_t>(block[i * 4 + 1]) << 8) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 16) | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+    }
+    uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t rotated = rotateLeft(a + f + MD5_K[i] + m[g], MD5_SHIFT[i]);
+        a = d;
+        d = c;
+        c = b;
+        b += rotated;
+    }
+    _state[0] += a; _state[1] += b; _state[2] += c; _state[3] += d;
+}
+
+/*
+ * Hashes the next bytes
+ */
+void Md5::update(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    _length += size;
+    if (_block_size > 0) {
+        size_t take = 64 - _block_size < size ? 64 - _block_size : size;
+        std::memcpy(_block + _block_size, bytes, take);
+        _block_size += take;
+        bytes += take;
+        size -= take;
+        if (_block_size < 64) {
+            return;
+        }
+        compress(_block);
+        _block_size = 0;
+    }
+    for (; size >= 64; bytes += 64, size -= 64) {
+        compress(bytes);
+    }
+    std::memcpy(_block, bytes, size);
+    _block_size = size;
+}
+
+/*
+ * Pads the message and writes the little-endian digest
+ */
+void Md5::finish(unsigned char digest[DIGEST_SIZE]) {
+    unsigned char tail[128];
+    size_t tail_size = padMessage(tail, _block, _block_size, _length, false);
+    for (size_t offset = 0; offset < tail_size; offset += 64) {
+        compress(tail + offset);
+    }
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            digest[i * 4 + j] = static_cast<unsigned char>(_state[i] >> (8 * j));
+        }
+    }
+}
+
+uint32_t Crc32c::_table[8][256];
+bool Crc32c::_table_ready = false;
+
+/*
+ * Builds the slicing-by-8 tables for the reflected polynomial 0x82f63b78
+ */
+void Crc32c::buildTable() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+        }
+        _table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int slice = 1; slice < 8; ++slice) {
+            _table[slice][i] = (_table[slice - 1][i] >> 8) ^ _table[0][_table[slice - 1][i] & 0xff];
+        }
+    }
+    _table_ready = true;
+}
+
+/*
+ * Default constructor for Crc32c
+ */
+Crc32c::Crc32c() : _crc(0xffffffff) {
+    if (!_table_ready) {
+        buildTable();
+    }
+}
+
+/*
+ * Folds the next bytes into the checksum, with the crc32 instruction
+ * when the CPU has it
+ */
+void Crc32c::update(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+#ifdef CONTENTHASH_X86
+    if (HAS_SSE42) {
+        _crc = crc32cSse42(_crc, bytes, size);
+        return;
+    }
+#endif
+    uint32_t crc = _crc;
+    for (; size >= 8; bytes += 8, size -= 8) {
+        uint32_t low = crc ^ (static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+                              (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24));
+        crc = _table[7][low & 0xff] ^ _table[6][(low >> 8) & 0xff] ^
+              _table[5][(low >> 16) & 0xff] ^ _table[4][low >> 24] ^
+              _table[3][bytes[4]] ^ _table[2][bytes[5]] ^ _table[1][bytes[6]] ^ _table[0][bytes[7]];
+    }
+    for (; size > 0; ++bytes, --size) {
+        crc = (crc >> 8) ^ _table[0][(crc ^ *bytes) & 0xff];
+    }
+    _crc = crc;
+}
+
+/*
+ * Returns the checksum of the bytes fed so far
+ */
+uint32_t Crc32c::value() const {
+    return _crc ^ 0xffffffff;
+}
+
+/*
+ * Constructor for ContentHash
+ */
+ContentHash::ContentHash(bool with_md5) : _with_md5(with_md5), _finished(false), _size(0) {}
+
+/*
+ * Starts over, as if nothing had been fed
+ */
+void ContentHash::reset(bool with_md5) {
+    _sha256 = Sha256();
+    _crc32c = Crc32c();
+    _md5 = Md5();
+    _with_md5 = with_md5;
+    _finished = false;
+    _size = 0;
+}
+
+/*
+ * Feeds the next bytes to every hash
+ */
+void ContentHash::update(const char* data, size_t size) {
+    _sha256.update(data, size);
+    _crc32c.update(data, size);
+    if (_with_md5) {
+        _md5.update(data, size);
+    }
+    _size += size;
+}
+
+/*
+ * Completes the hashes; no bytes can be fed afterwards
+ */
+void ContentHash::finish() {
+    if (_finished) {
+        return;
+    }
+    _sha256.finish(_sha256_digest);
+    if (_with_md5) {
+        _md5.finish(_md5_digest);
+    }
+    _finished = true;
+}
+
+/*
+ * Returns whether finish() was called
+ */
+bool ContentHash::isFinished() const {
+    return _finished;
+}
+
+/*
+ * Returns the number of bytes hashed
+ */
+uint64_t ContentHash::getSize() const {
+    return _size;
+}
+
+/*
+ * Returns the SHA-256 digest in lowercase hex
+ */
+std::string ContentHash::sha256Hex() const {
+    return toHex(_sha256_digest, Sha256::DIGEST_SIZE);
+}
+
+/*
+ * Returns the CRC-32C as eight lowercase hex digits
+ */
+std::string ContentHash::crc32cHex() const {
+    std::string bytes = digest("crc32c");
+    return toHex(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+}
+
+/*
+ * Returns the raw digest for an RFC 9530 algorithm name, or an empty
+ * string if it is not computed. The CRC-32C is in network byte order.
+ */
+std::string ContentHash::digest(const std::string& algorithm) const {
+    if (algorithm == "sha-256") {
+        return std::string(reinterpret_cast<const char*>(_sha256_digest), Sha256::DIGEST_SIZE);
+    }
+    if (algorithm == "crc32c") {
+        uint32_t crc = _crc32c.value();
+        char bytes[4] = { static_cast<char>(crc >> 24), static_cast<char>(crc >> 16),
+                          static_cast<char>(crc >> 8), static_cast<char>(crc) };
+        return std::string(bytes, 4);
+    }
+    if (algorithm == "md5" && _with_md5) {
+        return std::string(reinterpret_cast<const char*>(_md5_digest), Md5::DIGEST_SIZE);
+    }
+    return "";
+}
+
+/*
+ * Returns a strong ETag made of the SHA-256, so equal content gets the
+ * same tag wherever it was uploaded
+ */
+std::string ContentHash::etag() const {
+    return "\"" + sha256Hex() + "\"";
+}
+
+/*
+ * Returns an RFC 9530 digest field value, the same format
+ * ExpectedDigest parses: "sha-256=:<b64>:, crc32c=:<b64>:"
+ */
+std::string ContentHash::digestHeader() const {
+    std::string crc = digest("crc32c");
+    return "sha-256=:" + base64Encode(_sha256_digest, Sha256::DIGEST_SIZE) +
+           ":, crc32c=:" + base64Encode(reinterpret_cast<const unsigned char*>(crc.data()), crc.size()) + ":";
+}
+
+/*
+ * Returns data as lowercase hex
+ */
+std::string ContentHash::toHex(const unsigned char* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0xf];
+    }
+    return hex;
+}
+
+/*
+ * Returns data in padded base64
+ */
+std::string ContentHash::base64Encode(const unsigned char* data, size_t size) {
+    std::string text;
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < size) {
+            group |= static_cast<uint32_t>(data[i + 1]) << 8;
+        }
+        if (i + 2 < size) {
+            group |= data[i + 2];
+        }
+        text += BASE64_ALPHABET[(group >> 18) & 0x3f];
+        text += BASE64_ALPHABET[(group >> 12) & 0x3f];
+        text += (i + 1 < size) ? BASE64_ALPHABET[(group >> 6) & 0x3f] : '=';
+        text += (i + 2 < size) ? BASE64_ALPHABET[group & 0x3f] : '=';
+    }
+    return text;
+}
+
+/*
+ * Decodes base64, with or without padding
+ * Returns false on any character outside the alphabet
+ */
+bool ContentHash::base64Decode(const std::string& text, std::string& bytes) {
+    bytes.clear();
+    uint32_t group = 0;
+    int bits = 0;
+    size_t end = text.find_last_not_of('=');
+    if (end == std::string::npos || text.length() - end - 1 > 2) {
+        return false;
+    }
+    for (size_t i = 0; i <= end; ++i) {
+        const char* found = std::strchr(BASE64_ALPHABET, text[i]);
+        if (text[i] == '\0' || !found) {
+            return false;
+        }
+        group = (group << 6) | static_cast<uint32_t>(found - BASE64_ALPHABET);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            bytes += static_cast<char>((group >> bits) & 0xff);
+        }
+    }
+    return true;
+}
+
+/*
+ * Default constructor for ExpectedDigest: nothing to check
+ */
+ExpectedDigest::ExpectedDigest() : _valid(true) {}
+
+/*
+ * Parses the digest headers of a request; either may be empty
+ * A malformed value of a known algorithm makes the digest invalid
+ */
+ExpectedDigest::ExpectedDigest(const std::string& content_digest, const std::string& content_md5) : _valid(true) {
+    size_t start = 0;
+    while (start < content_digest.length()) {
+        size_t end = content_digest.find(',', start);
+        if (end == std::string::npos) {
+            end = content_digest.length();
+        }
+        std::string member = content_digest.substr(start, end - start);
+        start = end + 1;
+        size_t equals = member.find('=');
+        size_t name_start = member.find_first_not_of(" \t");
+        if (equals == std::string::npos || name_start == std::string::npos || name_start >= equals) {
+            continue;
+        }
+        std::string algorithm = member.substr(name_start, equals - name_start);
+        for (size_t i = 0; i < algorithm.length(); ++i) {
+            algorithm[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(algorithm[i])));
+        }
+        size_t value_end = member.find_last_not_of(" \t");
+        std::string value = member.substr(equals + 1, value_end - equals);
+        // A structured field byte sequence is wrapped in colons
+        if (value.length() < 2 || value[0] != ':' || value[value.length() - 1] != ':') {
+            if (algorithm == "sha-256" || algorithm == "crc32c" || algorithm == "md5") {
+                _valid = false;
+            }
+            continue;
+        }
+        add(algorithm, value.substr(1, value.length() - 2));
+    }
+    if (!content_md5.empty()) {
+        size_t value_start = content_md5.find_first_not_of(" \t");
+        size_t value_end = content_md5.find_last_not_of(" \t");
+        add("md5", value_start == std::string::npos ? "" : content_md5.substr(value_start, value_end - value_start + 1));
+    }
+}
+
+/*
+ * Records the expected digest of a supported algorithm
+ */
+bool ExpectedDigest::add(const std::string& algorithm, const std::string& encoded) {
+    size_t size;
+    if (algorithm == "sha-256") {
+        size = Sha256::DIGEST_SIZE;
+    } else if (algorithm == "md5") {
+        size = Md5::DIGEST_SIZE;
+    } else if (algorithm == "crc32c") {
+        size = 4;
+    } else {
+        return true;
+    }
+    std::string bytes;
+    if (!ContentHash::base64Decode(encoded, bytes) || bytes.size() != size) {
+        _valid = false;
+        return false;
+    }
+    _digests[algorithm] = bytes;
+    return true;
+}
+
+/*
+ * Returns false if a digest header could not be parsed
+ */
+bool ExpectedDigest::isValid() const {
+    return _valid;
+}
+
+/*
+ * Returns whether there is anything to check
+ */
+bool ExpectedDigest::isEmpty() const {
+    return _digests.empty();
+}
+
+/*
+ * Returns whether the content has to be hashed with MD5 as well
+ */
+bool ExpectedDigest::wantsMd5() const {
+    return _digests.count("md5") > 0;
+}
+
+/*
+ * Returns whether every expected digest equals the computed one
+ */
+bool ExpectedDigest::matches(const ContentHash& hash) const {
+    for (std::map<std::string, std::string>::const_iterator it = _digests.begin(); it != _digests.end(); ++it) {
+        if (hash.digest(it->first) != it->second) {
+            return false;
+        }
+    }
+    return true;
+}
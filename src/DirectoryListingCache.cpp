@@ -0,0 +1,289 @@
+#include "DirectoryListingCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+
+namespace {
+
+// Record layout returned by the getdents64 system call
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+}
+
+/*
+ * Default constructor for DirectoryListingCache
+ * Starts with no cached listings
+ */
+DirectoryListingCache::DirectoryListingCache() : _total_size(0) {}
+
+/*
+ * Destructor for DirectoryListingCache
+ * Chunks still queued on clients stay alive on their own
+ */
+DirectoryListingCache::~DirectoryListingCache() {}
+
+/*
+ * Checks whether a cached listing still describes the directory on disk
+ */
+bool DirectoryListingCache::matches(const Entry& entry, const struct stat& st) {
+    return entry.device == st.st_dev && entry.inode == st.st_ino &&
+           entry.mtime == st.st_mtime && entry.mtime_nsec == st.st_mtim.tv_nsec;
+}
+
+/*
+ * Reads the names in a directory with getdents64, 64KB per call
+ * Skips . and ..; entries of unknown type are classified with fstatat()
+ * Returns false if the directory cannot be opened or read
+ */
+bool DirectoryListingCache::readEntries(const std::string& dir_path, std::vector<DirEntry>& entries) {
+    int fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    while (true) {
+        long bytes = syscall(SYS_getdents64, fd, &buffer[0], buffer.size());
+        if (bytes < 0) {
+            close(fd);
+            return false;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        for (long offset = 0; offset < bytes; ) {
+            const LinuxDirent64* record = reinterpret_cast<const LinuxDirent64*>(&buffer[offset]);
+            offset += record->d_reclen;
+
+            const char* name = record->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            bool is_dir = record->d_type == DT_DIR;
+            if (record->d_type == DT_UNKNOWN) {
+                struct stat st;
+                is_dir = fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+            }
+            entries.push_back(DirEntry(name, is_dir));
+        }
+    }
+    close(fd);
+    return true;
+}
+
+/*
+ * Moves a full batch into the chunk list without copying it
+ */
+void DirectoryListingCache::flushChunk(std::string& batch, std::vector<SharedBuffer>& chunks) {
+    if (!batch.empty()) {
+        chunks.push_back(SharedBuffer::adopt(batch));
+        batch.reserve(CHUNK_SIZE + 1024);
+    }
+}
+
+/*
+ * Appends text with the HTML special characters escaped
+ */
+void DirectoryListingCache::appendHtmlEscaped(std::string& out, const std::string& text) {
+    for (size_t i = 0; i < text.length(); ++i) {
+        switch (text[i]) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            default: out += text[i]; break;
+        }
+    }
+}
+
+/*
+ * Appends text as the inside of a JSON string literal
+ */
+void DirectoryListingCache::appendJsonEscaped(std::string& out, const std::string& text) {
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+/*
+ * Renders the HTML listing, same markup as before, split into chunks
+ * Directory names get a trailing slash
+ */
+void DirectoryListingCache::renderHtml(const std::vector<DirEntry>& entries, const std::string& uri,
+                                       std::vector<SharedBuffer>& chunks) {
+    std::string base = uri;
+    if (base.empty() || base[base.length() - 1] != '/') {
+        base += "/";
+    }
+
+    std::string batch;
+    batch.reserve(CHUNK_SIZE + 1024);
+    batch += "<html><head><title>Directory listing for ";
+    appendHtmlEscaped(batch, uri);
+    batch += "</title></head><body><h1>Directory listing for ";
+    appendHtmlEscaped(batch, uri);
+    batch += "</h1><hr><ul>";
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const std::string& name = entries[i].first;
+        const char* suffix = entries[i].second ? "/" : "";
+        batch += "<li><a href=\"";
+        appendHtmlEscaped(batch, base);
+        appendHtmlEscaped(batch, name);
+        batch += suffix;
+        batch += "\">";
+        appendHtmlEscaped(batch, name);
+        batch += suffix;
+        batch += "</a></li>";
+        if (batch.size() >= CHUNK_SIZE) {
+            flushChunk(batch, chunks);
+        }
+    }
+
+    batch += "</ul><hr></body></html>";
+    flushChunk(batch, chunks);
+}
+
+/*
+ * Renders the listing as a JSON array of {"name", "type"} objects
+ */
+void DirectoryListingCache::renderJson(const std::vector<DirEntry>& entries, std::vector<SharedBuffer>& chunks) {
+    std::string batch;
+    batch.reserve(CHUNK_SIZE + 1024);
+    batch += "[";
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        batch += (i == 0) ? "\n{\"name\":\"" : ",\n{\"name\":\"";
+        appendJsonEscaped(batch, entries[i].first);
+        batch += entries[i].second ? "\",\"type\":\"directory\"}" : "\",\"type\":\"file\"}";
+        if (batch.size() >= CHUNK_SIZE) {
+            flushChunk(batch, chunks);
+        }
+    }
+
+    batch += "\n]\n";
+    flushChunk(batch, chunks);
+}
+
+/*
+ * Removes one cached listing
+ */
+void DirectoryListingCache::erase(std::map<std::string, Entry>::iterator it) {
+    _total_size -= it->second.size;
+    _entries.erase(it);
+}
+
+/*
+ * Drops listings until one more of size bytes fits under the limits
+ */
+void DirectoryListingCache::evictFor(size_t size) {
+    while (!_entries.empty() &&
+           (_entries.size() >= MAX_LISTINGS || _total_size + size > MAX_TOTAL_SIZE)) {
+        erase(_entries.begin());
+    }
+}
+
+/*
+ * Returns the rendered listing of dir_path, described by st, as chunks
+ * Serves from the cache while the directory's mtime is unchanged,
+ * otherwise reads and renders it again
+ * Returns false if the directory cannot be read
+ */
+bool DirectoryListingCache::load(const std::string& dir_path, const struct stat& st, const std::string& uri,
+                                 Location::AutoindexFormat format, bool sorted,
+                                 std::vector<SharedBuffer>& chunks) {
+    // Same spelling as the paths the file watcher reports
+    std::string key = dir_path;
+    while (key.length() > 1 && key[key.length() - 1] == '/') {
+        key.erase(key.length() - 1);
+    }
+    key += '\0';
+    key += (format == Location::AUTOINDEX_JSON) ? 'j' : 'h';
+    key += sorted ? 's' : 'u';
+    key += uri;
+
+    std::map<std::string, Entry>::iterator it = _entries.find(key);
+    if (it != _entries.end()) {
+        if (matches(it->second, st)) {
+            chunks = it->second.chunks;
+            return true;
+        }
+        erase(it);
+    }
+
+    std::vector<DirEntry> entries;
+    if (!readEntries(dir_path, entries)) {
+        return false;
+    }
+    if (sorted) {
+        std::sort(entries.begin(), entries.end());
+    }
+
+    chunks.clear();
+    if (format == Location::AUTOINDEX_JSON) {
+        renderJson(entries, chunks);
+    } else {
+        renderHtml(entries, uri, chunks);
+    }
+
+    size_t size = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        size += chunks[i].size();
+    }
+    if (size <= MAX_TOTAL_SIZE / 4) {
+        evictFor(size);
+        Entry& entry = _entries[key];
+        entry.chunks = chunks;
+        entry.size = size;
+        entry.device = st.st_dev;
+        entry.inode = st.st_ino;
+        entry.mtime = st.st_mtime;
+        entry.mtime_nsec = st.st_mtim.tv_nsec;
+        _total_size += size;
+    }
+    return true;
+}
+
+/*
+ * Removes every cached listing of dir_path, in all formats
+ */
+void DirectoryListingCache::invalidate(const std::string& dir_path) {
+    std::string prefix = dir_path;
+    prefix += '\0';
+    std::map<std::string, Entry>::iterator it = _entries.lower_bound(prefix);
+    while (it != _entries.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        std::map<std::string, Entry>::iterator next = it;
+        ++next;
+        erase(it);
+        it = next;
+    }
+}
+
+/*
+ * Removes every cached listing
+ */
+void DirectoryListingCache::clear() {
+    _entries.clear();
+    _total_size = 0;
+}
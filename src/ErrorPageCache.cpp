@@ -0,0 +1,111 @@
+#include "ErrorPageCache.hpp"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+
+// Page served for 404 when the server block configures none
+static const char* DEFAULT_NOT_FOUND_PAGE = "./www/404.html";
+
+/*
+ * Default constructor for ErrorPageCache
+ * Reserves one slot per 4xx/5xx status code
+ */
+ErrorPageCache::ErrorPageCache()
+    : _pages(LAST_CODE - FIRST_CODE + 1), _present(LAST_CODE - FIRST_CODE + 1, false) {}
+
+/*
+ * Destructor for ErrorPageCache
+ */
+ErrorPageCache::~ErrorPageCache() {}
+
+/*
+ * Returns the built-in response for an error code
+ */
+HttpResponse ErrorPageCache::createBuiltinResponse(int error_code) {
+    switch (error_code) {
+        case 400: return HttpResponse::createBadRequestResponse();
+        case 403: return HttpResponse::createForbiddenResponse();
+        case 404: return HttpResponse::createNotFoundResponse();
+        case 408: return HttpResponse::createRequestTimeoutResponse();
+        case 411: return HttpResponse::createLengthRequiredResponse();
+        case 413: return HttpResponse::createRequestEntityTooLargeResponse();
+        case 500: return HttpResponse::createServerErrorResponse();
+        default: return HttpResponse::createStatusResponse(error_code);
+    }
+}
+
+/*
+ * Reads a whole file into content
+ * Returns false if the file cannot be opened
+ */
+bool ErrorPageCache::loadFile(const std::string& path, std::string& content) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/*
+ * Freezes a response and stores it in the slot for its code
+ */
+void ErrorPageCache::store(int error_code, HttpResponse& response) {
+    response.prepare();
+    _pages[error_code - FIRST_CODE] = response;
+    _present[error_code - FIRST_CODE] = true;
+}
+
+/*
+ * Prepares the built-in pages and every configured error_page
+ * Custom pages that cannot be read fall back to the built-in page
+ */
+void ErrorPageCache::build(const ServerConfig& config) {
+    static const int builtin_codes[] = { 400, 403, 404, 408, 409, 411, 413, 416, 500, 502, 503, 504 };
+    
+    for (size_t i = 0; i < sizeof(builtin_codes) / sizeof(builtin_codes[0]); ++i) {
+        HttpResponse response = createBuiltinResponse(builtin_codes[i]);
+        store(builtin_codes[i], response);
+    }
+    
+    std::map<int, std::string> error_pages = config.getErrorPages();
+    if (error_pages.find(404) == error_pages.end()) {
+        error_pages[404] = DEFAULT_NOT_FOUND_PAGE;
+    }
+    
+    for (std::map<int, std::string>::const_iterator it = error_pages.begin();
+         it != error_pages.end(); ++it) {
+        if (it->first < FIRST_CODE || it->first > LAST_CODE) {
+            std::cerr << "Warning: ignoring error_page for non-error status " << it->first << std::endl;
+            continue;
+        }
+        
+        std::string content;
+        if (!loadFile(it->second, content)) {
+            if (it->second != DEFAULT_NOT_FOUND_PAGE) {
+                std::cerr << "Warning: could not read error page " << it->second << std::endl;
+            }
+            if (!_present[it->first - FIRST_CODE]) {
+                HttpResponse response = createBuiltinResponse(it->first);
+                store(it->first, response);
+            }
+            continue;
+        }
+        
+        HttpResponse response;
+        response.setStatusCode(it->first);
+        response.setContentType("text/html");
+        response.setBody(content);
+        store(it->first, response);
+    }
+}
+
+/*
+ * Returns the prepared response for error_code, or NULL if none exists
+ */
+const HttpResponse* ErrorPageCache::find(int error_code) const {
+    if (error_code < FIRST_CODE || error_code > LAST_CODE || !_present[error_code - FIRST_CODE]) {
+        return NULL;
+    }
+    return &_pages[error_code - FIRST_CODE];
+}
@@ -0,0 +1,859 @@
+#include "FastCgiPool.hpp"
+#include "ServerClock.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Record types and constants from the FastCGI 1.0 specification
+namespace {
+    const unsigned char FCGI_VERSION_1 = 1;
+    const unsigned char FCGI_BEGIN_REQUEST = 1;
+    const unsigned char FCGI_ABORT_REQUEST = 2;
+    const unsigned char FCGI_END_REQUEST = 3;
+    const unsigned char FCGI_PARAMS = 4;
+    const unsigned char FCGI_STDIN = 5;
+    const unsigned char FCGI_STDOUT = 6;
+    const unsigned char FCGI_STDERR = 7;
+    const unsigned char FCGI_GET_VALUES = 9;
+    const unsigned char FCGI_GET_VALUES_RESULT = 10;
+    const unsigned char FCGI_RESPONDER = 1;
+    const unsigned char FCGI_KEEP_CONN = 1;
+    const int FCGI_REQUEST_COMPLETE = 0;
+    const int FCGI_OVERLOADED = 2;
+    const size_t HEADER_SIZE = 8;
+    const size_t MAX_CONTENT = 65535;
+    const size_t STDIN_RECORD = 32768;      // body bytes per FCGI_STDIN record
+    const size_t READ_LIMIT = 262144;       // bytes read per event before others get a turn
+
+    /*
+     * Parses a dotted IPv4 address, or localhost, into network byte order
+     * Returns false if host is neither
+     */
+    bool parseIPv4(const std::string& host, uint32_t& address) {
+        if (host == "localhost") {
+            address = htonl(INADDR_LOOPBACK);
+            return true;
+        }
+        uint32_t value = 0;
+        size_t start = 0;
+        for (int part = 0; part < 4; ++part) {
+            size_t end = host.find('.', start);
+            if ((part < 3) != (end != std::string::npos)) {
+                return false;
+            }
+            if (end == std::string::npos) {
+                end = host.size();
+            }
+            if (end == start || end - start > 3) {
+                return false;
+            }
+            unsigned int number = 0;
+            for (size_t i = start; i < end; ++i) {
+                if (host[i] < '0' || host[i] > '9') {
+                    return false;
+                }
+                number = number * 10 + (host[i] - '0');
+            }
+            if (number > 255) {
+                return false;
+            }
+            value = (value << 8) | number;
+            start = end + 1;
+        }
+        address = htonl(value);
+        return true;
+    }
+}
+
+/*
+ * Creates a request for the worker at address; it waits in the pool
+ * until a connection takes it
+ */
+FastCgiRequest::FastCgiRequest(FastCgiPool* pool, const std::string& address,
+                               const std::string& params, const std::string& body)
+    : _pool(pool), _address(address), _connection(NULL), _params(params), _body(body),
+      _body_sent(0), _stdin_done(false), _received(false), _ended(false), _error_status(0),
+      _app_status(0), _reused_connection(false), _retried(false) {}
+
+/*
+ * Destructor for FastCgiRequest
+ * A request still in flight is taken off its connection first
+ */
+FastCgiRequest::~FastCgiRequest() {
+    _pool->release(this);
+}
+
+/*
+ * The pool polls the connections; a request has no descriptor of its own
+ */
+void FastCgiRequest::getPollFds(std::vector<pollfd>& fds) const {
+    (void)fds;
+}
+
+/*
+ * See getPollFds()
+ */
+bool FastCgiRequest::handleEvent(int fd, short revents) {
+    (void)fd;
+    (void)revents;
+    return false;
+}
+
+/*
+ * There is no child to reap; the end record says when the request is done
+ */
+void FastCgiRequest::reap() {}
+
+/*
+ * Returns whether stdout has ended, with the request
+ */
+bool FastCgiRequest::isOutputComplete() const {
+    return isFinished();
+}
+
+/*
+ * Returns whether the worker ended the request or it failed
+ */
+bool FastCgiRequest::isFinished() const {
+    return _ended || _error_status != 0;
+}
+
+/*
+ * Returns whether the worker completed the request with status 0
+ */
+bool FastCgiRequest::succeeded() const {
+    return _ended && _error_status == 0 && _app_status == 0;
+}
+
+/*
+ * 502 (or 503 when the worker is overloaded) if the worker could not be
+ * reached or gave up, 500 if the application reported failure
+ */
+int FastCgiRequest::getErrorStatus() const {
+    return _error_status != 0 ? _error_status : 500;
+}
+
+/*
+ * Gives up on the request; the worker is told to drop it if it can be
+ */
+void FastCgiRequest::abort() {
+    if (!isFinished()) {
+        _pool->release(this);
+        _error_status = 502;
+    }
+}
+
+/*
+ * Names the request for log messages
+ */
+std::string FastCgiRequest::describe() const {
+    return "FastCGI request to " + _address;
+}
+
+/*
+ * Returns the fastcgi_pass address the request goes to
+ */
+const std::string& FastCgiRequest::getAddress() const {
+    return _address;
+}
+
+/*
+ * Returns the encoded parameters
+ */
+const std::string& FastCgiRequest::getParams() const {
+    return _params;
+}
+
+/*
+ * Takes the next piece of the body, at most max_size bytes, for an
+ * FCGI_STDIN record; an empty piece ends the body
+ * Returns false once the empty record has been handed out
+ */
+bool FastCgiRequest::nextStdin(std::string& data, size_t max_size) {
+    if (_stdin_done) {
+        return false;
+    }
+    size_t size = std::min(max_size, _body.size() - _body_sent);
+    data.assign(_body, _body_sent, size);
+    _body_sent += size;
+    if (size == 0) {
+        _stdin_done = true;
+    }
+    return true;
+}
+
+/*
+ * Records the connection carrying the request, or NULL once it is off
+ * its connection
+ */
+void FastCgiRequest::attach(FastCgiConnection* connection, bool reused) {
+    _connection = connection;
+    if (connection) {
+        _reused_connection = reused;
+    }
+}
+
+/*
+ * A keep-alive connection the worker closed in the meantime fails the
+ * first request sent on it; that request is sent again once
+ */
+bool FastCgiRequest::canRetry() const {
+    return _reused_connection && !_received && !_retried;
+}
+
+/*
+ * Rewinds the request to be sent again on another connection
+ */
+void FastCgiRequest::retry() {
+    _retried = true;
+    _connection = NULL;
+    _body_sent = 0;
+    _stdin_done = false;
+}
+
+/*
+ * Adds FCGI_STDOUT content to the response
+ */
+void FastCgiRequest::receiveStdout(const char* data, size_t size) {
+    _received = true;
+    appendOutput(data, size);
+}
+
+/*
+ * Handles FCGI_END_REQUEST
+ */
+void FastCgiRequest::end(unsigned int app_status, int protocol_status) {
+    _received = true;
+    _connection = NULL;
+    if (protocol_status != FCGI_REQUEST_COMPLETE) {
+        fail(protocol_status == FCGI_OVERLOADED ? 503 : 502);
+        return;
+    }
+    _ended = true;
+    _app_status = app_status;
+    endOutput();
+}
+
+/*
+ * Ends the request without an answer from the worker
+ */
+void FastCgiRequest::fail(int error_status) {
+    _connection = NULL;
+    _error_status = error_status;
+    endOutput();
+}
+
+/*
+ * Appends one FastCGI name-value pair to params
+ * Lengths below 128 take one byte, longer ones four
+ */
+void FastCgiRequest::addParam(std::string& params, const std::string& name, const std::string& value) {
+    const std::string* parts[] = { &name, &value };
+    for (int i = 0; i < 2; ++i) {
+        size_t length = parts[i]->size();
+        if (length < 128) {
+            params += static_cast<char>(length);
+        } else {
+            params += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+            params += static_cast<char>((length >> 16) & 0xff);
+            params += static_cast<char>((length >> 8) & 0xff);
+            params += static_cast<char>(length & 0xff);
+        }
+    }
+    params += name;
+    params += value;
+}
+
+/*
+ * Takes over a connected (or connecting) socket and asks the worker
+ * whether it multiplexes
+ */
+FastCgiConnection::FastCgiConnection(int fd, bool connecting)
+    : _fd(fd), _connecting(connecting), _closed(false), _multiplexed(false), _max_requests(1),
+      _reused(false), _output_sent(0), _idle_since(ServerClock::now()) {
+    std::string values;
+    FastCgiRequest::addParam(values, "FCGI_MPXS_CONNS", "");
+    FastCgiRequest::addParam(values, "FCGI_MAX_REQS", "");
+    queueRecord(FCGI_GET_VALUES, 0, values.data(), values.size());
+}
+
+/*
+ * Destructor for FastCgiConnection
+ */
+FastCgiConnection::~FastCgiConnection() {
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+/*
+ * Opens a non-blocking connection to "unix:/path" or "host:port"
+ * Returns NULL if no socket could be created; a refused connection shows
+ * up later as an error on the socket
+ */
+FastCgiConnection* FastCgiConnection::open(const std::string& address) {
+    int fd;
+    int result;
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return NULL;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+        result = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    } else {
+        size_t colon = address.rfind(':');
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(std::atoi(address.c_str() + colon + 1));
+        if (!parseIPv4(address.substr(0, colon), addr.sin_addr.s_addr)) {
+            return NULL;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+        result = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    }
+    // -1 is usually "in progress"; poll reports the outcome either way
+    return new FastCgiConnection(fd, result != 0);
+}
+
+/*
+ * Returns the socket
+ */
+int FastCgiConnection::getFd() const {
+    return _fd;
+}
+
+/*
+ * Returns the events to poll for: writability while connecting or with
+ * records queued, readability unless a client fell behind
+ */
+short FastCgiConnection::getEvents() const {
+    if (_connecting) {
+        return POLLOUT;
+    }
+    short events = isReadPaused() ? 0 : POLLIN;
+    if (_output_sent < _output.size()) {
+        events |= POLLOUT;
+    }
+    return events;
+}
+
+/*
+ * Returns whether another request can be sent on the connection
+ */
+bool FastCgiConnection::canTake() const {
+    if (_closed) {
+        return false;
+    }
+    if (_requests.empty() && _aborted.empty()) {
+        return true;
+    }
+    return _multiplexed && _requests.size() + _aborted.size() < _max_requests;
+}
+
+/*
+ * Returns whether the connection carries no request
+ */
+bool FastCgiConnection::isIdle() const {
+    return !_closed && _requests.empty() && _aborted.empty();
+}
+
+/*
+ * Returns whether the connection failed or was closed
+ */
+bool FastCgiConnection::isClosed() const {
+    return _closed;
+}
+
+/*
+ * Returns whether a request on the connection has its output paused
+ * Records are not split by request, so one slow client holds up the
+ * connection it shares
+ */
+bool FastCgiConnection::isReadPaused() const {
+    for (std::map<unsigned short, FastCgiRequest*>::const_iterator it = _requests.begin();
+         it != _requests.end(); ++it) {
+        if (it->second->isOutputPaused()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Returns since when the connection has been idle
+ */
+time_t FastCgiConnection::getIdleSince() const {
+    return _idle_since;
+}
+
+/*
+ * Sends request on the connection: begin record, parameters, then the
+ * body as the socket takes it
+ */
+void FastCgiConnection::add(FastCgiRequest* request) {
+    unsigned short id = freeId();
+    _requests[id] = request;
+    request->attach(this, _reused);
+    _reused = true;
+
+    char begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+    queueRecord(FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+    const std::string& params = request->getParams();
+    for (size_t offset = 0; offset < params.size(); offset += MAX_CONTENT) {
+        queueRecord(FCGI_PARAMS, id, params.data() + offset, std::min(MAX_CONTENT, params.size() - offset));
+    }
+    queueRecord(FCGI_PARAMS, id, NULL, 0);
+    queueStdin();
+}
+
+/*
+ * Takes request off the connection before it has ended
+ * A multiplexing worker is told to abort it; otherwise the connection is
+ * in the middle of a response and cannot be used again
+ */
+void FastCgiConnection::remove(FastCgiRequest* request) {
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = _requests.begin();
+         it != _requests.end(); ++it) {
+        if (it->second != request) {
+            continue;
+        }
+        request->attach(NULL, false);
+        if (_multiplexed && !_closed) {
+            queueRecord(FCGI_ABORT_REQUEST, it->first, NULL, 0);
+            _aborted.insert(it->first);
+            _requests.erase(it);
+        } else {
+            _requests.erase(it);
+            std::vector<FastCgiRequest*> orphans;
+            close(orphans);
+        }
+        return;
+    }
+}
+
+/*
+ * Handles poll events on the socket
+ */
+void FastCgiConnection::handleEvent(short revents) {
+    if (_closed) {
+        return;
+    }
+    if (_connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if ((revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+            getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            std::cerr << "FastCGI connection failed" << std::endl;
+            _closed = true;
+            return;
+        }
+        _connecting = false;
+    }
+    if (revents & POLLIN) {
+        readInput();
+    }
+    if (!_closed && (revents & POLLOUT)) {
+        writeOutput();
+    }
+    if (!_closed && !(revents & POLLIN) && (revents & (POLLERR | POLLHUP | POLLNVAL))) {
+        _closed = true;
+    }
+}
+
+/*
+ * Closes the socket and hands back the requests it was carrying
+ */
+void FastCgiConnection::close(std::vector<FastCgiRequest*>& orphans) {
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = _requests.begin();
+         it != _requests.end(); ++it) {
+        it->second->attach(NULL, false);
+        orphans.push_back(it->second);
+    }
+    _requests.clear();
+    _aborted.clear();
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _closed = true;
+}
+
+/*
+ * Appends a record with its header and padding to the output
+ */
+void FastCgiConnection::queueRecord(unsigned char type, unsigned short id, const char* data, size_t size) {
+    size_t padding = (8 - size % 8) % 8;
+    char header[HEADER_SIZE] = {
+        static_cast<char>(FCGI_VERSION_1), static_cast<char>(type),
+        static_cast<char>(id >> 8), static_cast<char>(id & 0xff),
+        static_cast<char>(size >> 8), static_cast<char>(size & 0xff),
+        static_cast<char>(padding), 0
+    };
+    _output.append(header, HEADER_SIZE);
+    if (size > 0) {
+        _output.append(data, size);
+    }
+    _output.append(padding, '\0');
+}
+
+/*
+ * Frames more of the request bodies while little output is queued,
+ * taking turns between requests
+ */
+void FastCgiConnection::queueStdin() {
+    bool progress = true;
+    std::string data;
+    while (progress && _output.size() - _output_sent < OUTPUT_LOW_WATER) {
+        progress = false;
+        for (std::map<unsigned short, FastCgiRequest*>::iterator it = _requests.begin();
+             it != _requests.end(); ++it) {
+            if (it->second->nextStdin(data, STDIN_RECORD)) {
+                queueRecord(FCGI_STDIN, it->first, data.data(), data.size());
+                progress = true;
+            }
+        }
+    }
+}
+
+/*
+ * Writes queued records until the socket is full
+ */
+void FastCgiConnection::writeOutput() {
+    queueStdin();
+    while (_output_sent < _output.size()) {
+        ssize_t sent = send(_fd, _output.data() + _output_sent, _output.size() - _output_sent, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            break;    // full for now; a broken connection is reported by poll
+        }
+        _output_sent += sent;
+        if (_output_sent == _output.size()) {
+            _output.clear();
+            _output_sent = 0;
+            queueStdin();
+        }
+    }
+    if (_output_sent > OUTPUT_LOW_WATER) {
+        _output.erase(0, _output_sent);
+        _output_sent = 0;
+    }
+}
+
+/*
+ * Reads records and hands them to their requests
+ */
+void FastCgiConnection::readInput() {
+    char buffer[65536];
+    size_t total = 0;
+    while (total < READ_LIMIT) {
+        ssize_t bytes_read = recv(_fd, buffer, sizeof(buffer), 0);
+        if (bytes_read < 0) {
+            break;
+        }
+        if (bytes_read == 0) {
+            _closed = true;
+            break;
+        }
+        total += bytes_read;
+        _input.append(buffer, bytes_read);
+    }
+
+    size_t offset = 0;
+    while (_input.size() - offset >= HEADER_SIZE) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(_input.data() + offset);
+        size_t content_length = (header[4] << 8) | header[5];
+        size_t record_length = HEADER_SIZE + content_length + header[6];
+        if (_input.size() - offset < record_length) {
+            break;
+        }
+        handleRecord(header[1], static_cast<unsigned short>((header[2] << 8) | header[3]),
+                     _input.data() + offset + HEADER_SIZE, content_length);
+        offset += record_length;
+    }
+    _input.erase(0, offset);
+}
+
+/*
+ * Handles one complete record from the worker
+ */
+void FastCgiConnection::handleRecord(unsigned char type, unsigned short id, const char* content, size_t size) {
+    if (type == FCGI_GET_VALUES_RESULT) {
+        handleValues(content, size);
+        return;
+    }
+    std::map<unsigned short, FastCgiRequest*>::iterator request = _requests.find(id);
+    if (type == FCGI_STDOUT) {
+        if (request != _requests.end() && size > 0) {
+            request->second->receiveStdout(content, size);
+        }
+    } else if (type == FCGI_STDERR) {
+        if (size > 0) {
+            std::cerr.write(content, size);
+        }
+    } else if (type == FCGI_END_REQUEST && size >= 8) {
+        const unsigned char* body = reinterpret_cast<const unsigned char*>(content);
+        unsigned int app_status = (static_cast<unsigned int>(body[0]) << 24) | (body[1] << 16) |
+                                  (body[2] << 8) | body[3];
+        _aborted.erase(id);
+        if (request != _requests.end()) {
+            FastCgiRequest* ended = request->second;
+            _requests.erase(request);
+            ended->end(app_status, body[4]);
+        }
+        if (isIdle()) {
+            _idle_since = ServerClock::now();
+        }
+    }
+}
+
+/*
+ * Reads the FCGI_GET_VALUES_RESULT name-value pairs
+ */
+void FastCgiConnection::handleValues(const char* content, size_t size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(content);
+    size_t offset = 0;
+    while (offset < size) {
+        size_t lengths[2];
+        for (int i = 0; i < 2; ++i) {
+            if (offset < size && !(p[offset] & 0x80)) {
+                lengths[i] = p[offset++];
+            } else if (offset + 4 <= size) {
+                lengths[i] = ((p[offset] & 0x7f) << 24) | (p[offset + 1] << 16) | (p[offset + 2] << 8) | p[offset + 3];
+                offset += 4;
+            } else {
+                return;
+            }
+        }
+        if (offset + lengths[0] + lengths[1] > size) {
+            return;
+        }
+        std::string name(content + offset, lengths[0]);
+        std::string value(content + offset + lengths[0], lengths[1]);
+        offset += lengths[0] + lengths[1];
+        if (name == "FCGI_MPXS_CONNS") {
+            _multiplexed = (value == "1");
+        } else if (name == "FCGI_MAX_REQS") {
+            _max_requests = std::max(1, std::atoi(value.c_str()));
+        }
+    }
+    if (_multiplexed && _max_requests == 1) {
+        _max_requests = 16;    // multiplexing, but no limit given
+    }
+}
+
+/*
+ * Returns the lowest request id not in use on the connection
+ */
+unsigned short FastCgiConnection::freeId() const {
+    unsigned short id = 1;
+    while (_requests.count(id) || _aborted.count(id)) {
+        ++id;
+    }
+    return id;
+}
+
+/*
+ * Default constructor for FastCgiPool
+ */
+FastCgiPool::FastCgiPool() {}
+
+/*
+ * Destructor for FastCgiPool
+ * Requests belong to their owners, which release them first
+ */
+FastCgiPool::~FastCgiPool() {
+    for (std::map<std::string, Upstream>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        for (size_t i = 0; i < it->second.connections.size(); ++i) {
+            delete it->second.connections[i];
+        }
+    }
+}
+
+/*
+ * Starts a request to the worker at address
+ * The caller owns the returned request and deletes it when done
+ */
+FastCgiRequest* FastCgiPool::start(const std::string& address, const std::string& params, const std::string& body) {
+    FastCgiRequest* request = new FastCgiRequest(this, address, params, body);
+    Upstream& upstream = _upstreams[address];
+    upstream.waiting.push_back(request);
+    dispatch(address, upstream);
+    return request;
+}
+
+/*
+ * Takes a request off its connection, or out of the line of waiting
+ * requests; called when its owner is done with it
+ */
+void FastCgiPool::release(FastCgiRequest* request) {
+    std::map<std::string, Upstream>::iterator upstream = _upstreams.find(request->getAddress());
+    if (upstream == _upstreams.end()) {
+        return;
+    }
+    std::deque<FastCgiRequest*>& waiting = upstream->second.waiting;
+    for (std::deque<FastCgiRequest*>::iterator it = waiting.begin(); it != waiting.end(); ++it) {
+        if (*it == request) {
+            waiting.erase(it);
+            return;
+        }
+    }
+    for (size_t i = 0; i < upstream->second.connections.size(); ++i) {
+        upstream->second.connections[i]->remove(request);
+    }
+    collect(upstream->first, upstream->second);
+    dispatch(upstream->first, upstream->second);
+}
+
+/*
+ * Adds every open connection with the events it waits for
+ */
+void FastCgiPool::getPollFds(std::vector<pollfd>& fds) const {
+    for (std::map<std::string, Upstream>::const_iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        for (size_t i = 0; i < it->second.connections.size(); ++i) {
+            const FastCgiConnection* connection = it->second.connections[i];
+            if (connection->isClosed()) {
+                continue;
+            }
+            pollfd pfd;
+            pfd.fd = connection->getFd();
+            pfd.events = connection->getEvents();
+            pfd.revents = 0;
+            fds.push_back(pfd);
+        }
+    }
+}
+
+/*
+ * Handles poll events on a worker connection
+ * Returns false if fd is not one of the pool's connections
+ */
+bool FastCgiPool::handleEvent(int fd, short revents) {
+    for (std::map<std::string, Upstream>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        for (size_t i = 0; i < it->second.connections.size(); ++i) {
+            if (it->second.connections[i]->getFd() == fd && !it->second.connections[i]->isClosed()) {
+                it->second.connections[i]->handleEvent(revents);
+                collect(it->first, it->second);
+                dispatch(it->first, it->second);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Closes connections that have been idle for IDLE_TIMEOUT seconds
+ */
+void FastCgiPool::closeIdle(time_t now) {
+    for (std::map<std::string, Upstream>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        std::vector<FastCgiConnection*>& connections = it->second.connections;
+        for (size_t i = 0; i < connections.size(); ++i) {
+            if (connections[i]->isIdle() && now - connections[i]->getIdleSince() >= IDLE_TIMEOUT) {
+                std::vector<FastCgiRequest*> orphans;
+                connections[i]->close(orphans);
+            }
+        }
+        collect(it->first, it->second);
+    }
+}
+
+/*
+ * Hands waiting requests to connections that can take them, opening
+ * new connections up to MAX_CONNECTIONS
+ */
+void FastCgiPool::dispatch(const std::string& address, Upstream& upstream) {
+    while (!upstream.waiting.empty()) {
+        FastCgiConnection* connection = NULL;
+        for (size_t i = 0; i < upstream.connections.size() && !connection; ++i) {
+            if (upstream.connections[i]->canTake()) {
+                connection = upstream.connections[i];
+            }
+        }
+        if (!connection && upstream.connections.size() < MAX_CONNECTIONS) {
+            connection = FastCgiConnection::open(address);
+            if (!connection) {
+                std::cerr << "Cannot connect to FastCGI worker " << address << std::endl;
+                FastCgiRequest* request = upstream.waiting.front();
+                upstream.waiting.pop_front();
+                request->fail(502);
+                continue;
+            }
+            upstream.connections.push_back(connection);
+        }
+        if (!connection) {
+            return;    // all connections busy; waits for one to free up
+        }
+        FastCgiRequest* request = upstream.waiting.front();
+        upstream.waiting.pop_front();
+        connection->add(request);
+    }
+}
+
+/*
+ * Removes closed connections; their unanswered requests are sent again
+ * when that is safe, else they fail with 502
+ */
+void FastCgiPool::collect(const std::string& address, Upstream& upstream) {
+    std::vector<FastCgiConnection*>& connections = upstream.connections;
+    for (size_t i = 0; i < connections.size(); ) {
+        if (!connections[i]->isClosed()) {
+            ++i;
+            continue;
+        }
+        std::vector<FastCgiRequest*> orphans;
+        connections[i]->close(orphans);
+        delete connections[i];
+        connections.erase(connections.begin() + i);
+        for (size_t j = orphans.size(); j > 0; --j) {
+            if (orphans[j - 1]->canRetry()) {
+                orphans[j - 1]->retry();
+                upstream.waiting.push_front(orphans[j - 1]);
+            } else {
+                std::cerr << "FastCGI worker " << address << " closed the connection" << std::endl;
+                orphans[j - 1]->fail(502);
+            }
+        }
+    }
+}
+
+/*
+ * Checks a fastcgi_pass address: "unix:/path" or "host:port" with an
+ * IPv4 host or localhost
+ */
+bool FastCgiPool::isValidAddress(const std::string& address) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        return address.size() > 5 && address.size() - 5 < sizeof(((struct sockaddr_un*)0)->sun_path);
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+        return false;
+    }
+    for (size_t i = colon + 1; i < address.size(); ++i) {
+        if (address[i] < '0' || address[i] > '9') {
+            return false;
+        }
+    }
+    int port = std::atoi(address.c_str() + colon + 1);
+    if (port < 1 || port > 65535 || address.size() - colon > 6) {
+        return false;
+    }
+    uint32_t host;
+    return parseIPv4(address.substr(0, colon), host);
+}
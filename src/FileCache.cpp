@@ -0,0 +1,129 @@
+#include "FileCache.hpp"
+#include <fstream>
+
+/*
+ * Default constructor for FileCache
+ * Starts with no cached files
+ */
+FileCache::FileCache() : _total_size(0) {}
+
+/*
+ * Destructor for FileCache
+ * Buffers still referenced by queued responses stay alive on their own
+ */
+FileCache::~FileCache() {}
+
+/*
+ * Checks whether a cached entry still describes the file on disk
+ */
+bool FileCache::matches(const Entry& entry, const struct stat& st) {
+    return entry.device == st.st_dev && entry.inode == st.st_ino &&
+           entry.size == st.st_size && entry.mtime == st.st_mtime;
+}
+
+/*
+ * Reads size bytes of a file into content
+ * Returns false if the file cannot be opened or is shorter than expected
+ */
+bool FileCache::readFile(const std::string& path, size_t size, std::string& content) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    content.resize(size);
+    if (size > 0) {
+        file.read(&content[0], size);
+        if (static_cast<size_t>(file.gcount()) != size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Drops entries until size more bytes fit under MAX_TOTAL_SIZE
+ */
+void FileCache::evictFor(size_t size) {
+    while (!_entries.empty() && _total_size + size > MAX_TOTAL_SIZE) {
+        std::map<std::string, Entry>::iterator victim = _entries.begin();
+        _total_size -= victim->second.body.size();
+        _entries.erase(victim);
+    }
+}
+
+/*
+ * Returns the body and Content-Type of the file at path, described by st
+ * Serves from the cache when the entry is still current, otherwise reads
+ * the file and caches it if it is small enough
+ * Returns false if the file cannot be read
+ */
+bool FileCache::load(const std::string& path, const struct stat& st, const MimeTypes& mime_types,
+                     SharedBuffer& body, const std::string*& content_type) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end()) {
+        Entry& entry = it->second;
+        if (matches(entry, st)) {
+            if (entry.mime_source != &mime_types) {
+                entry.mime_source = &mime_types;
+                entry.content_type = &mime_types.lookup(path);
+            }
+            body = entry.body;
+            content_type = entry.content_type;
+            return true;
+        }
+        _total_size -= entry.body.size();
+        _entries.erase(it);
+    }
+    
+    std::string content;
+    if (!readFile(path, static_cast<size_t>(st.st_size), content)) {
+        return false;
+    }
+    body = SharedBuffer::adopt(content);
+    content_type = &mime_types.lookup(path);
+    
+    if (static_cast<size_t>(st.st_size) <= MAX_FILE_SIZE) {
+        evictFor(body.size());
+        Entry& entry = _entries[path];
+        entry.body = body;
+        entry.device = st.st_dev;
+        entry.inode = st.st_ino;
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entry.mime_source = &mime_types;
+        entry.content_type = content_type;
+        _total_size += body.size();
+    }
+    return true;
+}
+
+/*
+ * Removes the cached copy of path, if any
+ */
+void FileCache::invalidate(const std::string& path) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end()) {
+        _total_size -= it->second.body.size();
+        _entries.erase(it);
+    }
+}
+
+/*
+ * Removes the cached copies of every file below dir
+ */
+void FileCache::invalidateTree(const std::string& dir) {
+    std::string prefix = dir + "/";
+    std::map<std::string, Entry>::iterator it = _entries.lower_bound(prefix);
+    while (it != _entries.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        _total_size -= it->second.body.size();
+        _entries.erase(it++);
+    }
+}
+
+/*
+ * Removes every cached file
+ */
+void FileCache::clear() {
+    _entries.clear();
+    _total_size = 0;
+}
@@ -0,0 +1,265 @@
+#include "FileWatcher.hpp"
+#include <iostream>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+namespace {
+
+// Everything that can make a cached file, stat result or listing stale
+const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+}
+
+/*
+ * Default constructor for FileWatcher
+ * Nothing is watched until start() succeeds
+ */
+FileWatcher::FileWatcher() : _fd(-1), _complete(true) {}
+
+/*
+ * Destructor for FileWatcher
+ * Closing the descriptor drops all of its watches
+ */
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+/*
+ * Opens the non-blocking inotify descriptor
+ * Returns false if inotify is unavailable; callers then keep validating
+ * cached entries with stat()
+ */
+bool FileWatcher::start() {
+    if (_fd >= 0) {
+        return true;
+    }
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) {
+        std::cerr << "Warning: inotify unavailable, file caches fall back to stat()" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Closes the descriptor and forgets every watch
+ */
+void FileWatcher::stop() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _paths.clear();
+    _watches.clear();
+    _complete = true;
+}
+
+/*
+ * Returns path without trailing slashes, the spelling used for watches
+ */
+std::string FileWatcher::normalize(const std::string& path) {
+    std::string normalized = path;
+    while (normalized.length() > 1 && normalized[normalized.length() - 1] == '/') {
+        normalized.erase(normalized.length() - 1);
+    }
+    return normalized;
+}
+
+/*
+ * Adds a watch on one directory
+ * Returns false if the watch limit is reached or inotify refuses it
+ */
+bool FileWatcher::addWatch(const std::string& dir) {
+    if (_watches.find(dir) != _watches.end()) {
+        return true;
+    }
+    if (_watches.size() >= MAX_WATCHES) {
+        return false;
+    }
+    int wd = inotify_add_watch(_fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        return false;
+    }
+    // A directory reached under two names shares one descriptor; keep the first
+    if (_paths.find(wd) != _paths.end()) {
+        return true;
+    }
+    _paths[wd] = dir;
+    _watches[dir] = wd;
+    return true;
+}
+
+/*
+ * Forgets the bookkeeping of a watch descriptor
+ */
+void FileWatcher::removeWatch(int wd) {
+    std::map<int, std::string>::iterator it = _paths.find(wd);
+    if (it != _paths.end()) {
+        _watches.erase(it->second);
+        _paths.erase(it);
+    }
+}
+
+/*
+ * Drops the watches of dir and everything below it
+ * Used when a directory is moved away and its recorded paths go stale
+ */
+void FileWatcher::removeTree(const std::string& dir) {
+    std::map<std::string, int>::iterator it = _watches.find(dir);
+    if (it != _watches.end()) {
+        inotify_rm_watch(_fd, it->second);
+        _paths.erase(it->second);
+        _watches.erase(it);
+    }
+
+    std::string prefix = dir + "/";
+    it = _watches.lower_bound(prefix);
+    while (it != _watches.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        std::map<std::string, int>::iterator next = it;
+        ++next;
+        inotify_rm_watch(_fd, it->second);
+        _paths.erase(it->second);
+        _watches.erase(it);
+        it = next;
+    }
+}
+
+/*
+ * Watches root and every directory below it, breadth first
+ * Symbolic links to directories are not followed below the root
+ */
+void FileWatcher::watchTree(const std::string& root) {
+    if (_fd < 0) {
+        return;
+    }
+    std::vector<std::string> pending(1, normalize(root));
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (!addWatch(pending[i])) {
+            _complete = false;
+            if (_watches.size() >= MAX_WATCHES) {
+                std::cerr << "Warning: watch limit reached under " << root
+                          << ", remaining files are checked with stat()" << std::endl;
+                return;
+            }
+            continue;
+        }
+
+        DIR* dir = opendir(pending[i].c_str());
+        if (!dir) {
+            continue;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            std::string child = pending[i] == "/" ? "/" + std::string(name) : pending[i] + "/" + name;
+            bool is_dir = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat st;
+                is_dir = lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (is_dir) {
+                pending.push_back(child);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+/*
+ * Returns whether changes directly inside dir are being reported
+ */
+bool FileWatcher::isWatched(const std::string& dir) const {
+    return _watches.find(dir) != _watches.end();
+}
+
+/*
+ * Returns whether creating path would be reported
+ * True when a directory above it is watched and no directory of the
+ * watched trees was left out, so every existing ancestor is watched too
+ */
+bool FileWatcher::coversTree(const std::string& path) const {
+    if (!_complete || _watches.empty()) {
+        return false;
+    }
+    size_t slash = path.rfind('/');
+    while (slash != std::string::npos && slash > 0) {
+        if (_watches.find(path.substr(0, slash)) != _watches.end()) {
+            return true;
+        }
+        slash = path.rfind('/', slash - 1);
+    }
+    return false;
+}
+
+/*
+ * Drains pending events and appends the paths that changed
+ * Directory events report the directory itself; new subdirectories are
+ * watched as they appear. Returns false if events were lost, in which
+ * case the caller must treat everything as changed.
+ */
+bool FileWatcher::readChanges(std::vector<std::string>& paths) {
+    if (_fd < 0) {
+        return true;
+    }
+    bool complete = true;
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true) {
+        ssize_t bytes = read(_fd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < bytes; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                complete = false;
+                continue;
+            }
+            std::map<int, std::string>::iterator watch = _paths.find(event->wd);
+            if (watch == _paths.end()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                paths.push_back(watch->second);
+                removeWatch(event->wd);
+                continue;
+            }
+
+            const std::string dir = watch->second;
+            std::string path = dir;
+            if (event->len > 0 && event->name[0] != '\0') {
+                path = (path == "/") ? "/" + std::string(event->name) : path + "/" + event->name;
+            }
+            paths.push_back(path);
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watchTree(path);
+                } else if (event->mask & IN_MOVED_FROM) {
+                    removeTree(path);
+                }
+            }
+            if (event->mask & IN_MOVE_SELF) {
+                removeTree(dir);
+            }
+        }
+    }
+    return complete;
+}
+
+/*
+ * Returns the inotify descriptor for poll(), or -1 when not started
+ */
+int FileWatcher::getFd() const {
+    return _fd;
+}
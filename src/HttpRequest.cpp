@@ -194,13 +194,11 @@ bool HttpRequest::parseHeader(const std::string& line) {
     return true;
 }
 
-bool HttpRequest::parse(const std::string& raw_request) {
-    clear();
-    
-    if (raw_request.empty()) {
-        return false;
-    }
-    
+/*
+ * Parses the request line and headers from stream, which reads raw_request
+ * Leaves stream at the first byte of the body
+ */
+bool HttpRequest::parseHead(const std::string& raw_request, std::istringstream& stream) {
     // Validate line endings for headers only - body content can have mixed line endings
     // Find where headers end (first occurrence of \r\n\r\n)
     size_t headers_end = raw_request.find("\r\n\r\n");
@@ -222,7 +220,6 @@ bool HttpRequest::parse(const std::string& raw_request) {
         }
     }
     
-    std::istringstream stream(raw_request);
     std::string line;
     
     // Parse request line
@@ -255,6 +252,46 @@ bool HttpRequest::parse(const std::string& raw_request) {
             return false;
         }
     }
+    return true;
+}
+
+/*
+ * Parses only the request line and headers, for requests whose body is
+ * streamed instead of buffered; the request is left incomplete
+ * Returns false until the whole header block has arrived or if it is malformed
+ */
+bool HttpRequest::parseHeaders(const std::string& raw_request) {
+    clear();
+    
+    size_t header_end = raw_request.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        return false;
+    }
+    std::istringstream stream(raw_request.substr(0, header_end + 4));
+    if (!parseHead(raw_request, stream)) {
+        return false;
+    }
+    if (_version == "HTTP/1.1" && !hasHeader("host")) {
+        _error_code = 400;
+        return false;
+    }
+    _is_valid = true;
+    _is_complete = false;
+    _bytes_consumed = header_end + 4;
+    return true;
+}
+
+bool HttpRequest::parse(const std::string& raw_request) {
+    clear();
+    
+    if (raw_request.empty()) {
+        return false;
+    }
+    
+    std::istringstream stream(raw_request);
+    if (!parseHead(raw_request, stream)) {
+        return false;
+    }
     
     // Read body if present
     size_t expected_content_length = getContentLength();
@@ -408,6 +445,15 @@ const std::string& HttpRequest::getUri() const {
     return _uri;
 }
 
+std::string HttpRequest::getPath() const {
+    return _uri.substr(0, _uri.find('?'));
+}
+
+std::string HttpRequest::getQueryString() const {
+    size_t question = _uri.find('?');
+    return question == std::string::npos ? "" : _uri.substr(question + 1);
+}
+
 const std::string& HttpRequest::getVersion() const {
     return _version;
 }
@@ -466,6 +512,49 @@ bool HttpRequest::isKeepAlive() const {
     }
 }
 
+/*
+ * Returns whether Accept-Encoding allows coding, named or through "*"
+ * Only a q of zero ("0", "0.0", "0.000", ...) refuses it; spaces around
+ * ';' and '=' are allowed
+ */
+bool HttpRequest::acceptsEncoding(const std::string& coding) const {
+    std::string accept_encoding = getHeader("accept-encoding");
+    int named = -1;      // -1 not listed, 0 refused, 1 accepted
+    int wildcard = -1;
+    size_t start = 0;
+    while (start < accept_encoding.length()) {
+        size_t end = accept_encoding.find(',', start);
+        if (end == std::string::npos) {
+            end = accept_encoding.length();
+        }
+        std::string element = accept_encoding.substr(start, end - start);
+        start = end + 1;
+        size_t semicolon = element.find(';');
+        std::string name = toLowerCase(trim(element.substr(0, semicolon)));
+        bool refused = false;
+        while (semicolon != std::string::npos) {
+            size_t next = element.find(';', semicolon + 1);
+            std::string parameter = element.substr(semicolon + 1, next == std::string::npos ? std::string::npos
+                                                                                            : next - semicolon - 1);
+            semicolon = next;
+            size_t equals = parameter.find('=');
+            if (equals == std::string::npos || toLowerCase(trim(parameter.substr(0, equals))) != "q") {
+                continue;
+            }
+            std::string q = trim(parameter.substr(equals + 1));
+            refused = !q.empty() && q[0] == '0' &&
+                      (q.length() == 1 || (q[1] == '.' && q.length() <= 5 &&
+                                           q.find_first_not_of('0', 2) == std::string::npos));
+        }
+        if (name == coding) {
+            named = refused ? 0 : 1;
+        } else if (name == "*") {
+            wildcard = refused ? 0 : 1;
+        }
+    }
+    return named >= 0 ? named == 1 : wildcard == 1;
+}
+
 bool HttpRequest::validatePostRequest() const {
     if (_method == "POST") {
         // If POST has a body, Content-Length is required
@@ -1,41 +1,147 @@
 #include "HttpResponse.hpp"
+#include "ServerClock.hpp"
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
 #include <cctype>
+#include <cstring>
 
-HttpResponse::HttpResponse() : _status_code(200), _version("HTTP/1.1"), _is_head_response(false) {
-    _status_message = getStatusMessage(_status_code);
+/*
+ * Precomputed "HTTP/1.1 <code> <reason>\r\n" lines for codes 100-599
+ * Built once on first use so the status line is a single copy
+ */
+class StatusLineTable {
+public:
+    static const int FIRST_CODE = 100;
+    static const int LAST_CODE = 599;
+    std::string lines[LAST_CODE - FIRST_CODE + 1];
+    
+    explicit StatusLineTable(const char* (*message_for)(int)) {
+        for (int code = FIRST_CODE; code <= LAST_CODE; ++code) {
+            char digits[20];
+            size_t length = HttpResponse::formatNumber(digits, code);
+            std::string& line = lines[code - FIRST_CODE];
+            line = "HTTP/1.1 ";
+            line.append(digits, length);
+            line += ' ';
+            line += message_for(code);
+            line += "\r\n";
+        }
+    }
+};
+
+/*
+ * Returns the shared status line table, built on first use
+ */
+static const StatusLineTable& getStatusLineTable(const char* (*message_for)(int)) {
+    static const StatusLineTable table(message_for);
+    return table;
 }
 
+HttpResponse::HttpResponse()
+    : _status_code(200), _version("HTTP/1.1"), _slot_mask(0),
+      _is_head_response(false), _is_chunked(false), _is_prepared(false) {}
+
 HttpResponse::~HttpResponse() {}
 
-std::string HttpResponse::getStatusMessage(int status_code) const {
+const char* HttpResponse::getStatusMessage(int status_code) {
     switch (status_code) {
         case 200: return "OK";
         case 201: return "Created";
         case 204: return "No Content";
         case 301: return "Moved Permanently";
         case 302: return "Found";
+        case 304: return "Not Modified";
         case 400: return "Bad Request";
         case 401: return "Unauthorized";
         case 403: return "Forbidden";
         case 404: return "Not Found";
         case 405: return "Method Not Allowed";
         case 408: return "Request Timeout";
+        case 409: return "Conflict";
         case 411: return "Length Required";
         case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
         case 500: return "Internal Server Error";
         case 501: return "Not Implemented";
         case 502: return "Bad Gateway";
         case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
         default: return "Unknown";
     }
 }
 
+/*
+ * Returns the wire name of a fixed header slot
+ */
+const char* HttpResponse::getHeaderSlotName(HeaderSlot slot) {
+    switch (slot) {
+        case HEADER_CONTENT_TYPE: return "Content-Type";
+        case HEADER_CONTENT_LENGTH: return "Content-Length";
+        case HEADER_TRANSFER_ENCODING: return "Transfer-Encoding";
+        case HEADER_LOCATION: return "Location";
+        case HEADER_ALLOW: return "Allow";
+        case HEADER_CONNECTION: return "Connection";
+        default: return "";
+    }
+}
+
+/*
+ * Maps a header name to its fixed slot (case-insensitive)
+ * Returns -1 for headers stored in the extra list
+ */
+int HttpResponse::findHeaderSlot(const std::string& name) {
+    for (int slot = 0; slot < HEADER_SLOT_COUNT; ++slot) {
+        const char* slot_name = getHeaderSlotName(static_cast<HeaderSlot>(slot));
+        size_t length = std::strlen(slot_name);
+        if (name.size() != length) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < length && std::tolower(static_cast<unsigned char>(name[i])) ==
+                             std::tolower(static_cast<unsigned char>(slot_name[i]))) {
+            ++i;
+        }
+        if (i == length) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Writes value in decimal, two digits per step
+ * buffer must hold at least 20 bytes; returns the number of digits written
+ */
+size_t HttpResponse::formatNumber(char* buffer, size_t value) {
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char reversed[20];
+    size_t pos = sizeof(reversed);
+    
+    while (value >= 100) {
+        size_t pair = (value % 100) * 2;
+        value /= 100;
+        reversed[--pos] = digit_pairs[pair + 1];
+        reversed[--pos] = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        size_t pair = value * 2;
+        reversed[--pos] = digit_pairs[pair + 1];
+        reversed[--pos] = digit_pairs[pair];
+    } else {
+        reversed[--pos] = static_cast<char>('0' + value);
+    }
+    
+    size_t length = sizeof(reversed) - pos;
+    std::memcpy(buffer, reversed + pos, length);
+    return length;
+}
+
 void HttpResponse::setStatusCode(int status_code) {
     _status_code = status_code;
-    _status_message = getStatusMessage(status_code);
 }
 
 void HttpResponse::setVersion(const std::string& version) {
@@ -43,30 +149,178 @@ void HttpResponse::setVersion(const std::string& version) {
 }
 
 void HttpResponse::setHeader(const std::string& name, const std::string& value) {
-    _headers[name] = value;
+    int slot = findHeaderSlot(name);
+    if (slot >= 0) {
+        setHeader(static_cast<HeaderSlot>(slot), value);
+        return;
+    }
+    for (size_t i = 0; i < _extra_headers.size(); ++i) {
+        if (_extra_headers[i].first == name) {
+            _extra_headers[i].second = value;
+            return;
+        }
+    }
+    _extra_headers.push_back(HeaderField(name, value));
+}
+
+void HttpResponse::setHeader(HeaderSlot slot, const std::string& value) {
+    _slot_values[slot] = value;
+    _slot_mask |= 1u << slot;
+}
+
+void HttpResponse::removeHeader(HeaderSlot slot) {
+    _slot_values[slot].clear();
+    _slot_mask &= ~(1u << slot);
 }
 
 void HttpResponse::setBody(const std::string& body) {
+    _shared_body.clear();
+    if (_is_chunked) {
+        // Re-frame the whole body as a single chunk
+        _body = body.empty() ? std::string() : formatChunk(body.data(), body.size());
+        return;
+    }
     _body = body;
     setContentLength(body.size());
 }
 
+/*
+ * Uses a shared buffer as the body without copying it
+ * Used for content served from caches
+ */
+void HttpResponse::setBody(const SharedBuffer& body) {
+    _body.clear();
+    _shared_body.clear();
+    if (!body.empty()) {
+        _shared_body.push_back(body);
+    }
+    setContentLength(body.size());
+}
+
 void HttpResponse::setContentType(const std::string& content_type) {
-    setHeader("Content-Type", content_type);
+    setHeader(HEADER_CONTENT_TYPE, content_type);
 }
 
 void HttpResponse::setContentLength(size_t length) {
-    std::ostringstream oss;
-    oss << length;
-    setHeader("Content-Length", oss.str());
+    char digits[20];
+    _slot_values[HEADER_CONTENT_LENGTH].assign(digits, formatNumber(digits, length));
+    _slot_mask |= 1u << HEADER_CONTENT_LENGTH;
 }
 
 void HttpResponse::setConnection(bool keep_alive) {
-    if (keep_alive) {
-        setHeader("Connection", "keep-alive");
+    static const std::string keep_alive_value("keep-alive");
+    static const std::string close_value("close");
+    setHeader(HEADER_CONNECTION, keep_alive ? keep_alive_value : close_value);
+}
+
+/*
+ * Switches the response to chunked transfer coding
+ * Content-Length is dropped since the body length is not known up front
+ */
+void HttpResponse::setChunked(bool chunked) {
+    if (chunked == _is_chunked) {
+        return;
+    }
+    _is_chunked = chunked;
+    if (chunked) {
+        removeHeader(HEADER_CONTENT_LENGTH);
+        setHeader(HEADER_TRANSFER_ENCODING, "chunked");
+        std::string raw_body;
+        raw_body.swap(_body);
+        if (!raw_body.empty()) {
+            _body = formatChunk(raw_body.data(), raw_body.size());
+        }
+        std::vector<SharedBuffer> raw_segments;
+        raw_segments.swap(_shared_body);
+        for (size_t i = 0; i < raw_segments.size(); ++i) {
+            appendChunk(raw_segments[i]);
+        }
+    } else {
+        // Only valid before any chunk has been appended
+        removeHeader(HEADER_TRANSFER_ENCODING);
+        _body.clear();
+        _shared_body.clear();
+        setContentLength(0);
+    }
+}
+
+/*
+ * Appends data to a chunked body as a single chunk
+ * Empty data is ignored because a zero-size chunk terminates the body
+ */
+void HttpResponse::appendChunk(const std::string& data) {
+    if (data.empty() && _is_chunked) {
+        return;
+    }
+    std::string framed = _is_chunked ? formatChunk(data.data(), data.size()) : data;
+    if (_shared_body.empty()) {
+        _body += framed;
     } else {
-        setHeader("Connection", "close");
+        // Keep the order once shared segments follow _body
+        _shared_body.push_back(SharedBuffer::adopt(framed));
+    }
+    if (!_is_chunked) {
+        setContentLength(_body.size() + sharedBodySize());
+    }
+}
+
+/*
+ * Appends a shared buffer to the body by reference
+ * For chunked responses it is framed as one chunk; the data is not copied
+ */
+void HttpResponse::appendChunk(const SharedBuffer& data) {
+    static const SharedBuffer chunk_end(std::string("\r\n"));
+    if (data.empty()) {
+        return;
+    }
+    if (!_is_chunked) {
+        _shared_body.push_back(data);
+        setContentLength(_body.size() + sharedBodySize());
+        return;
     }
+    char size_line[sizeof(size_t) * 2 + 2];
+    _shared_body.push_back(SharedBuffer(std::string(size_line, formatChunkSize(size_line, data.size()))));
+    _shared_body.push_back(data);
+    _shared_body.push_back(chunk_end);
+}
+
+/*
+ * Returns the total size of the shared body segments
+ */
+size_t HttpResponse::sharedBodySize() const {
+    size_t size = 0;
+    for (size_t i = 0; i < _shared_body.size(); ++i) {
+        size += _shared_body[i].size();
+    }
+    return size;
+}
+
+/*
+ * Freezes the response into shared immutable buffers
+ * The status line and headers are serialized once (without Connection,
+ * which depends on the client) and the body is moved into shared storage.
+ * Copies of a prepared response only bump reference counts; headers set
+ * afterwards are appended per response at serialization time.
+ */
+void HttpResponse::prepare() {
+    if (_is_prepared) {
+        return;
+    }
+    removeHeader(HEADER_CONNECTION);
+    // Date and Server are written per response, after the prepared head
+    std::string head(headersSize(false), '\0');
+    writeHeaders(&head[0], false);
+    head.erase(head.size() - 2);  // Drop the blank line, dynamic headers follow
+    _prepared_head = SharedBuffer::adopt(head);
+    if (!_body.empty()) {
+        _shared_body.insert(_shared_body.begin(), SharedBuffer::adopt(_body));
+    }
+    for (int slot = 0; slot < HEADER_SLOT_COUNT; ++slot) {
+        _slot_values[slot].clear();
+    }
+    _slot_mask = 0;
+    _extra_headers.clear();
+    _is_prepared = true;
 }
 
 int HttpResponse::getStatusCode() const {
@@ -82,34 +336,260 @@ const std::string& HttpResponse::getBody() const {
 }
 
 std::string HttpResponse::getHeader(const std::string& name) const {
-    std::map<std::string, std::string>::const_iterator it = _headers.find(name);
-    if (it != _headers.end()) {
-        return it->second;
+    int slot = findHeaderSlot(name);
+    if (slot >= 0) {
+        return _slot_values[slot];
+    }
+    for (size_t i = 0; i < _extra_headers.size(); ++i) {
+        if (_extra_headers[i].first == name) {
+            return _extra_headers[i].second;
+        }
     }
     return "";
 }
 
-std::string HttpResponse::toString() const {
-    std::ostringstream response;
+bool HttpResponse::isChunked() const {
+    return _is_chunked;
+}
+
+bool HttpResponse::isPrepared() const {
+    return _is_prepared;
+}
+
+/*
+ * Returns the exact number of bytes writeHeaders() produces
+ */
+size_t HttpResponse::headersSize(bool with_generated) const {
+    size_t size;
+    if (_is_prepared) {
+        size = _prepared_head.size();
+    } else if (_version == "HTTP/1.1" && _status_code >= StatusLineTable::FIRST_CODE &&
+               _status_code <= StatusLineTable::LAST_CODE) {
+        size = getStatusLineTable(getStatusMessage).lines[_status_code - StatusLineTable::FIRST_CODE].size();
+    } else {
+        char digits[20];
+        size = _version.size() + 1 + formatNumber(digits, _status_code) + 1 +
+               std::strlen(getStatusMessage(_status_code)) + 2;
+    }
     
-    // Status line
-    response << _version << " " << _status_code << " " << _status_message << "\r\n";
+    if (with_generated) {
+        size += 8 + ServerClock::serverToken().size() + 2;  // "Server: " token CRLF
+        size += 6 + ServerClock::httpDate().size() + 2;     // "Date: " date CRLF
+    }
     
-    // Headers
-    for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); 
-         it != _headers.end(); ++it) {
-        response << it->first << ": " << it->second << "\r\n";
+    for (int slot = 0; slot < HEADER_SLOT_COUNT; ++slot) {
+        if (_slot_mask & (1u << slot)) {
+            size += std::strlen(getHeaderSlotName(static_cast<HeaderSlot>(slot))) + 2 +
+                    _slot_values[slot].size() + 2;
+        }
+    }
+    for (size_t i = 0; i < _extra_headers.size(); ++i) {
+        size += _extra_headers[i].first.size() + 2 + _extra_headers[i].second.size() + 2;
+    }
+    return size + 2;
+}
+
+/*
+ * Writes the status line, headers and blank line into out
+ * with_generated adds the Server and Date headers from the loop clock
+ * out must hold headersSize() bytes; returns the number of bytes written
+ */
+size_t HttpResponse::writeHeaders(char* out, bool with_generated) const {
+    const StatusLineTable& status_lines = getStatusLineTable(getStatusMessage);
+    char* p = out;
+    
+    if (_is_prepared) {
+        std::memcpy(p, _prepared_head.data(), _prepared_head.size());
+        p += _prepared_head.size();
+    } else if (_version == "HTTP/1.1" && _status_code >= StatusLineTable::FIRST_CODE &&
+               _status_code <= StatusLineTable::LAST_CODE) {
+        const std::string& line = status_lines.lines[_status_code - StatusLineTable::FIRST_CODE];
+        std::memcpy(p, line.data(), line.size());
+        p += line.size();
+    } else {
+        const char* message = getStatusMessage(_status_code);
+        std::memcpy(p, _version.data(), _version.size());
+        p += _version.size();
+        *p++ = ' ';
+        p += formatNumber(p, _status_code);
+        *p++ = ' ';
+        std::memcpy(p, message, std::strlen(message));
+        p += std::strlen(message);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    
+    if (with_generated) {
+        const std::string& server = ServerClock::serverToken();
+        const std::string& date = ServerClock::httpDate();
+        std::memcpy(p, "Server: ", 8);
+        p += 8;
+        std::memcpy(p, server.data(), server.size());
+        p += server.size();
+        std::memcpy(p, "\r\nDate: ", 8);
+        p += 8;
+        std::memcpy(p, date.data(), date.size());
+        p += date.size();
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    
+    for (int slot = 0; slot < HEADER_SLOT_COUNT; ++slot) {
+        if (!(_slot_mask & (1u << slot))) {
+            continue;
+        }
+        const char* name = getHeaderSlotName(static_cast<HeaderSlot>(slot));
+        size_t name_length = std::strlen(name);
+        std::memcpy(p, name, name_length);
+        p += name_length;
+        *p++ = ':';
+        *p++ = ' ';
+        std::memcpy(p, _slot_values[slot].data(), _slot_values[slot].size());
+        p += _slot_values[slot].size();
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    for (size_t i = 0; i < _extra_headers.size(); ++i) {
+        const HeaderField& field = _extra_headers[i];
+        std::memcpy(p, field.first.data(), field.first.size());
+        p += field.first.size();
+        *p++ = ':';
+        *p++ = ' ';
+        std::memcpy(p, field.second.data(), field.second.size());
+        p += field.second.size();
+        *p++ = '\r';
+        *p++ = '\n';
     }
     
     // Empty line to separate headers from body
-    response << "\r\n";
+    *p++ = '\r';
+    *p++ = '\n';
+    return p - out;
+}
+
+/*
+ * Serializes the whole response into one preallocated string
+ */
+std::string HttpResponse::toString() const {
+    size_t head_size = headersSize(true);
+    size_t body_size = 0;
     
     // Body (only for non-HEAD responses)
     if (!_is_head_response) {
-        response << _body;
+        body_size = _body.size() + sharedBodySize() + (_is_chunked ? lastChunk().size() : 0);
+    }
+    
+    std::string response(head_size + body_size, '\0');
+    char* p = &response[0];
+    p += writeHeaders(p, true);
+    
+    if (!_is_head_response) {
+        if (!_body.empty()) {
+            std::memcpy(p, _body.data(), _body.size());
+            p += _body.size();
+        }
+        for (size_t i = 0; i < _shared_body.size(); ++i) {
+            std::memcpy(p, _shared_body[i].data(), _shared_body[i].size());
+            p += _shared_body[i].size();
+        }
+        if (_is_chunked) {
+            std::memcpy(p, lastChunk().data(), lastChunk().size());
+        }
     }
     
-    return response.str();
+    return response;
+}
+
+/*
+ * Serializes the status line and headers, including the blank line
+ * Streaming producers send this first and follow up with chunks
+ */
+std::string HttpResponse::headersToString() const {
+    std::string head(headersSize(true), '\0');
+    writeHeaders(&head[0], true);
+    return head;
+}
+
+/*
+ * Serializes the response as output queue segments
+ * Headers and any generated body share one fresh buffer; a shared body is
+ * appended by reference so cached content is never copied per response
+ */
+void HttpResponse::serialize(std::vector<SharedBuffer>& segments) const {
+    static const SharedBuffer last_chunk(lastChunk());
+    // The last chunk goes inline unless shared segments come after _body
+    bool inline_last_chunk = _is_chunked && _shared_body.empty();
+    size_t head_size = headersSize(true);
+    size_t body_size = 0;
+    if (!_is_head_response) {
+        body_size = _body.size() + (inline_last_chunk ? lastChunk().size() : 0);
+    }
+    
+    std::string head(head_size + body_size, '\0');
+    char* p = &head[0];
+    p += writeHeaders(p, true);
+    if (!_is_head_response) {
+        if (!_body.empty()) {
+            std::memcpy(p, _body.data(), _body.size());
+            p += _body.size();
+        }
+        if (inline_last_chunk) {
+            std::memcpy(p, lastChunk().data(), lastChunk().size());
+        }
+    }
+    segments.push_back(SharedBuffer::adopt(head));
+    
+    if (!_is_head_response && !_shared_body.empty()) {
+        segments.insert(segments.end(), _shared_body.begin(), _shared_body.end());
+        if (_is_chunked) {
+            segments.push_back(last_chunk);
+        }
+    }
+}
+
+/*
+ * Writes the chunk size line (hex size, CRLF) for length bytes
+ * out must hold sizeof(size_t) * 2 + 2 bytes; returns the length written
+ */
+size_t HttpResponse::formatChunkSize(char* out, size_t length) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char digits[sizeof(size_t) * 2];
+    size_t count = 0;
+    do {
+        digits[count++] = hex_digits[length & 0xf];
+        length >>= 4;
+    } while (length != 0);
+    
+    size_t pos = 0;
+    while (count > 0) {
+        out[pos++] = digits[--count];
+    }
+    out[pos++] = '\r';
+    out[pos++] = '\n';
+    return pos;
+}
+
+/*
+ * Frames data as one chunk: hex size, CRLF, data, CRLF
+ */
+std::string HttpResponse::formatChunk(const char* data, size_t length) {
+    char size_line[sizeof(size_t) * 2 + 2];
+    size_t size_length = formatChunkSize(size_line, length);
+    
+    std::string chunk;
+    chunk.reserve(size_length + length + 2);
+    chunk.append(size_line, size_length);
+    chunk.append(data, length);
+    chunk.append("\r\n", 2);
+    return chunk;
+}
+
+/*
+ * Returns the terminating zero-size chunk (no trailers)
+ */
+const std::string& HttpResponse::lastChunk() {
+    static const std::string last_chunk("0\r\n\r\n");
+    return last_chunk;
 }
 
 HttpResponse HttpResponse::createOkResponse(const std::string& body, const std::string& content_type) {
@@ -121,6 +601,15 @@ HttpResponse HttpResponse::createOkResponse(const std::string& body, const std::
     return response;
 }
 
+HttpResponse HttpResponse::createOkResponse(const SharedBuffer& body, const std::string& content_type) {
+    HttpResponse response;
+    response.setStatusCode(200);
+    response.setContentType(content_type);
+    response.setBody(body);
+    response.setConnection(false);
+    return response;
+}
+
 HttpResponse HttpResponse::createHeadResponse(const std::string& content_type, size_t content_length) {
     (void)content_length;  // Silence unused parameter warning
     HttpResponse response;
@@ -257,16 +746,37 @@ HttpResponse HttpResponse::createRedirectResponse(const std::string& redirect_in
     response.setStatusCode(status_code);
     response.setHeader("Location", url);
     response.setContentType("text/html");
-    response.setBody("<html><body><h1>" + response.getStatusMessage(status_code) + "</h1><p>The document has moved <a href=\"" + url + "\">here</a>.</p></body></html>");
+    response.setBody(std::string("<html><body><h1>") + getStatusMessage(status_code) + "</h1><p>The document has moved <a href=\"" + url + "\">here</a>.</p></body></html>");
+    response.setConnection(false);
+    return response;
+}
+
+/*
+ * Generic HTML response for any status code without a dedicated factory
+ */
+HttpResponse HttpResponse::createStatusResponse(int status_code) {
+    HttpResponse response;
+    response.setStatusCode(status_code);
+    response.setContentType("text/html");
+    std::ostringstream body;
+    body << "<html><body><h1>" << status_code << " " << getStatusMessage(status_code) << "</h1></body></html>";
+    response.setBody(body.str());
     response.setConnection(false);
     return response;
 }
 
 void HttpResponse::clear() {
     _status_code = 200;
-    _status_message = "OK";
     _version = "HTTP/1.1";
-    _headers.clear();
+    for (int slot = 0; slot < HEADER_SLOT_COUNT; ++slot) {
+        _slot_values[slot].clear();
+    }
+    _slot_mask = 0;
+    _extra_headers.clear();
     _body.clear();
     _is_head_response = false;
+    _is_chunked = false;
+    _is_prepared = false;
+    _prepared_head = SharedBuffer();
+    _shared_body.clear();
 }
\ No newline at end of file
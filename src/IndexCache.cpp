@@ -0,0 +1,75 @@
+#include "IndexCache.hpp"
+
+/*
+ * Default constructor for IndexCache
+ * Starts with no resolved directories
+ */
+IndexCache::IndexCache() {}
+
+/*
+ * Destructor for IndexCache
+ */
+IndexCache::~IndexCache() {}
+
+/*
+ * Builds the key of a directory probed with a given index list
+ * Locations with different index lists get separate entries
+ */
+std::string IndexCache::makeKey(const std::string& dir_path, const std::vector<std::string>& index_files) {
+    std::string key = dir_path;
+    while (key.length() > 1 && key[key.length() - 1] == '/') {
+        key.erase(key.length() - 1);
+    }
+    for (size_t i = 0; i < index_files.size(); ++i) {
+        key += '\0';
+        key += index_files[i];
+    }
+    return key;
+}
+
+/*
+ * Checks whether a cached resolution still describes the directory
+ */
+bool IndexCache::matches(const Entry& entry, const struct stat& dir_st) {
+    return entry.device == dir_st.st_dev && entry.inode == dir_st.st_ino &&
+           entry.mtime == dir_st.st_mtime && entry.mtime_nsec == dir_st.st_mtim.tv_nsec;
+}
+
+/*
+ * Returns the cached index file name of a directory described by dir_st
+ * index_name is left empty when the directory is known to have none
+ * Returns false if the directory must be probed
+ */
+bool IndexCache::lookup(const std::string& dir_path, const struct stat& dir_st,
+                        const std::vector<std::string>& index_files, std::string& index_name) const {
+    std::map<std::string, Entry>::const_iterator it = _entries.find(makeKey(dir_path, index_files));
+    if (it == _entries.end() || !matches(it->second, dir_st)) {
+        return false;
+    }
+    index_name = it->second.index_name;
+    return true;
+}
+
+/*
+ * Records the result of probing a directory, empty index_name for none
+ */
+void IndexCache::store(const std::string& dir_path, const struct stat& dir_st,
+                       const std::vector<std::string>& index_files, const std::string& index_name) {
+    std::string key = makeKey(dir_path, index_files);
+    if (_entries.size() >= MAX_ENTRIES && _entries.find(key) == _entries.end()) {
+        _entries.erase(_entries.begin());
+    }
+    Entry& entry = _entries[key];
+    entry.index_name = index_name;
+    entry.device = dir_st.st_dev;
+    entry.inode = dir_st.st_ino;
+    entry.mtime = dir_st.st_mtime;
+    entry.mtime_nsec = dir_st.st_mtim.tv_nsec;
+}
+
+/*
+ * Removes every cached resolution
+ */
+void IndexCache::clear() {
+    _entries.clear();
+}
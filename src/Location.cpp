@@ -5,7 +5,10 @@
  * Default constructor for Location
  * Initializes with autoindex disabled by default
  */
-Location::Location() : _autoindex(false) {}
+Location::Location() : _match_type(MATCH_PREFIX), _autoindex(false),
+      _autoindex_format(AUTOINDEX_HTML), _autoindex_sort(false),
+      _preload(false), _preload_max_size(DEFAULT_PRELOAD_MAX_SIZE), _upload_fsync(UPLOAD_FSYNC_OFF),
+      _cgi_pool_size(0), _cgi_pool_idle(0) {}
 
 /*
  * Destructor for Location
@@ -22,6 +25,22 @@ const std::string& Location::getPath() const {
     return _path;
 }
 
+/*
+ * Returns how the path of this location is matched against request URIs
+ * Used for ordering exact, prefix and regex locations
+ */
+Location::MatchType Location::getMatchType() const {
+    return _match_type;
+}
+
+/*
+ * Returns whether the path of this location is a regular expression
+ * Used for separating regex locations from the prefix trie
+ */
+bool Location::isRegex() const {
+    return _match_type == MATCH_REGEX || _match_type == MATCH_REGEX_CASELESS;
+}
+
 /*
  * Returns the list of allowed HTTP methods for this location
  * Used for validating incoming requests
@@ -46,6 +65,36 @@ bool Location::getAutoindex() const {
     return _autoindex;
 }
 
+/*
+ * Returns the output format of directory listings (HTML or JSON)
+ * Used for choosing the listing renderer and Content-Type
+ */
+Location::AutoindexFormat Location::getAutoindexFormat() const {
+    return _autoindex_format;
+}
+
+/*
+ * Returns whether directory listings are sorted by name
+ * Unsorted listings keep the order the file system returns
+ */
+bool Location::getAutoindexSort() const {
+    return _autoindex_sort;
+}
+
+/*
+ * Returns whether files under this location are loaded into memory at startup
+ */
+bool Location::getPreload() const {
+    return _preload;
+}
+
+/*
+ * Returns the largest file size, in bytes, eligible for preloading
+ */
+size_t Location::getPreloadMaxSize() const {
+    return _preload_max_size;
+}
+
 /*
  * Returns the list of index files to try when serving directories
  * Used for serving default files in directories
@@ -62,6 +111,13 @@ const std::string& Location::getUploadPath() const {
     return _upload_path;
 }
 
+/*
+ * Returns when uploaded files are flushed to disk
+ */
+Location::UploadFsync Location::getUploadFsync() const {
+    return _upload_fsync;
+}
+
 /*
  * Returns the map of CGI file extensions to their interpreter paths
  * Used for executing CGI scripts based on file extension
@@ -78,6 +134,37 @@ const std::string& Location::getRedirect() const {
     return _redirect;
 }
 
+/*
+ * Returns the path of the packed bundle serving this location, if any
+ * Used instead of the root for static files
+ */
+const std::string& Location::getBundle() const {
+    return _bundle;
+}
+
+/*
+ * Returns the FastCGI worker handling this location, if any
+ * "unix:/path" or "host:port"
+ */
+const std::string& Location::getFastcgiPass() const {
+    return _fastcgi_pass;
+}
+
+/*
+ * Returns how many CGI scripts of this location may run at once
+ * 0 without a cgi_pool: every request spawns its own
+ */
+size_t Location::getCgiPoolSize() const {
+    return _cgi_pool_size;
+}
+
+/*
+ * Returns how many CGI workers are kept started ahead of time
+ */
+size_t Location::getCgiPoolIdle() const {
+    return _cgi_pool_idle;
+}
+
 // Setters
 /*
  * Sets the URL path pattern for this location block
@@ -87,6 +174,14 @@ void Location::setPath(const std::string& path) {
     _path = path;
 }
 
+/*
+ * Sets the modifier given before the location path
+ * Used by the config parser for =, ^~, ~ and ~* locations
+ */
+void Location::setMatchType(MatchType match_type) {
+    _match_type = match_type;
+}
+
 /*
  * Sets the list of allowed HTTP methods for this location
  * Called during configuration parsing
@@ -111,6 +206,46 @@ void Location::setAutoindex(bool autoindex) {
     _autoindex = autoindex;
 }
 
+/*
+ * Sets the output format of directory listings
+ * Called when parsing autoindex_format
+ */
+void Location::setAutoindexFormat(AutoindexFormat format) {
+    _autoindex_format = format;
+}
+
+/*
+ * Sets whether directory listings are sorted by name
+ * Called when parsing autoindex_sort
+ */
+void Location::setAutoindexSort(bool sort) {
+    _autoindex_sort = sort;
+}
+
+/*
+ * Sets whether files under this location are preloaded
+ * Called when parsing preload
+ */
+void Location::setPreload(bool preload) {
+    _preload = preload;
+}
+
+/*
+ * Sets the largest file size eligible for preloading
+ * Called when parsing preload_max_size
+ */
+void Location::setPreloadMaxSize(size_t max_size) {
+    _preload_max_size = max_size;
+}
+
+/*
+ * Sets when uploaded files are flushed to disk
+ * Called when parsing upload_fsync
+ */
+void Location::setUploadFsync(UploadFsync upload_fsync) {
+    _upload_fsync = upload_fsync;
+}
+
 /*
  * Sets the list of index files to try when serving directories
  * Called during configuration parsing
@@ -143,6 +278,31 @@ void Location::setRedirect(const std::string& redirect) {
     _redirect = redirect;
 }
 
+/*
+ * Sets the packed bundle serving this location
+ * Called when parsing bundle
+ */
+void Location::setBundle(const std::string& bundle) {
+    _bundle = bundle;
+}
+
+/*
+ * Sets the FastCGI worker handling this location
+ * Called when parsing fastcgi_pass
+ */
+void Location::setFastcgiPass(const std::string& address) {
+    _fastcgi_pass = address;
+}
+
+/*
+ * Sets the size of the CGI worker pool and the idle workers it keeps
+ * Called when parsing cgi_pool
+ */
+void Location::setCgiPool(size_t size, size_t idle) {
+    _cgi_pool_size = size;
+    _cgi_pool_idle = idle;
+}
+
 /*
  * Adds a CGI extension mapping to the location
  * Called when parsing multiple CGI extension directives
@@ -156,7 +316,8 @@ void Location::addCgiExtension(const std::string& extension, const std::string&
  * Displays all configured values including methods, root, and CGI extensions
  */
 void Location::print() const {
-    std::cout << "    Location: " << _path << std::endl;
+    const char* modifiers[] = { "", "= ", "^~ ", "~ ", "~* " };
+    std::cout << "    Location: " << modifiers[_match_type] << _path << std::endl;
     std::cout << "      Methods: ";
     for (size_t i = 0; i < _methods.size(); ++i) {
         std::cout << _methods[i];
@@ -164,15 +325,30 @@ void Location::print() const {
     }
     std::cout << std::endl;
     std::cout << "      Root: " << _root << std::endl;
-    std::cout << "      Autoindex: " << (_autoindex ? "on" : "off") << std::endl;
+    std::cout << "      Autoindex: " << (_autoindex ? "on" : "off");
+    if (_autoindex)
+        std::cout << " (" << (_autoindex_format == AUTOINDEX_JSON ? "json" : "html")
+                  << (_autoindex_sort ? ", sorted" : "") << ")";
+    std::cout << std::endl;
+    if (_preload)
+        std::cout << "      Preload: on (max " << _preload_max_size << " bytes)" << std::endl;
     std::cout << "      Index files: ";
     for (size_t i = 0; i < _index_files.size(); ++i) {
         std::cout << _index_files[i];
         if (i < _index_files.size() - 1) std::cout << " ";
     }
     std::cout << std::endl;
-    if (!_upload_path.empty())
-        std::cout << "      Upload path: " << _upload_path << std::endl;
+    if (!_upload_path.empty()) {
+        const char* fsync_modes[] = { "off", "commit", "always" };
+        std::cout << "      Upload path: " << _upload_path
+                  << " (fsync " << fsync_modes[_upload_fsync] << ")" << std::endl;
+    }
+    if (!_bundle.empty())
+        std::cout << "      Bundle: " << _bundle << std::endl;
+    if (!_fastcgi_pass.empty())
+        std::cout << "      FastCGI pass: " << _fastcgi_pass << std::endl;
+    if (_cgi_pool_size > 0)
+        std::cout << "      CGI pool: size " << _cgi_pool_size << ", idle " << _cgi_pool_idle << std::endl;
     if (!_cgi_extensions.empty()) {
         std::cout << "      CGI extensions:" << std::endl;
         for (std::map<std::string, std::string>::const_iterator it = _cgi_extensions.begin(); 
@@ -0,0 +1,187 @@
+#include "LocationTrie.hpp"
+#include <cstring>
+
+/*
+ * Creates an empty trie node
+ */
+LocationTrie::Node::Node() : location(NULL) {}
+
+/*
+ * Frees the subtree below this node
+ */
+LocationTrie::Node::~Node() {
+    for (size_t i = 0; i < children.size(); ++i) {
+        delete children[i].child;
+    }
+}
+
+/*
+ * Creates an empty trie that matches nothing
+ */
+LocationTrie::LocationTrie() : _root(new Node()) {}
+
+/*
+ * Destructor for LocationTrie
+ */
+LocationTrie::~LocationTrie() {
+    delete _root;
+}
+
+/*
+ * Orders two segments bytewise, shorter first on a common prefix
+ * Used for keeping children sorted and for the lookup binary search
+ */
+int LocationTrie::compareSegment(const char* a, size_t a_length, const char* b, size_t b_length) {
+    size_t common = (a_length < b_length) ? a_length : b_length;
+    int result = std::memcmp(a, b, common);
+    if (result != 0) {
+        return result;
+    }
+    if (a_length == b_length) {
+        return 0;
+    }
+    return (a_length < b_length) ? -1 : 1;
+}
+
+/*
+ * Returns the child of node for one segment, creating it in sorted position
+ * Only used while building, before edges are compressed
+ */
+LocationTrie::Node* LocationTrie::insertSegment(Node* node, const char* segment, size_t length) {
+    std::vector<Edge>& children = node->children;
+    size_t low = 0;
+    size_t high = children.size();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = compareSegment(children[mid].label.data(), children[mid].first_length, segment, length);
+        if (order == 0) {
+            return children[mid].child;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    Edge edge;
+    edge.label.assign(segment, length);
+    edge.first_length = length;
+    edge.child = new Node();
+    children.insert(children.begin() + low, edge);
+    return edge.child;
+}
+
+/*
+ * Collapses chains of nodes that have no location and a single child
+ * Keeps the number of edges followed per lookup close to the number of
+ * locations on the path rather than the number of segments
+ */
+void LocationTrie::compress(Node* node) {
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        Edge& edge = node->children[i];
+        while (!edge.child->location && edge.child->children.size() == 1) {
+            Node* merged = edge.child;
+            Edge& next = merged->children[0];
+            edge.label += '/';
+            edge.label += next.label;
+            edge.child = next.child;
+            merged->children.clear();
+            delete merged;
+        }
+        compress(edge.child);
+    }
+}
+
+/*
+ * Builds the trie from a server block's prefix locations
+ * When two locations normalize to the same path the first one is kept
+ */
+void LocationTrie::build(const std::vector<Location>& locations) {
+    clear();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (locations[i].isRegex() || locations[i].getMatchType() == Location::MATCH_EXACT) {
+            continue;
+        }
+        const std::string& path = locations[i].getPath();
+        Node* node = _root;
+        size_t pos = 0;
+        while (pos < path.length()) {
+            size_t end = path.find('/', pos);
+            if (end == std::string::npos) {
+                end = path.length();
+            }
+            if (end > pos) {
+                node = insertSegment(node, path.data() + pos, end - pos);
+            }
+            pos = end + 1;
+        }
+        if (!node->location) {
+            node->location = &locations[i];
+        }
+    }
+    compress(_root);
+}
+
+/*
+ * Returns the longest location matching uri on a segment boundary
+ * Returns NULL if no location matches; does not allocate
+ */
+const Location* LocationTrie::match(const std::string& uri) const {
+    const Node* node = _root;
+    const Location* best = node->location;
+    const char* data = uri.data();
+    size_t length = uri.length();
+    size_t pos = (length > 0 && data[0] == '/') ? 1 : 0;
+
+    while (pos < length) {
+        const char* slash = static_cast<const char*>(std::memchr(data + pos, '/', length - pos));
+        size_t segment_length = slash ? static_cast<size_t>(slash - (data + pos)) : length - pos;
+
+        // Binary search the children by the first segment of their label
+        const Edge* found = NULL;
+        size_t low = 0;
+        size_t high = node->children.size();
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            const Edge& edge = node->children[mid];
+            int order = compareSegment(edge.label.data(), edge.first_length, data + pos, segment_length);
+            if (order == 0) {
+                found = &edge;
+                break;
+            }
+            if (order < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (!found) {
+            break;
+        }
+
+        // A collapsed edge must match completely and end on a boundary
+        size_t label_length = found->label.length();
+        if (label_length > length - pos ||
+            std::memcmp(found->label.data(), data + pos, label_length) != 0 ||
+            (pos + label_length < length && data[pos + label_length] != '/')) {
+            break;
+        }
+
+        node = found->child;
+        pos += label_length + 1;
+        if (node->location) {
+            best = node->location;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Removes every location from the trie
+ */
+void LocationTrie::clear() {
+    delete _root;
+    _root = new Node();
+}
@@ -0,0 +1,131 @@
+#include "MimeTypes.hpp"
+#include <cctype>
+#include <cstring>
+
+/*
+ * Creates a table holding only the built-in defaults
+ */
+MimeTypes::MimeTypes() {
+    build(std::map<std::string, std::string>());
+}
+
+/*
+ * Destructor for MimeTypes
+ */
+MimeTypes::~MimeTypes() {}
+
+/*
+ * Returns the FNV-1a hash of a lowercase extension
+ */
+size_t MimeTypes::hashExtension(const char* extension, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(extension[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Returns the index of type in _types, adding it if needed
+ * Keeps one copy of types shared by many extensions
+ */
+size_t MimeTypes::internType(const std::string& type) {
+    for (size_t i = 0; i < _types.size(); ++i) {
+        if (_types[i] == type) {
+            return i;
+        }
+    }
+    _types.push_back(type);
+    return _types.size() - 1;
+}
+
+/*
+ * Builds the table from the built-in defaults and configured mappings
+ * Configured mappings (lowercase extension -> type) override the defaults
+ */
+void MimeTypes::build(const std::map<std::string, std::string>& configured) {
+    static const char* defaults[][2] = {
+        { "html", "text/html" },
+        { "htm", "text/html" },
+        { "css", "text/css" },
+        { "js", "application/javascript" },
+        { "png", "image/png" },
+        { "jpg", "image/jpeg" },
+        { "jpeg", "image/jpeg" },
+        { "gif", "image/gif" },
+        { "txt", "text/plain" },
+        { "json", "application/json" },
+        { "xml", "application/xml" }
+    };
+
+    std::map<std::string, std::string> mappings;
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+        mappings[defaults[i][0]] = defaults[i][1];
+    }
+    for (std::map<std::string, std::string>::const_iterator it = configured.begin();
+         it != configured.end(); ++it) {
+        mappings[it->first] = it->second;
+    }
+
+    size_t bucket_count = 16;
+    while (bucket_count < mappings.size() * 2) {
+        bucket_count *= 2;
+    }
+    _types.clear();
+    _buckets.clear();
+    _buckets.resize(bucket_count);
+
+    for (std::map<std::string, std::string>::const_iterator it = mappings.begin();
+         it != mappings.end(); ++it) {
+        if (it->first.empty() || it->first.length() > MAX_EXTENSION_LENGTH) {
+            continue;
+        }
+        Entry entry;
+        entry.extension = it->first;
+        entry.hash = hashExtension(it->first.data(), it->first.length());
+        entry.type = internType(it->second);
+        _buckets[entry.hash & (bucket_count - 1)].push_back(entry);
+    }
+}
+
+/*
+ * Returns the Content-Type for a file path based on its extension
+ * Files without an extension are text/plain, unknown ones octet-stream
+ */
+const std::string& MimeTypes::lookup(const std::string& path) const {
+    static const std::string text_plain = "text/plain";
+
+    size_t dot_pos = path.find_last_of("./");
+    if (dot_pos == std::string::npos || path[dot_pos] != '.') {
+        return text_plain;  // Default for files without extension
+    }
+
+    size_t length = path.length() - dot_pos - 1;
+    if (length == 0 || length > MAX_EXTENSION_LENGTH || _buckets.empty()) {
+        return defaultType();
+    }
+
+    char extension[MAX_EXTENSION_LENGTH];
+    for (size_t i = 0; i < length; ++i) {
+        extension[i] = std::tolower(static_cast<unsigned char>(path[dot_pos + 1 + i]));
+    }
+
+    size_t hash = hashExtension(extension, length);
+    const std::vector<Entry>& bucket = _buckets[hash & (_buckets.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].hash == hash && bucket[i].extension.length() == length &&
+            std::memcmp(bucket[i].extension.data(), extension, length) == 0) {
+            return _types[bucket[i].type];
+        }
+    }
+    return defaultType();
+}
+
+/*
+ * Returns the type used for unknown extensions
+ */
+const std::string& MimeTypes::defaultType() {
+    static const std::string octet_stream = "application/octet-stream";
+    return octet_stream;
+}
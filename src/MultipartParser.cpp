@@ -0,0 +1,300 @@
+#include "MultipartParser.hpp"
+#include <cctype>
+#include <cstring>
+
+/*
+ * Default constructor for MultipartParser
+ * Fails every feed until setBoundary() succeeds
+ */
+MultipartParser::MultipartParser() : _state(FAILED) {
+    for (size_t i = 0; i < 256; ++i) {
+        _skip[i] = 1;
+    }
+}
+
+/*
+ * Destructor for MultipartParser
+ */
+MultipartParser::~MultipartParser() {}
+
+/*
+ * Sets the boundary and builds the Horspool shift table for its delimiter
+ * The body is treated as if it started with CRLF, so the first delimiter
+ * is found by the same search as the others
+ */
+bool MultipartParser::setBoundary(const std::string& boundary) {
+    if (boundary.empty() || boundary.length() > MAX_BOUNDARY_LENGTH) {
+        _state = FAILED;
+        return false;
+    }
+    _delimiter = "\r\n--" + boundary;
+    size_t length = _delimiter.length();
+    for (size_t i = 0; i < 256; ++i) {
+        _skip[i] = length;
+    }
+    for (size_t i = 0; i + 1 < length; ++i) {
+        _skip[static_cast<unsigned char>(_delimiter[i])] = length - 1 - i;
+    }
+    _buffer = "\r\n";
+    _state = PREAMBLE;
+    return true;
+}
+
+/*
+ * Returns the offset of the first delimiter in data, or size if none
+ */
+size_t MultipartParser::findDelimiter(const char* data, size_t size) const {
+    size_t length = _delimiter.length();
+    const char* pattern = _delimiter.data();
+    size_t position = 0;
+    while (position + length <= size) {
+        unsigned char last = static_cast<unsigned char>(data[position + length - 1]);
+        if (last == static_cast<unsigned char>(pattern[length - 1]) &&
+            std::memcmp(data + position, pattern, length - 1) == 0) {
+            return position;
+        }
+        position += _skip[last];
+    }
+    return size;
+}
+
+/*
+ * Splits a part's header block into lowercase names and trimmed values
+ */
+bool MultipartParser::parseHeaders(const std::string& block, std::map<std::string, std::string>& headers) const {
+    size_t start = 0;
+    while (start < block.length()) {
+        size_t end = block.find("\r\n", start);
+        if (end == std::string::npos) {
+            end = block.length();
+        }
+        std::string line = block.substr(start, end - start);
+        start = end + 2;
+        if (line.empty()) {
+            continue;
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            return false;
+        }
+        std::string name = line.substr(0, colon);
+        for (size_t i = 0; i < name.length(); ++i) {
+            name[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+        }
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        size_t value_end = line.find_last_not_of(" \t");
+        headers[name] = (value_start == std::string::npos) ? "" : line.substr(value_start, value_end - value_start + 1);
+    }
+    return true;
+}
+
+/*
+ * Advances the state machine over the buffered bytes from offset
+ * Returns false when more input is needed before progress can be made
+ */
+bool MultipartParser::step(MultipartHandler& handler, size_t& offset) {
+    const char* data = _buffer.data() + offset;
+    size_t size = _buffer.size() - offset;
+
+    switch (_state) {
+        case PREAMBLE: {
+            size_t found = findDelimiter(data, size);
+            if (found == size) {
+                // Keep only what could still be the start of a delimiter
+                if (size >= _delimiter.length()) {
+                    offset += size - (_delimiter.length() - 1);
+                }
+                return false;
+            }
+            offset += found + _delimiter.length();
+            _state = AFTER_DELIMITER;
+            return true;
+        }
+        case AFTER_DELIMITER: {
+            // "--" closes the body; otherwise optional padding then CRLF
+            if (size >= 2 && data[0] == '-' && data[1] == '-') {
+                offset = _buffer.size();
+                _state = DONE;
+                return true;
+            }
+            size_t position = 0;
+            while (position < size && (data[position] == ' ' || data[position] == '\t')) {
+                ++position;
+            }
+            if (position + 2 > size) {
+                if (size > MAX_BOUNDARY_LENGTH) {
+                    _state = FAILED;
+                }
+                return false;
+            }
+            if (data[position] != '\r' || data[position + 1] != '\n') {
+                _state = FAILED;
+                return false;
+            }
+            offset += position + 2;
+            _state = HEADERS;
+            return true;
+        }
+        case HEADERS: {
+            size_t end = 0;
+            size_t skip = 0;
+            if (size >= 2 && data[0] == '\r' && data[1] == '\n') {
+                skip = 2;                          // part without headers
+            } else {
+                const char* found = NULL;
+                for (size_t i = 0; i + 4 <= size && !found; ++i) {
+                    if (data[i] == '\r' && std::memcmp(data + i, "\r\n\r\n", 4) == 0) {
+                        found = data + i;
+                    }
+                }
+                if (!found) {
+                    if (size > MAX_HEADER_SIZE) {
+                        _state = FAILED;
+                    }
+                    return false;
+                }
+                end = found - data;
+                skip = end + 4;
+            }
+            std::map<std::string, std::string> headers;
+            if (!parseHeaders(std::string(data, end), headers) || !handler.onPartBegin(headers)) {
+                _state = FAILED;
+                return false;
+            }
+            offset += skip;
+            _state = BODY;
+            return true;
+        }
+        case BODY: {
+            size_t found = findDelimiter(data, size);
+            if (found == size) {
+                // Everything but a possible partial delimiter is part content
+                if (size >= _delimiter.length()) {
+                    size_t safe = size - (_delimiter.length() - 1);
+                    if (!handler.onPartData(data, safe)) {
+                        _state = FAILED;
+                        return false;
+                    }
+                    offset += safe;
+                }
+                return false;
+            }
+            if ((found > 0 && !handler.onPartData(data, found)) || !handler.onPartEnd()) {
+                _state = FAILED;
+                return false;
+            }
+            offset += found + _delimiter.length();
+            _state = AFTER_DELIMITER;
+            return true;
+        }
+        case DONE:
+            offset = _buffer.size();              // epilogue is ignored
+            return false;
+        case FAILED:
+            return false;
+    }
+    return false;
+}
+
+/*
+ * Consumes the next bytes of the body
+ * Returns false once the body is found to be malformed or a handler
+ * callback refuses a part
+ */
+bool MultipartParser::feed(const char* data, size_t size, MultipartHandler& handler) {
+    if (_state == FAILED) {
+        return false;
+    }
+    if (_state == DONE) {
+        return true;
+    }
+    _buffer.append(data, size);
+    size_t offset = 0;
+    while (step(handler, offset)) {
+    }
+    _buffer.erase(0, offset);
+    return _state != FAILED;
+}
+
+/*
+ * Returns whether the closing delimiter has been seen
+ */
+bool MultipartParser::isDone() const {
+    return _state == DONE;
+}
+
+/*
+ * Returns whether the body was rejected
+ */
+bool MultipartParser::hasFailed() const {
+    return _state == FAILED;
+}
+
+/*
+ * Extracts the boundary parameter of a multipart Content-Type
+ * Returns an empty string if the type is not multipart/form-data
+ */
+std::string MultipartParser::boundaryFromContentType(const std::string& content_type) {
+    std::string lowered = content_type;
+    for (size_t i = 0; i < lowered.length(); ++i) {
+        lowered[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(lowered[i])));
+    }
+    if (lowered.compare(0, 19, "multipart/form-data") != 0) {
+        return "";
+    }
+    return headerParameter(content_type, "boundary");
+}
+
+/*
+ * Returns the value of a `name=value` parameter of a header value,
+ * unquoted, e.g. the filename of a Content-Disposition
+ * found, if given, tells an empty value from a missing parameter
+ */
+std::string MultipartParser::headerParameter(const std::string& value, const std::string& name, bool* found) {
+    if (found) {
+        *found = false;
+    }
+    size_t position = value.find(';');
+    while (position != std::string::npos) {
+        size_t start = value.find_first_not_of(" \t", position + 1);
+        if (start == std::string::npos) {
+            break;
+        }
+        size_t equals = value.find('=', start);
+        if (equals == std::string::npos) {
+            break;
+        }
+        std::string key = value.substr(start, equals - start);
+        size_t key_end = key.find_last_not_of(" \t");
+        key = (key_end == std::string::npos) ? "" : key.substr(0, key_end + 1);
+        for (size_t i = 0; i < key.length(); ++i) {
+            key[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(key[i])));
+        }
+
+        std::string parameter;
+        size_t next;
+        if (equals + 1 < value.length() && value[equals + 1] == '"') {
+            size_t i = equals + 2;
+            while (i < value.length() && value[i] != '"') {
+                if (value[i] == '\\' && i + 1 < value.length()) {
+                    ++i;
+                }
+                parameter += value[i++];
+            }
+            next = value.find(';', i);
+        } else {
+            next = value.find(';', equals + 1);
+            parameter = value.substr(equals + 1, (next == std::string::npos ? value.length() : next) - equals - 1);
+            size_t end = parameter.find_last_not_of(" \t");
+            parameter = (end == std::string::npos) ? "" : parameter.substr(0, end + 1);
+        }
+        if (key == name) {
+            if (found) {
+                *found = true;
+            }
+            return parameter;
+        }
+        position = next;
+    }
+    return "";
+}
@@ -0,0 +1,349 @@
+#include "MultipartUpload.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+
+unsigned long MultipartUpload::_serial = 0;
+
+/*
+ * Constructor for MultipartUpload
+ * A boundary the parser rejects, or a malformed digest header, makes the
+ * upload fail with 400
+ */
+MultipartUpload::MultipartUpload(const std::string& upload_path, const std::string& boundary, bool html_summary,
+                                 Location::UploadFsync fsync, const ExpectedDigest& expected)
+    : _upload_path(upload_path), _html_summary(html_summary), _fsync(fsync), _expected(expected),
+      _body_hash(expected.wantsMd5()), _fields_size(0), _error_code(0), _fd(-1), _in_field(false) {
+    _current.size = 0;
+    if (!_expected.isValid() || !_parser.setBoundary(boundary)) {
+        _error_code = 400;
+    }
+}
+
+/*
+ * Destructor for MultipartUpload
+ * Removes a part left half-written; finished parts stay stored
+ */
+MultipartUpload::~MultipartUpload() {
+    discardCurrent();
+}
+
+/*
+ * Reduces a client supplied filename to a safe name inside upload_path
+ * Drops any directory components and control characters; returns an
+ * empty string if nothing usable is left
+ */
+std::string MultipartUpload::sanitizeFilename(const std::string& filename) {
+    size_t slash = filename.find_last_of("/\\");
+    std::string base = (slash == std::string::npos) ? filename : filename.substr(slash + 1);
+    std::string name;
+    for (size_t i = 0; i < base.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(base[i]);
+        if (c >= 0x20 && c != 0x7f) {
+            name += base[i];
+        }
+    }
+    if (name == "." || name == "..") {
+        return "";
+    }
+    return name;
+}
+
+/*
+ * Returns text with the HTML special characters escaped
+ */
+std::string MultipartUpload::escapeHtml(const std::string& text) {
+    std::string escaped;
+    for (size_t i = 0; i < text.length(); ++i) {
+        switch (text[i]) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += text[i]; break;
+        }
+    }
+    return escaped;
+}
+
+/*
+ * Appends text as a quoted JSON string
+ */
+void MultipartUpload::appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+/*
+ * Closes and removes the temporary file of the current part, if any
+ */
+void MultipartUpload::discardCurrent() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+        unlink(_temp_path.c_str());
+    }
+}
+
+/*
+ * Opens the temporary file for a part that carries a filename, or starts
+ * collecting the value of a plain form field
+ */
+bool MultipartUpload::onPartBegin(const std::map<std::string, std::string>& headers) {
+    _in_field = false;
+    std::map<std::string, std::string>::const_iterator disposition = headers.find("content-disposition");
+    if (disposition == headers.end()) {
+        return true;
+    }
+    std::string field = MultipartParser::headerParameter(disposition->second, "name");
+    bool has_filename = false;
+    std::string filename = MultipartParser::headerParameter(disposition->second, "filename", &has_filename);
+    if (filename.empty()) {
+        if (has_filename || field.empty()) {
+            return true;    // a file input left empty, or a part nobody can refer to
+        }
+        if (_fields.size() >= MAX_FIELDS || _fields_size + field.length() > MAX_FIELDS_SIZE) {
+            _error_code = 413;
+            return false;
+        }
+        _fields.push_back(std::make_pair(field, std::string()));
+        _fields_size += field.length();
+        _in_field = true;
+        return true;
+    }
+
+    std::ostringstream serial;
+    serial << ++_serial;
+    _current.name = sanitizeFilename(filename);
+    if (_current.name.empty()) {
+        _current.name = "upload_" + serial.str() + ".bin";
+    }
+    _current.field = field;
+    _current.path = _upload_path + "/" + _current.name;
+    _current.size = 0;
+    _current_hash.reset(false);
+    _temp_path = _upload_path + "/." + _current.name + ".upload-" + serial.str();
+
+    _fd = open(_temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        std::cerr << "Error: cannot create " << _temp_path << std::endl;
+        _error_code = 500;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Appends part content to the current file and its hashes
+ */
+bool MultipartUpload::onPartData(const char* data, size_t size) {
+    if (_in_field) {
+        if (_fields_size + size > MAX_FIELDS_SIZE) {
+            _error_code = 413;
+            return false;
+        }
+        _fields.back().second.append(data, size);
+        _fields_size += size;
+        return true;
+    }
+    if (_fd < 0) {
+        return true;
+    }
+    _current_hash.update(data, size);
+    while (size > 0) {
+        ssize_t written = ::write(_fd, data, size);
+        if (written <= 0) {
+            std::cerr << "Error: cannot write " << _temp_path << std::endl;
+            _error_code = 500;
+            discardCurrent();
+            return false;
+        }
+        data += written;
+        size -= written;
+        _current.size += written;
+    }
+    return true;
+}
+
+/*
+ * Moves a completed part to its final name, flushing it first unless
+ * upload_fsync is off
+ */
+bool MultipartUpload::onPartEnd() {
+    _in_field = false;
+    if (_fd < 0) {
+        return true;
+    }
+    bool synced = _fsync == Location::UPLOAD_FSYNC_OFF || fdatasync(_fd) == 0;
+    int result = close(_fd);
+    _fd = -1;
+    if (!synced || result != 0 || std::rename(_temp_path.c_str(), _current.path.c_str()) != 0) {
+        std::cerr << "Error: cannot store " << _current.path << std::endl;
+        unlink(_temp_path.c_str());
+        _error_code = 500;
+        return false;
+    }
+    _current_hash.finish();
+    _current.sha256 = _current_hash.sha256Hex();
+    _current.crc32c = _current_hash.crc32cHex();
+    _files.push_back(_current);
+    return true;
+}
+
+/*
+ * Feeds the next body bytes to the parser
+ */
+bool MultipartUpload::write(const char* data, size_t size) {
+    if (_error_code != 0) {
+        return false;
+    }
+    if (!_expected.isEmpty()) {
+        _body_hash.update(data, size);
+    }
+    if (!_parser.feed(data, size, *this)) {
+        if (_error_code == 0) {
+            _error_code = 400;
+        }
+        discardCurrent();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Checks that the body ended with the closing delimiter, carried at
+ * least one file or field and matches the digest the client sent
+ */
+bool MultipartUpload::finish() {
+    if (_error_code != 0) {
+        return false;
+    }
+    if (!_parser.isDone() || (_files.empty() && _fields.empty())) {
+        _error_code = 400;
+        abort();
+        return false;
+    }
+    if (!_expected.isEmpty()) {
+        _body_hash.finish();
+        if (!_expected.matches(_body_hash)) {
+            std::cerr << "Error: multipart body does not match its digest" << std::endl;
+            _error_code = 400;
+            abort();
+            return false;
+        }
+    }
+    if (_fsync != Location::UPLOAD_FSYNC_OFF && !_files.empty() && !syncDirectory(_files[0].path)) {
+        _error_code = 500;
+        abort();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Removes everything this request stored
+ * Used when the body turns out to be incomplete or malformed
+ */
+void MultipartUpload::abort() {
+    discardCurrent();
+    for (size_t i = 0; i < _files.size(); ++i) {
+        unlink(_files[i].path.c_str());
+    }
+    _files.clear();
+    _fields.clear();
+}
+
+/*
+ * Returns the status code to answer a failed upload with
+ */
+int MultipartUpload::getErrorCode() const {
+    return _error_code;
+}
+
+/*
+ * Returns the summary of the upload, as a page for browsers or as JSON
+ */
+HttpResponse MultipartUpload::buildResponse() const {
+    return _html_summary ? buildHtmlResponse() : buildJsonResponse();
+}
+
+/*
+ * Returns the success page listing every stored file
+ */
+HttpResponse MultipartUpload::buildHtmlResponse() const {
+    std::string response_body = "<!DOCTYPE html><html><head><title>Upload Success</title></head><body>";
+    response_body += "<h1>File Upload Successful</h1>";
+    for (size_t i = 0; i < _files.size(); ++i) {
+        std::ostringstream size_stream;
+        size_stream << _files[i].size;
+        response_body += "<p>File saved as: " + escapeHtml(_files[i].name) + "</p>";
+        response_body += "<p>Size: " + size_stream.str() + " bytes</p>";
+        response_body += "<p>SHA-256: " + _files[i].sha256 + "</p>";
+    }
+    response_body += "<p><a href=\"/upload/\">View Uploaded Files</a></p>";
+    response_body += "<p><a href=\"/\">Back to Home</a></p>";
+    response_body += "</body></html>";
+    return HttpResponse::createOkResponse(response_body, "text/html");
+}
+
+/*
+ * Returns the stored files with their sizes and digests and the form
+ * fields as JSON
+ */
+HttpResponse MultipartUpload::buildJsonResponse() const {
+    std::string body = "{\"files\":[";
+    size_t total_size = 0;
+    for (size_t i = 0; i < _files.size(); ++i) {
+        std::ostringstream size_stream;
+        size_stream << _files[i].size;
+        body += (i == 0) ? "\n{\"field\":" : ",\n{\"field\":";
+        appendJsonString(body, _files[i].field);
+        body += ",\"name\":";
+        appendJsonString(body, _files[i].name);
+        body += ",\"size\":" + size_stream.str();
+        body += ",\"sha256\":\"" + _files[i].sha256 + "\",\"crc32c\":\"" + _files[i].crc32c + "\"}";
+        total_size += _files[i].size;
+    }
+    body += "\n],\"fields\":[";
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        body += (i == 0) ? "\n{\"name\":" : ",\n{\"name\":";
+        appendJsonString(body, _fields[i].first);
+        body += ",\"value\":";
+        appendJsonString(body, _fields[i].second);
+        body += "}";
+    }
+    std::ostringstream total_stream;
+    total_stream << total_size;
+    body += "\n],\"total_size\":" + total_stream.str() + "}\n";
+    return HttpResponse::createOkResponse(body, "application/json");
+}
+
+/*
+ * Returns the files stored so far
+ */
+const std::vector<MultipartUpload::StoredFile>& MultipartUpload::getFiles() const {
+    return _files;
+}
+
+/*
+ * Returns the form fields collected so far, in the order they were sent
+ */
+const std::vector<std::pair<std::string, std::string> >& MultipartUpload::getFields() const {
+    return _fields;
+}
@@ -0,0 +1,68 @@
+#include "NegativeCache.hpp"
+#include "ServerClock.hpp"
+
+/*
+ * Default constructor for NegativeCache
+ * Starts with no remembered misses
+ */
+NegativeCache::NegativeCache() {}
+
+/*
+ * Destructor for NegativeCache
+ */
+NegativeCache::~NegativeCache() {}
+
+/*
+ * Returns whether path is known not to exist
+ * Expired entries are dropped on the way
+ */
+bool NegativeCache::contains(const std::string& path) {
+    if (_entries.empty()) {
+        return false;
+    }
+    std::map<std::string, time_t>::iterator it = _entries.find(path);
+    if (it == _entries.end()) {
+        return false;
+    }
+    if (it->second != 0 && it->second <= ServerClock::now()) {
+        _entries.erase(it);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Remembers that path does not exist
+ * Watched paths need no expiry, the watcher reports their creation
+ */
+void NegativeCache::store(const std::string& path, bool watched) {
+    if (_entries.size() >= MAX_ENTRIES && _entries.find(path) == _entries.end()) {
+        _entries.erase(_entries.begin());
+    }
+    _entries[path] = watched ? 0 : ServerClock::now() + TTL_SECONDS;
+}
+
+/*
+ * Forgets path, which may have just been created
+ */
+void NegativeCache::invalidate(const std::string& path) {
+    _entries.erase(path);
+}
+
+/*
+ * Forgets every path below dir, which may have just been created or moved in
+ */
+void NegativeCache::invalidateTree(const std::string& dir) {
+    std::string prefix = dir + "/";
+    std::map<std::string, time_t>::iterator it = _entries.lower_bound(prefix);
+    while (it != _entries.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        _entries.erase(it++);
+    }
+}
+
+/*
+ * Forgets every remembered miss
+ */
+void NegativeCache::clear() {
+    _entries.clear();
+}
@@ -0,0 +1,251 @@
+#include "PreloadCache.hpp"
+#include "ServerContext.hpp"
+#include "FileWatcher.hpp"
+#include <iostream>
+#include <fstream>
+#include <utility>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*
+ * Default constructor for PreloadCache
+ * Holds nothing until build() runs
+ */
+PreloadCache::PreloadCache() {}
+
+/*
+ * Destructor for PreloadCache
+ * Queued responses keep their slices of the arena alive on their own
+ */
+PreloadCache::~PreloadCache() {}
+
+/*
+ * Reads exactly size bytes of a file into out
+ * Returns false if the file cannot be opened or has shrunk
+ */
+bool PreloadCache::readInto(const std::string& path, char* out, size_t size) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    if (size > 0) {
+        file.read(out, size);
+        if (static_cast<size_t>(file.gcount()) != size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns whether name would be run as a CGI script by location
+ */
+bool PreloadCache::isCgiFile(const Location& location, const std::string& name) {
+    size_t dot_pos = name.find_last_of('.');
+    if (dot_pos == std::string::npos) {
+        return false;
+    }
+    const std::map<std::string, std::string>& cgi_extensions = location.getCgiExtensions();
+    return cgi_extensions.find(name.substr(dot_pos)) != cgi_extensions.end();
+}
+
+/*
+ * Appends a path segment to a URI that may or may not end in a slash
+ */
+std::string PreloadCache::joinUri(const std::string& base, const std::string& name) {
+    if (!base.empty() && base[base.length() - 1] == '/') {
+        return base + name;
+    }
+    return base + "/" + name;
+}
+
+/*
+ * Walks the files a location serves and records those worth preloading
+ * A file qualifies if it fits preload_max_size and the remaining budget,
+ * is not a CGI script, and requests for it are routed to this location
+ */
+void PreloadCache::collect(const Location& location, ServerContext& context,
+                           std::vector<Candidate>& candidates, size_t& total_size) {
+    std::string base_uri = location.getPath();
+    if (base_uri.length() > 1 && base_uri[base_uri.length() - 1] == '/') {
+        base_uri.erase(base_uri.length() - 1);
+    }
+    std::string base_path = FileWatcher::normalize(location.getRoot());
+    if (base_uri != "/") {
+        base_path += base_uri;
+    }
+
+    std::vector<std::pair<std::string, std::string> > pending;   // directory, URI
+    struct stat st;
+    if (stat(base_path.c_str(), &st) != 0) {
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        pending.push_back(std::make_pair(base_path, base_uri));
+    }
+
+    for (size_t i = 0; i < pending.size() && pending.size() <= MAX_FILES; ++i) {
+        const std::string dir_path = pending[i].first;
+        const std::string dir_uri = pending[i].second;
+        DIR* dir = opendir(dir_path.c_str());
+        if (!dir) {
+            continue;
+        }
+
+        std::map<std::string, size_t> files;   // name -> candidate index, this directory only
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL && candidates.size() < MAX_FILES) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string path = dir_path + "/" + name;
+            std::string uri = joinUri(dir_uri, name);
+            if (stat(path.c_str(), &st) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                if (entry->d_type == DT_DIR) {   // do not follow directory symlinks
+                    pending.push_back(std::make_pair(path, uri));
+                }
+                continue;
+            }
+            if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) > location.getPreloadMaxSize() ||
+                isCgiFile(location, name) || context.findLocation(uri) != &location) {
+                continue;
+            }
+            if (total_size + st.st_size > MAX_TOTAL_SIZE) {
+                std::cerr << "Warning: preload budget exhausted, " << path << " is served from disk" << std::endl;
+                continue;
+            }
+
+            Candidate candidate;
+            candidate.path = path;
+            candidate.uris.push_back(uri);
+            candidate.size = static_cast<size_t>(st.st_size);
+            candidate.offset = total_size;
+            total_size += candidate.size;
+            files[name] = candidates.size();
+            candidates.push_back(candidate);
+        }
+        closedir(dir);
+
+        // The directory itself is served by its first existing index file
+        const std::vector<std::string>& index_files = location.getIndexFiles();
+        for (size_t j = 0; j < index_files.size(); ++j) {
+            std::map<std::string, size_t>::const_iterator found = files.find(index_files[j]);
+            if (found != files.end()) {
+                Candidate& candidate = candidates[found->second];
+                std::string slash_uri = joinUri(dir_uri, "");
+                if (context.findLocation(slash_uri) == &location) {
+                    candidate.uris.push_back(slash_uri);
+                }
+                if (dir_uri != slash_uri && context.findLocation(dir_uri) == &location) {
+                    candidate.uris.push_back(dir_uri);
+                }
+                candidate.dirs.push_back(dir_path);
+                break;
+            }
+            if (stat((dir_path + "/" + index_files[j]).c_str(), &st) == 0) {
+                break;   // exists but was not preloaded, the regular path serves it
+            }
+        }
+    }
+}
+
+/*
+ * Loads every eligible file of the `preload on` locations into the arena
+ * and prepares a response for each URI that serves one of them
+ */
+void PreloadCache::build(const std::vector<Location>& locations, ServerContext& context) {
+    _responses.clear();
+    _uris_by_path.clear();
+    _arena = SharedBuffer();
+
+    std::vector<Candidate> candidates;
+    size_t total_size = 0;
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (locations[i].getPreload() && !locations[i].isRegex() && locations[i].getRedirect().empty()) {
+            collect(locations[i], context, candidates, total_size);
+        }
+    }
+    if (candidates.empty()) {
+        return;
+    }
+
+    std::string arena(total_size, '\0');
+    std::vector<bool> loaded(candidates.size(), false);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        loaded[i] = candidates[i].size == 0 ||
+                    readInto(candidates[i].path, &arena[candidates[i].offset], candidates[i].size);
+    }
+    _arena = SharedBuffer::adopt(arena);
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const Candidate& candidate = candidates[i];
+        if (!loaded[i]) {
+            continue;
+        }
+        HttpResponse response = HttpResponse::createOkResponse(
+            _arena.slice(candidate.offset, candidate.size), context.getMimeTypes().lookup(candidate.path));
+        response.prepare();
+
+        for (size_t j = 0; j < candidate.uris.size(); ++j) {
+            if (_responses.insert(std::make_pair(candidate.uris[j], response)).second) {
+                _uris_by_path.insert(std::make_pair(candidate.path, candidate.uris[j]));
+                for (size_t k = 0; k < candidate.dirs.size(); ++k) {
+                    _uris_by_path.insert(std::make_pair(candidate.dirs[k], candidate.uris[j]));
+                }
+            }
+        }
+    }
+    std::cout << "Preloaded " << _responses.size() << " URIs (" << total_size << " bytes)" << std::endl;
+}
+
+/*
+ * Returns the prepared response for uri, or NULL if it was not preloaded
+ */
+const HttpResponse* PreloadCache::find(const std::string& uri) const {
+    if (_responses.empty()) {
+        return NULL;
+    }
+    std::map<std::string, HttpResponse>::const_iterator it = _responses.find(uri);
+    return it != _responses.end() ? &it->second : NULL;
+}
+
+/*
+ * Drops every prepared response, for when changes may have been missed
+ * The arena stays mapped; responses already queued still refer to it
+ */
+void PreloadCache::clear() {
+    _responses.clear();
+    _uris_by_path.clear();
+}
+
+/*
+ * Drops the URIs served from a changed file, from a directory whose
+ * contents changed (its index file may have been replaced), and from
+ * anything below path when a whole directory moved
+ */
+void PreloadCache::invalidate(const std::string& path) {
+    if (_uris_by_path.empty()) {
+        return;
+    }
+    std::string prefix = path + "/";
+    std::multimap<std::string, std::string>::iterator it = _uris_by_path.lower_bound(path);
+    while (it != _uris_by_path.end() && it->first.compare(0, path.length(), path) == 0) {
+        if (it->first == path || it->first.compare(0, prefix.length(), prefix) == 0) {
+            _responses.erase(it->second);
+            _uris_by_path.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*
+ * Returns the number of preloaded URIs
+ */
+size_t PreloadCache::size() const {
+    return _responses.size();
+}
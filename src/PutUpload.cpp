@@ -0,0 +1,519 @@
+#include "PutUpload.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <fcntl.h>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/*
+ * Constructor for PutUpload
+ * Validates Content-Range and opens the part file; problems are kept in
+ * the error code and reported by the first write() or finish()
+ */
+PutUpload::PutUpload(const std::string& target_path, const std::string& content_range, size_t content_length,
+                     Location::UploadFsync fsync, const ExpectedDigest& expected)
+    : _target_path(target_path), _part_path(target_path + ".part"), _ranged(false), _status_query(false),
+      _start(0), _end(content_length), _total(content_length), _offset(0), _committed(0),
+      _complete(false), _created(true), _fsync(fsync), _fd(-1), _splice_refused(false), _error_code(0),
+      _expected(expected),
+      _hashing(false), _hashed(0) {
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+    struct stat st;
+    _created = stat(_target_path.c_str(), &st) != 0;
+    if (!_expected.isValid() ||
+        (!content_range.empty() && !parseContentRange(content_range, content_length))) {
+        if (_error_code == 0) {
+            _error_code = 400;
+        }
+        return;
+    }
+    // The body of a plain PUT is the whole file, one hash serves both
+    _file_hash.reset(!_ranged && _expected.wantsMd5());
+    _content_hash.reset(_expected.wantsMd5());
+    if (openPartFile()) {
+        _hashing = !_status_query && _total >= 0 && _end >= _total;
+    }
+}
+
+/*
+ * Destructor for PutUpload
+ * The part file is kept so the upload can be resumed
+ */
+PutUpload::~PutUpload() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    if (_pipe[0] >= 0) {
+        close(_pipe[0]);
+        close(_pipe[1]);
+    }
+}
+
+/*
+ * Parses a non-negative decimal offset
+ */
+bool PutUpload::parseOffset(const std::string& text, off_t& value) {
+    if (text.empty() || text.length() > 18) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    return true;
+}
+
+/*
+ * Parses a Content-Range of the form "bytes first-last/total"
+ * Either the range or the total may be "*": an unknown total, or a
+ * status query. The range must cover exactly the body and lie inside
+ * the total when it is known.
+ */
+bool PutUpload::parseContentRange(const std::string& value, size_t content_length) {
+    if (value.compare(0, 6, "bytes ") != 0) {
+        return false;
+    }
+    size_t slash = value.find('/', 6);
+    if (slash == std::string::npos) {
+        return false;
+    }
+    std::string range = value.substr(6, slash - 6);
+    std::string total = value.substr(slash + 1);
+    _ranged = true;
+    _total = -1;
+    if (total != "*" && !parseOffset(total, _total)) {
+        return false;
+    }
+
+    if (range == "*") {
+        _status_query = true;
+        return content_length == 0;
+    }
+    size_t dash = range.find('-');
+    off_t first;
+    off_t last;
+    if (dash == std::string::npos || !parseOffset(range.substr(0, dash), first) ||
+        !parseOffset(range.substr(dash + 1), last) || last < first ||
+        static_cast<size_t>(last - first + 1) != content_length) {
+        return false;
+    }
+    if (_total >= 0 && last >= _total) {
+        _error_code = 416;
+        return false;
+    }
+    _start = first;
+    _end = last + 1;
+    return true;
+}
+
+/*
+ * Opens and locks the part file and learns how much of it is committed
+ * A plain PUT starts over; a ranged one must not leave a gap before
+ * its first byte, or the committed length would be a lie. Another
+ * upload holding the lock, or one that renamed or removed the file
+ * while this one waited to open it, is answered with 409. The space
+ * still to come is reserved up front without changing the file size,
+ * which keeps the file contiguous and catches a full disk early.
+ */
+bool PutUpload::openPartFile() {
+    struct stat st;
+    bool has_part = stat(_part_path.c_str(), &st) == 0;
+    if (_status_query) {
+        if (has_part) {
+            _committed = st.st_size;
+        } else if (stat(_target_path.c_str(), &st) == 0 && (_total < 0 || st.st_size == _total)) {
+            _committed = st.st_size;
+            _complete = true;
+        }
+        return true;
+    }
+    // Checked before the part file is created, so a refused range does
+    // not leave an empty one behind to look like an upload in progress
+    if (_ranged && _start > (has_part ? st.st_size : 0)) {
+        _error_code = 416;
+        return false;
+    }
+
+    // Readable too, spliced bytes are hashed by reading them back. Not
+    // truncated until the lock is held, another upload may be writing
+    _fd = open(_part_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0 || fstat(_fd, &st) != 0) {
+        std::cerr << "Error: cannot open " << _part_path << std::endl;
+        _error_code = (_fd < 0 && stat(_target_path.c_str(), &st) != 0) ? 409 : 500;
+        if (_fd >= 0) {
+            close(_fd);
+            _fd = -1;
+        }
+        return false;
+    }
+    struct stat current;
+    if (flock(_fd, LOCK_EX | LOCK_NB) != 0 || stat(_part_path.c_str(), &current) != 0 ||
+        current.st_dev != st.st_dev || current.st_ino != st.st_ino) {
+        std::cerr << "Error: " << _part_path << " is in use by another upload" << std::endl;
+        _error_code = 409;
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+    if (!_ranged && st.st_size > 0) {
+        if (ftruncate(_fd, 0) != 0) {
+            std::cerr << "Error: cannot truncate " << _part_path << std::endl;
+            _error_code = 500;
+            return false;
+        }
+        st.st_size = 0;
+    }
+    if (_ranged && _start > st.st_size) {
+        _error_code = 416;
+        return false;
+    }
+    _committed = st.st_size;
+    _offset = _start;
+
+    off_t reserve_end = _total >= 0 ? _total : _end;
+    if (reserve_end > _committed) {
+        // Best effort: not every filesystem supports it
+        fallocate(_fd, FALLOC_FL_KEEP_SIZE, _committed, reserve_end - _committed);
+    }
+    return true;
+}
+
+/*
+ * Creates the pipe body bytes travel through on their way to the file
+ */
+bool PutUpload::openPipe() {
+    if (pipe2(_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        _pipe[0] = -1;
+        _pipe[1] = -1;
+        return false;
+    }
+    // A larger pipe moves more per splice; the default still works
+    fcntl(_pipe[1], F_SETPIPE_SZ, static_cast<int>(PIPE_SIZE));
+    return true;
+}
+
+/*
+ * Passes size bytes left in the pipe to write(), once the part file has
+ * refused to take them by splice()
+ */
+bool PutUpload::drainPipe(size_t size) {
+    char buffer[65536];
+    while (size > 0) {
+        ssize_t got = read(_pipe[0], buffer, size < sizeof(buffer) ? size : sizeof(buffer));
+        if (got <= 0) {
+            std::cerr << "Error: cannot read upload pipe for " << _part_path << std::endl;
+            _error_code = 500;
+            return false;
+        }
+        if (!write(buffer, got)) {
+            return false;
+        }
+        size -= got;
+    }
+    return true;
+}
+
+/*
+ * Returns whether the rest of the body can be spliced into the file
+ */
+bool PutUpload::canSplice() const {
+    return _fd >= 0 && _error_code == 0 && !_splice_refused;
+}
+
+/*
+ * Splices up to max_bytes from the socket into the pipe, then from the
+ * pipe into the part file at the current offset
+ * Returns the bytes taken off the socket, 0 if the peer closed it or
+ * the socket failed and -1 if nothing was moved. Only a socket or file
+ * that splice() refuses sends the rest of the body through write();
+ * bytes already in the pipe are written from there.
+ */
+ssize_t PutUpload::spliceFrom(int socket_fd, size_t max_bytes) {
+    if (_pipe[0] < 0 && !openPipe()) {
+        _splice_refused = true;
+        return -1;
+    }
+    if (max_bytes > PIPE_SIZE) {
+        max_bytes = PIPE_SIZE;
+    }
+    ssize_t moved = splice(socket_fd, NULL, _pipe[1], NULL, max_bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved < 0) {
+        if (errno == EINVAL || errno == ENOSYS) {
+            // A socket splice() does not support; recv() reads the rest
+            _splice_refused = true;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            return 0;
+        }
+        return -1;
+    }
+    if (moved == 0) {
+        return 0;
+    }
+
+    off_t first = _offset;
+    size_t pending = moved;
+    while (pending > 0) {
+        loff_t offset = _offset;
+        ssize_t written = splice(_pipe[0], NULL, _fd, &offset, pending, SPLICE_F_MOVE);
+        if (written <= 0) {
+            break;
+        }
+        pending -= written;
+        _offset += written;
+        if (_offset > _committed) {
+            _committed = _offset;
+        }
+    }
+    if (!hashStored(first, NULL, moved - pending)) {
+        _error_code = 500;
+        return moved;
+    }
+    if (pending > 0) {
+        // The filesystem does not take splice(), or the disk is full;
+        // write() tells which
+        _splice_refused = true;
+        drainPipe(pending);
+    }
+    return moved;
+}
+
+/*
+ * Feeds the part file from the hashed length up to end to the file hash
+ * Those bytes were stored by earlier requests of a resumed upload
+ */
+bool PutUpload::hashFileUpTo(off_t end) {
+    char buffer[65536];
+    while (_hashed < end) {
+        size_t length = sizeof(buffer);
+        if (static_cast<off_t>(length) > end - _hashed) {
+            length = end - _hashed;
+        }
+        ssize_t got = pread(_fd, buffer, length, _hashed);
+        if (got <= 0) {
+            std::cerr << "Error: cannot read " << _part_path << std::endl;
+            return false;
+        }
+        _file_hash.update(buffer, got);
+        _hashed += got;
+    }
+    return true;
+}
+
+/*
+ * Feeds the body bytes that go to offset to the hashes that need them
+ * Spliced bytes are passed as NULL and read back from the part file
+ * once stored, which finds them in the page cache.
+ */
+bool PutUpload::hashStored(off_t offset, const char* data, size_t size) {
+    bool checking = _ranged && !_expected.isEmpty();
+    if (!_hashing && !checking) {
+        return true;
+    }
+    if (_hashing && !hashFileUpTo(offset)) {
+        return false;
+    }
+    char buffer[65536];
+    while (size > 0) {
+        const char* chunk = data;
+        size_t length = size;
+        if (!data) {
+            length = size < sizeof(buffer) ? size : sizeof(buffer);
+            ssize_t got = pread(_fd, buffer, length, offset);
+            if (got <= 0) {
+                std::cerr << "Error: cannot read " << _part_path << std::endl;
+                return false;
+            }
+            chunk = buffer;
+            length = got;
+        } else {
+            data += length;
+        }
+        if (checking) {
+            _content_hash.update(chunk, length);
+        }
+        if (_hashing) {
+            _file_hash.update(chunk, length);
+            _hashed = offset + length;
+        }
+        offset += length;
+        size -= length;
+    }
+    return true;
+}
+
+/*
+ * Writes body bytes at the current offset of the part file
+ */
+bool PutUpload::write(const char* data, size_t size) {
+    if (_error_code != 0) {
+        return false;
+    }
+    if (_fd < 0) {
+        return true;
+    }
+    if (!hashStored(_offset, data, size)) {
+        _error_code = 500;
+        return false;
+    }
+    while (size > 0) {
+        ssize_t written = pwrite(_fd, data, size, _offset);
+        if (written <= 0) {
+            std::cerr << "Error: cannot write " << _part_path << std::endl;
+            _error_code = 500;
+            return false;
+        }
+        data += written;
+        size -= written;
+        _offset += written;
+        if (_offset > _committed) {
+            _committed = _offset;
+        }
+    }
+    return true;
+}
+
+/*
+ * Moves the finished part file over the target
+ * Bytes beyond the total, left by an earlier attempt, are cut off first
+ */
+bool PutUpload::commit() {
+    if (_committed > _total && ftruncate(_fd, _total) != 0) {
+        return false;
+    }
+    _committed = _total;
+    return std::rename(_part_path.c_str(), _target_path.c_str()) == 0;
+}
+
+/*
+ * Cuts the part file back to where this request's body started, so
+ * bytes that failed their digest check are not resumed from
+ */
+void PutUpload::discardBody() {
+    if (_start == 0) {
+        unlink(_part_path.c_str());
+    } else if (ftruncate(_fd, _start) != 0) {
+        std::cerr << "Error: cannot truncate " << _part_path << std::endl;
+    }
+    _committed = _start;
+    close(_fd);
+    _fd = -1;
+}
+
+/*
+ * Renames the part file once every byte is in, then closes it
+ * A client supplied digest is checked first. upload_fsync decides
+ * whether the data, and the rename, are flushed to disk before the
+ * client hears about them. The file stays open, and locked, until it
+ * has been renamed.
+ */
+bool PutUpload::finish() {
+    if (_error_code != 0) {
+        return false;
+    }
+    if (_status_query) {
+        return true;
+    }
+    if (!_ranged) {
+        _total = _end;
+    }
+    bool completes = _total >= 0 && _committed >= _total;
+    if (completes) {
+        // Also covers a file completed by bytes an earlier request left
+        _hashing = true;
+        if (!hashFileUpTo(_total)) {
+            _error_code = 500;
+            return false;
+        }
+        _file_hash.finish();
+    }
+    if (!_expected.isEmpty()) {
+        ContentHash& content = _ranged ? _content_hash : _file_hash;
+        content.finish();
+        if (!_expected.matches(content)) {
+            std::cerr << "Error: body of " << _target_path << " does not match its digest" << std::endl;
+            discardBody();
+            _error_code = 400;
+            return false;
+        }
+    }
+    bool flush = _fsync == Location::UPLOAD_FSYNC_ALWAYS || (completes && _fsync == Location::UPLOAD_FSYNC_COMMIT);
+    if (flush && fdatasync(_fd) != 0) {
+        std::cerr << "Error: cannot flush " << _part_path << std::endl;
+        _error_code = 500;
+        return false;
+    }
+    if (completes) {
+        if (!commit() || (_fsync != Location::UPLOAD_FSYNC_OFF && !syncDirectory(_target_path))) {
+            std::cerr << "Error: cannot store " << _target_path << std::endl;
+            _error_code = 500;
+            return false;
+        }
+        _complete = true;
+    }
+    int result = close(_fd);
+    _fd = -1;
+    if (result != 0) {
+        std::cerr << "Error: cannot close " << (_complete ? _target_path : _part_path) << std::endl;
+        _error_code = 500;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Stops an interrupted upload
+ * The bytes written so far stay in the part file for the client to resume
+ */
+void PutUpload::abort() {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+/*
+ * Returns the status code to answer a failed upload with
+ */
+int PutUpload::getErrorCode() const {
+    return _error_code;
+}
+
+/*
+ * Returns 201 or 200 once the target holds the whole upload, with its
+ * digests, otherwise 204 with a Range header telling how many bytes are
+ * committed
+ */
+HttpResponse PutUpload::buildResponse() const {
+    if (_complete) {
+        std::ostringstream body;
+        body << "Upload successful\nFile saved to: " << _target_path << "\nSize: " << _committed << " bytes\n";
+        if (_file_hash.isFinished()) {
+            body << "SHA-256: " << _file_hash.sha256Hex() << "\nCRC32C: " << _file_hash.crc32cHex() << "\n";
+        }
+        HttpResponse response = HttpResponse::createOkResponse(body.str(), "text/plain");
+        if (_file_hash.isFinished()) {
+            response.setHeader("ETag", _file_hash.etag());
+            // The stored file, not this text body, so not Content-Digest
+            response.setHeader("Repr-Digest", _file_hash.digestHeader());
+        }
+        if (_created && !_status_query) {
+            response.setStatusCode(201);
+        }
+        return response;
+    }
+    HttpResponse response;
+    response.setStatusCode(204);
+    if (_committed > 0) {
+        std::ostringstream range;
+        range << "bytes=0-" << _committed - 1;
+        response.setHeader("Range", range.str());
+    }
+    return response;
+}
@@ -0,0 +1,268 @@
+#include "RegexLocationSet.hpp"
+#include <iostream>
+#include <cctype>
+#include <cstring>
+
+/*
+ * Creates an empty set that matches nothing
+ */
+RegexLocationSet::RegexLocationSet() {}
+
+/*
+ * Destructor for RegexLocationSet
+ * Frees the compiled patterns
+ */
+RegexLocationSet::~RegexLocationSet() {
+    clear();
+}
+
+/*
+ * Returns the index just past a bracket expression starting at start
+ * Handles a leading ']' or '^]' and [:class:] style elements
+ */
+size_t RegexLocationSet::skipBracket(const std::string& pattern, size_t start) {
+    size_t i = start + 1;
+    if (i < pattern.length() && pattern[i] == '^') {
+        ++i;
+    }
+    if (i < pattern.length() && pattern[i] == ']') {
+        ++i;
+    }
+    while (i < pattern.length() && pattern[i] != ']') {
+        if (pattern[i] == '[' && i + 1 < pattern.length() &&
+            (pattern[i + 1] == ':' || pattern[i + 1] == '.' || pattern[i + 1] == '=')) {
+            char kind = pattern[i + 1];
+            i += 2;
+            while (i + 1 < pattern.length() && !(pattern[i] == kind && pattern[i + 1] == ']')) {
+                ++i;
+            }
+            i += 2;
+        } else {
+            ++i;
+        }
+    }
+    return (i < pattern.length()) ? i + 1 : pattern.length();
+}
+
+/*
+ * Extracts literals that every URI matching pattern must have
+ * prefix is the literal text right after a leading '^'; required is the
+ * longest literal run outside groups. Both are left empty when the pattern
+ * has a top-level alternation, since then no literal is mandatory.
+ */
+void RegexLocationSet::extractLiterals(const std::string& pattern, std::string& prefix, std::string& required) {
+    prefix.clear();
+    required.clear();
+
+    size_t length = pattern.length();
+    size_t i = 0;
+    bool in_prefix = false;
+    if (length > 0 && pattern[0] == '^') {
+        in_prefix = true;
+        i = 1;
+    }
+
+    std::string run;
+    int depth = 0;
+    while (i < length) {
+        char c = pattern[i];
+        size_t width = 1;
+        bool is_literal = false;
+        char literal = 0;
+
+        if (c == '\\' && i + 1 < length) {
+            width = 2;
+            if (!std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                is_literal = true;
+                literal = pattern[i + 1];
+            }
+        } else if (c == '[') {
+            width = skipBracket(pattern, i) - i;
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            --depth;
+        } else if (c == '|') {
+            if (depth == 0) {
+                prefix.clear();
+                required.clear();
+                return;
+            }
+        } else if (std::strchr(".*+?{}^$", c) == NULL) {
+            is_literal = true;
+            literal = c;
+        }
+
+        char next = (i + width < length) ? pattern[i + width] : '\0';
+        bool optional = (next == '*' || next == '?' || next == '{');
+        if (is_literal && depth == 0 && !optional) {
+            run += literal;
+            if (in_prefix) {
+                prefix += literal;
+            }
+            if (next == '+') {
+                // The character may repeat, so the literal run ends here
+                if (run.length() > required.length()) {
+                    required = run;
+                }
+                run.clear();
+                in_prefix = false;
+            }
+        } else {
+            if (run.length() > required.length()) {
+                required = run;
+            }
+            run.clear();
+            in_prefix = false;
+        }
+        i += width;
+    }
+    if (run.length() > required.length()) {
+        required = run;
+    }
+}
+
+/*
+ * Compiles the regex locations of a server block in config order
+ * Patterns that fail to compile are reported and skipped
+ */
+void RegexLocationSet::build(const std::vector<Location>& locations) {
+    clear();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (!locations[i].isRegex()) {
+            continue;
+        }
+
+        Pattern* pattern = new Pattern();
+        pattern->location = &locations[i];
+        pattern->caseless = locations[i].getMatchType() == Location::MATCH_REGEX_CASELESS;
+        int flags = REG_EXTENDED | REG_NOSUB;
+        if (pattern->caseless) {
+            flags |= REG_ICASE;
+        }
+        if (regcomp(&pattern->regex, locations[i].getPath().c_str(), flags) != 0) {
+            std::cerr << "Error: Invalid regular expression in location: " << locations[i].getPath() << std::endl;
+            delete pattern;
+            continue;
+        }
+
+        extractLiterals(locations[i].getPath(), pattern->prefix, pattern->required);
+        if (pattern->caseless) {
+            for (size_t j = 0; j < pattern->prefix.length(); ++j) {
+                pattern->prefix[j] = std::tolower(static_cast<unsigned char>(pattern->prefix[j]));
+            }
+            for (size_t j = 0; j < pattern->required.length(); ++j) {
+                pattern->required[j] = std::tolower(static_cast<unsigned char>(pattern->required[j]));
+            }
+        }
+        _patterns.push_back(pattern);
+    }
+}
+
+/*
+ * Returns whether uri starts with prefix, ignoring case if requested
+ * prefix is already lowercase for caseless patterns
+ */
+bool RegexLocationSet::startsWith(const std::string& uri, const std::string& prefix, bool caseless) {
+    if (uri.length() < prefix.length()) {
+        return false;
+    }
+    if (!caseless) {
+        return std::memcmp(uri.data(), prefix.data(), prefix.length()) == 0;
+    }
+    for (size_t i = 0; i < prefix.length(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(uri[i])) != prefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns whether uri contains literal, ignoring case if requested
+ * literal is already lowercase for caseless patterns
+ */
+bool RegexLocationSet::contains(const std::string& uri, const std::string& literal, bool caseless) {
+    if (!caseless) {
+        return uri.find(literal) != std::string::npos;
+    }
+    if (uri.length() < literal.length()) {
+        return false;
+    }
+    for (size_t start = 0; start + literal.length() <= uri.length(); ++start) {
+        size_t i = 0;
+        while (i < literal.length() &&
+               std::tolower(static_cast<unsigned char>(uri[start + i])) == literal[i]) {
+            ++i;
+        }
+        if (i == literal.length()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Runs the patterns in config order and returns the first matching location
+ * The literal prefilters skip regexec for patterns that cannot match
+ */
+const Location* RegexLocationSet::evaluate(const std::string& uri) const {
+    for (size_t i = 0; i < _patterns.size(); ++i) {
+        const Pattern* pattern = _patterns[i];
+        if (!pattern->prefix.empty() && !startsWith(uri, pattern->prefix, pattern->caseless)) {
+            continue;
+        }
+        if (!pattern->required.empty() && !contains(uri, pattern->required, pattern->caseless)) {
+            continue;
+        }
+        if (regexec(&pattern->regex, uri.c_str(), 0, NULL, 0) == 0) {
+            return pattern->location;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the first regex location matching uri, or NULL
+ * Results, including misses, are remembered for the most recent URIs
+ */
+const Location* RegexLocationSet::match(const std::string& uri) {
+    if (_patterns.empty()) {
+        return NULL;
+    }
+
+    std::map<std::string, MemoList::iterator>::iterator found = _memo_index.find(uri);
+    if (found != _memo_index.end()) {
+        _memo.splice(_memo.begin(), _memo, found->second);
+        return found->second->second;
+    }
+
+    const Location* location = evaluate(uri);
+    _memo.push_front(std::make_pair(uri, location));
+    _memo_index[uri] = _memo.begin();
+    if (_memo.size() > MEMO_CAPACITY) {
+        _memo_index.erase(_memo.back().first);
+        _memo.pop_back();
+    }
+    return location;
+}
+
+/*
+ * Returns whether the server block has no regex locations
+ */
+bool RegexLocationSet::empty() const {
+    return _patterns.empty();
+}
+
+/*
+ * Frees the compiled patterns and forgets memoized results
+ */
+void RegexLocationSet::clear() {
+    for (size_t i = 0; i < _patterns.size(); ++i) {
+        regfree(&_patterns[i]->regex);
+        delete _patterns[i];
+    }
+    _patterns.clear();
+    _memo.clear();
+    _memo_index.clear();
+}
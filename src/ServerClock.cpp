@@ -0,0 +1,58 @@
+#include "ServerClock.hpp"
+
+// Static member initialization
+time_t ServerClock::_now = 0;
+time_t ServerClock::_date_time = 0;
+std::string ServerClock::_http_date;
+const std::string ServerClock::_server_token = "webserv/1.0";
+
+/*
+ * Reads the wall clock once for this loop iteration
+ * The HTTP-date is only reformatted when the second changes
+ */
+void ServerClock::tick() {
+    _now = time(NULL);
+    if (_now != _date_time) {
+        formatHttpDate();
+    }
+}
+
+/*
+ * Formats _now as an IMF-fixdate (RFC 9110), e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ */
+void ServerClock::formatHttpDate() {
+    struct tm utc;
+    char buffer[64];
+    
+    gmtime_r(&_now, &utc);
+    size_t length = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+    _http_date.assign(buffer, length);
+    _date_time = _now;
+}
+
+/*
+ * Returns the timestamp of the current loop iteration
+ */
+time_t ServerClock::now() {
+    if (_now == 0) {
+        tick();
+    }
+    return _now;
+}
+
+/*
+ * Returns the cached HTTP-date for the current second
+ */
+const std::string& ServerClock::httpDate() {
+    if (_now == 0) {
+        tick();
+    }
+    return _http_date;
+}
+
+/*
+ * Returns the product token sent in the Server header
+ */
+const std::string& ServerClock::serverToken() {
+    return _server_token;
+}
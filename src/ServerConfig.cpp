@@ -1,5 +1,6 @@
 #include "ServerConfig.hpp"
 #include <iostream>
+#include <cctype>
 
 /*
  * Default constructor for ServerConfig
@@ -62,6 +63,14 @@ const std::vector<Location>& ServerConfig::getLocations() const {
     return _locations;
 }
 
+/*
+ * Returns the extension to MIME type mappings from types blocks
+ * Used for building the server's content type table
+ */
+const std::map<std::string, std::string>& ServerConfig::getMimeTypes() const {
+    return _mime_types;
+}
+
 // Setters
 /*
  * Sets the host/IP address for this server configuration
@@ -135,6 +144,21 @@ void ServerConfig::addLocation(const Location& location) {
     _locations.push_back(location);
 }
 
+/*
+ * Maps a file extension (without the dot) to a MIME type
+ * Extensions are stored lowercase; replace decides whether an existing
+ * mapping is overwritten (server types override global ones)
+ */
+void ServerConfig::addMimeType(const std::string& extension, const std::string& type, bool replace) {
+    std::string key = extension;
+    for (size_t i = 0; i < key.length(); ++i) {
+        key[i] = std::tolower(static_cast<unsigned char>(key[i]));
+    }
+    if (replace || _mime_types.find(key) == _mime_types.end()) {
+        _mime_types[key] = type;
+    }
+}
+
 /*
  * Prints the server configuration to stdout for debugging
  * Displays all configured values including locations and error pages
@@ -155,6 +179,8 @@ void ServerConfig::print() const {
          it != _error_pages.end(); ++it) {
         std::cout << "    " << it->first << ": " << it->second << std::endl;
     }
+    if (!_mime_types.empty())
+        std::cout << "  MIME types: " << _mime_types.size() << " extensions" << std::endl;
     std::cout << "  Locations:" << std::endl;
     for (size_t i = 0; i < _locations.size(); ++i) {
         _locations[i].print();
@@ -0,0 +1,148 @@
+#include "ServerContext.hpp"
+#include "ServerClock.hpp"
+#include <sstream>
+
+/*
+ * Builds the runtime state for a server block
+ * Loads and serializes all error pages, compiles the locations, builds
+ * the MIME type table, maps bundles, prepares the CGI environments and
+ * preloads pinned static files up front
+ */
+ServerContext::ServerContext(const ServerConfig& config) : _config(&config) {
+    _error_pages.build(config);
+    _mime_types.build(config.getMimeTypes());
+    const std::vector<Location>& locations = config.getLocations();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (locations[i].getMatchType() == Location::MATCH_EXACT &&
+            _exact_locations.find(locations[i].getPath()) == _exact_locations.end()) {
+            _exact_locations[locations[i].getPath()] = &locations[i];
+        }
+    }
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (!locations[i].getBundle().empty()) {
+            StaticBundle* bundle = new StaticBundle();
+            if (bundle->open(locations[i].getBundle())) {
+                _bundles[&locations[i]] = bundle;
+            } else {
+                delete bundle;   // the location keeps serving from its root
+            }
+        }
+        if (!locations[i].getCgiExtensions().empty()) {
+            buildCgiEnvironment(locations[i]);
+        }
+    }
+    _locations.build(locations);
+    _regex_locations.build(locations);
+    _preloaded.build(locations, *this);
+}
+
+/*
+ * Destructor for ServerContext
+ * Unmaps the bundles
+ */
+ServerContext::~ServerContext() {
+    for (std::map<const Location*, StaticBundle*>::iterator it = _bundles.begin(); it != _bundles.end(); ++it) {
+        delete it->second;
+    }
+}
+
+/*
+ * Returns the server block this context was built from
+ */
+const ServerConfig& ServerContext::getConfig() const {
+    return *_config;
+}
+
+/*
+ * Returns the prepared error responses for this server block
+ */
+const ErrorPageCache& ServerContext::getErrorPages() const {
+    return _error_pages;
+}
+
+/*
+ * Returns the extension to Content-Type table of this server block
+ */
+const MimeTypes& ServerContext::getMimeTypes() const {
+    return _mime_types;
+}
+
+/*
+ * Returns the location handling uri, or NULL, in nginx order
+ * An exact location wins outright; otherwise the longest prefix is found
+ * and, unless it is a ^~ location, the first matching regex overrides it
+ */
+const Location* ServerContext::findLocation(const std::string& uri) {
+    if (!_exact_locations.empty()) {
+        std::map<std::string, const Location*>::const_iterator exact = _exact_locations.find(uri);
+        if (exact != _exact_locations.end()) {
+            return exact->second;
+        }
+    }
+    
+    const Location* prefix = _locations.match(uri);
+    if (prefix && prefix->getMatchType() == Location::MATCH_PREFIX_NO_REGEX) {
+        return prefix;
+    }
+    
+    const Location* regex = _regex_locations.match(uri);
+    return regex ? regex : prefix;
+}
+
+/*
+ * Returns the response preloaded for uri, or NULL
+ */
+const HttpResponse* ServerContext::findPreloaded(const std::string& uri) const {
+    return _preloaded.find(uri);
+}
+
+/*
+ * Returns the bundle serving location, or NULL if it serves from its root
+ */
+const StaticBundle* ServerContext::findBundle(const Location* location) const {
+    if (_bundles.empty()) {
+        return NULL;
+    }
+    std::map<const Location*, StaticBundle*>::const_iterator it = _bundles.find(location);
+    return it != _bundles.end() ? it->second : NULL;
+}
+
+/*
+ * Returns the CGI variables shared by every request to location, or NULL
+ * if it runs no scripts
+ */
+const std::vector<std::string>* ServerContext::findCgiEnvironment(const Location* location) const {
+    std::map<const Location*, std::vector<std::string> >::const_iterator it = _cgi_environments.find(location);
+    return it != _cgi_environments.end() ? &it->second : NULL;
+}
+
+/*
+ * Prepares the CGI variables that only depend on the server block and
+ * location; requests add their own to these
+ */
+void ServerContext::buildCgiEnvironment(const Location& location) {
+    const std::vector<std::string>& names = _config->getServerNames();
+    std::ostringstream port;
+    port << _config->getPort();
+    std::vector<std::string>& env = _cgi_environments[&location];
+    env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+    env.push_back("SERVER_SOFTWARE=" + ServerClock::serverToken());
+    env.push_back("SERVER_NAME=" + (names.empty() ? _config->getHost() : names[0]));
+    env.push_back("SERVER_PORT=" + port.str());
+    env.push_back("DOCUMENT_ROOT=" + location.getRoot());
+    env.push_back("PATH=/usr/bin:/bin");
+}
+
+/*
+ * Stops serving preloaded copies of a changed file or directory
+ */
+void ServerContext::invalidatePreloaded(const std::string& path) {
+    _preloaded.invalidate(path);
+}
+
+/*
+ * Stops serving any preloaded copy, when file changes were lost
+ */
+void ServerContext::clearPreloaded() {
+    _preloaded.clear();
+}
@@ -0,0 +1,139 @@
+#include "SharedBuffer.hpp"
+
+/*
+ * Default constructor for SharedBuffer
+ * Creates an empty buffer without allocating storage
+ */
+SharedBuffer::SharedBuffer() : _storage(NULL), _data(NULL), _size(0) {}
+
+/*
+ * Creates a buffer holding a private copy of data
+ */
+SharedBuffer::SharedBuffer(const std::string& data) : _storage(NULL), _data(NULL), _size(0) {
+    if (data.empty()) {
+        return;
+    }
+    _storage = new Storage();
+    _storage->bytes = data;
+    _data = _storage->bytes.data();
+    _size = _storage->bytes.size();
+}
+
+/*
+ * Copy constructor - shares storage and bumps the reference count
+ */
+SharedBuffer::SharedBuffer(const SharedBuffer& other)
+    : _storage(other._storage), _data(other._data), _size(other._size) {
+    if (_storage) {
+        ++_storage->refs;
+    }
+}
+
+/*
+ * Assignment operator - drops the current reference and shares other's storage
+ */
+SharedBuffer& SharedBuffer::operator=(const SharedBuffer& other) {
+    if (this != &other) {
+        if (other._storage) {
+            ++other._storage->refs;
+        }
+        release();
+        _storage = other._storage;
+        _data = other._data;
+        _size = other._size;
+    }
+    return *this;
+}
+
+/*
+ * Destructor - frees the storage when the last reference goes away
+ */
+SharedBuffer::~SharedBuffer() {
+    release();
+}
+
+void SharedBuffer::release() {
+    if (_storage && --_storage->refs == 0) {
+        delete _storage;
+    }
+    _storage = NULL;
+    _data = NULL;
+    _size = 0;
+}
+
+/*
+ * Builds a buffer by swapping data into new storage
+ * Avoids copying large bodies that were just read into a string
+ */
+SharedBuffer SharedBuffer::adopt(std::string& data) {
+    SharedBuffer buffer;
+    if (data.empty()) {
+        return buffer;
+    }
+    buffer._storage = new Storage();
+    buffer._storage->bytes.swap(data);
+    buffer._data = buffer._storage->bytes.data();
+    buffer._size = buffer._storage->bytes.size();
+    return buffer;
+}
+
+/*
+ * Builds a buffer over memory it does not own, without reference counting
+ * Used for read-only mappings that stay in place until shutdown
+ */
+SharedBuffer SharedBuffer::borrow(const char* data, size_t size) {
+    SharedBuffer buffer;
+    if (data && size > 0) {
+        buffer._data = data;
+        buffer._size = size;
+    }
+    return buffer;
+}
+
+/*
+ * Returns a buffer covering part of this one without copying
+ * The range is clamped to the buffer; the whole storage stays alive
+ * as long as any slice of it does
+ */
+SharedBuffer SharedBuffer::slice(size_t offset, size_t length) const {
+    SharedBuffer buffer;
+    if (offset >= _size || length == 0) {
+        return buffer;
+    }
+    if (length > _size - offset) {
+        length = _size - offset;
+    }
+    buffer._storage = _storage;
+    buffer._data = _data + offset;
+    buffer._size = length;
+    if (_storage) {
+        ++_storage->refs;
+    }
+    return buffer;
+}
+
+const char* SharedBuffer::data() const {
+    return _data;
+}
+
+size_t SharedBuffer::size() const {
+    return _size;
+}
+
+bool SharedBuffer::empty() const {
+    return _size == 0;
+}
+
+/*
+ * Returns how many buffers share this storage (0 for an empty buffer)
+ */
+size_t SharedBuffer::useCount() const {
+    return _storage ? _storage->refs : 0;
+}
+
+/*
+ * Returns a private copy of the contents
+ */
+std::string SharedBuffer::toString() const {
+    return _size ? std::string(_data, _size) : std::string();
+}
@@ -0,0 +1,60 @@
+#include "StatCache.hpp"
+
+/*
+ * Default constructor for StatCache
+ * Starts with no cached results
+ */
+StatCache::StatCache() {}
+
+/*
+ * Destructor for StatCache
+ */
+StatCache::~StatCache() {}
+
+/*
+ * Copies the cached stat() result of path into st
+ * Returns false if the path has no cached result
+ */
+bool StatCache::lookup(const std::string& path, struct stat& st) const {
+    std::map<std::string, struct stat>::const_iterator it = _entries.find(path);
+    if (it == _entries.end()) {
+        return false;
+    }
+    st = it->second;
+    return true;
+}
+
+/*
+ * Records the stat() result of path, evicting an entry when full
+ */
+void StatCache::store(const std::string& path, const struct stat& st) {
+    if (_entries.size() >= MAX_ENTRIES && _entries.find(path) == _entries.end()) {
+        _entries.erase(_entries.begin());
+    }
+    _entries[path] = st;
+}
+
+/*
+ * Removes the cached result of path, if any
+ */
+void StatCache::invalidate(const std::string& path) {
+    _entries.erase(path);
+}
+
+/*
+ * Removes the cached results of every path below dir
+ */
+void StatCache::invalidateTree(const std::string& dir) {
+    std::string prefix = dir + "/";
+    std::map<std::string, struct stat>::iterator it = _entries.lower_bound(prefix);
+    while (it != _entries.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        _entries.erase(it++);
+    }
+}
+
+/*
+ * Removes every cached result
+ */
+void StatCache::clear() {
+    _entries.clear();
+}
@@ -0,0 +1,183 @@
+#include "StaticBundle.hpp"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Default constructor for StaticBundle
+ * Nothing is mapped until open() succeeds
+ */
+StaticBundle::StaticBundle()
+    : _map(NULL), _map_size(0), _header(NULL), _entries(NULL), _strings(NULL) {}
+
+/*
+ * Destructor for StaticBundle
+ * Unmaps the bundle; responses pointing into it must be gone by now
+ */
+StaticBundle::~StaticBundle() {
+    close();
+}
+
+/*
+ * Maps a bundle file and checks that every entry lies inside it
+ * Returns false, and leaves nothing mapped, if the file is not a valid bundle
+ */
+bool StaticBundle::open(const std::string& path) {
+    close();
+    _path = path;
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open bundle " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(BundleFormat::Header)) {
+        std::cerr << "Error: " << path << " is too small to be a bundle" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Error: cannot map bundle " << path << std::endl;
+        return false;
+    }
+
+    _map = static_cast<const char*>(map);
+    _map_size = st.st_size;
+    _header = reinterpret_cast<const BundleFormat::Header*>(_map);
+    _entries = reinterpret_cast<const BundleFormat::Entry*>(_map + _header->index_offset);
+    _strings = _map + _header->strings_offset;
+    if (!validate()) {
+        std::cerr << "Error: " << path << " is not a valid bundle (rebuild it with webserv-pack)" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Unmaps the bundle
+ */
+void StaticBundle::close() {
+    if (_map) {
+        munmap(const_cast<char*>(_map), _map_size);
+    }
+    _map = NULL;
+    _map_size = 0;
+    _header = NULL;
+    _entries = NULL;
+    _strings = NULL;
+}
+
+/*
+ * Checks the header, bounds of every entry and the sort order of the index
+ * A truncated or corrupt bundle is rejected at load instead of faulting
+ * while serving
+ */
+bool StaticBundle::validate() const {
+    const BundleFormat::Header& header = *_header;
+    if (std::memcmp(header.magic, BundleFormat::MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BundleFormat::VERSION || header.file_size != _map_size) {
+        return false;
+    }
+    uint64_t index_size = static_cast<uint64_t>(header.entry_count) * sizeof(BundleFormat::Entry);
+    if (header.index_offset % sizeof(uint64_t) != 0 || header.index_offset > _map_size ||
+        index_size > _map_size - header.index_offset ||
+        header.strings_offset > _map_size || header.strings_size > _map_size - header.strings_offset) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.entry_count; ++i) {
+        const BundleFormat::Entry& entry = _entries[i];
+        if (static_cast<uint64_t>(entry.path_offset) + entry.path_length > header.strings_size ||
+            static_cast<uint64_t>(entry.type_offset) + entry.type_length > header.strings_size ||
+            static_cast<uint64_t>(entry.etag_offset) + entry.etag_length > header.strings_size ||
+            entry.body_offset > _map_size || entry.body_size > _map_size - entry.body_offset ||
+            entry.gzip_offset > _map_size || entry.gzip_size > _map_size - entry.gzip_offset) {
+            return false;
+        }
+        if (i > 0 && comparePath(_entries[i - 1], _strings + entry.path_offset, entry.path_length) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Compares an entry's path with path, bytewise like the packer's sort
+ */
+int StaticBundle::comparePath(const BundleFormat::Entry& entry, const char* path, size_t length) const {
+    size_t common = entry.path_length < length ? entry.path_length : length;
+    int result = std::memcmp(_strings + entry.path_offset, path, common);
+    if (result != 0) {
+        return result;
+    }
+    if (entry.path_length == length) {
+        return 0;
+    }
+    return entry.path_length < length ? -1 : 1;
+}
+
+/*
+ * Returns the entry stored under path, or NULL, by binary search
+ */
+const BundleFormat::Entry* StaticBundle::find(const std::string& path) const {
+    if (!_map) {
+        return NULL;
+    }
+    size_t low = 0;
+    size_t high = _header->entry_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int result = comparePath(_entries[middle], path.data(), path.length());
+        if (result == 0) {
+            return &_entries[middle];
+        }
+        if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the body of an entry as a buffer pointing into the mapping
+ */
+SharedBuffer StaticBundle::body(const BundleFormat::Entry& entry) const {
+    return SharedBuffer::borrow(_map + entry.body_offset, entry.body_size);
+}
+
+/*
+ * Returns the gzip variant of an entry, empty if it has none
+ */
+SharedBuffer StaticBundle::gzipBody(const BundleFormat::Entry& entry) const {
+    return SharedBuffer::borrow(_map + entry.gzip_offset, entry.gzip_size);
+}
+
+/*
+ * Returns the Content-Type recorded for an entry
+ */
+std::string StaticBundle::contentType(const BundleFormat::Entry& entry) const {
+    return std::string(_strings + entry.type_offset, entry.type_length);
+}
+
+/*
+ * Returns the quoted ETag recorded for an entry
+ */
+std::string StaticBundle::etag(const BundleFormat::Entry& entry) const {
+    return std::string(_strings + entry.etag_offset, entry.etag_length);
+}
+
+/*
+ * Returns the number of files in the bundle
+ */
+size_t StaticBundle::size() const {
+    return _header ? _header->entry_count : 0;
+}
@@ -0,0 +1,198 @@
+#include "VirtualHostTable.hpp"
+#include <iostream>
+#include <cctype>
+#include <cstring>
+
+/*
+ * Creates an empty name table with a small power-of-two bucket count
+ */
+VirtualHostTable::NameTable::NameTable() : _buckets(16), _count(0) {}
+
+/*
+ * Returns the FNV-1a hash of a lowercase name
+ * Used for both inserting config names and looking up Host values
+ */
+size_t VirtualHostTable::NameTable::hashName(const char* name, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Doubles the bucket count and redistributes the entries
+ * Keeps chains short as server_name lists grow
+ */
+void VirtualHostTable::NameTable::grow() {
+    std::vector<std::vector<Entry> > buckets(_buckets.size() * 2);
+    for (size_t i = 0; i < _buckets.size(); ++i) {
+        for (size_t j = 0; j < _buckets[i].size(); ++j) {
+            const Entry& entry = _buckets[i][j];
+            buckets[entry.hash & (buckets.size() - 1)].push_back(entry);
+        }
+    }
+    _buckets.swap(buckets);
+}
+
+/*
+ * Maps name to server_index unless the name is already taken
+ * Returns false for a duplicate, the first server block keeps the name
+ */
+bool VirtualHostTable::NameTable::insert(const std::string& name, size_t server_index) {
+    size_t dummy;
+    if (find(name.data(), name.length(), dummy)) {
+        return false;
+    }
+    if (_count >= _buckets.size()) {
+        grow();
+    }
+    Entry entry;
+    entry.name = name;
+    entry.hash = hashName(name.data(), name.length());
+    entry.server_index = server_index;
+    _buckets[entry.hash & (_buckets.size() - 1)].push_back(entry);
+    ++_count;
+    return true;
+}
+
+/*
+ * Looks up a lowercase name given as pointer and length
+ * Returns true and sets server_index when found; does not allocate
+ */
+bool VirtualHostTable::NameTable::find(const char* name, size_t length, size_t& server_index) const {
+    if (_count == 0) {
+        return false;
+    }
+    size_t hash = hashName(name, length);
+    const std::vector<Entry>& bucket = _buckets[hash & (_buckets.size() - 1)];
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].hash == hash && bucket[i].name.length() == length &&
+            std::memcmp(bucket[i].name.data(), name, length) == 0) {
+            server_index = bucket[i].server_index;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Returns whether the table holds no names
+ */
+bool VirtualHostTable::NameTable::empty() const {
+    return _count == 0;
+}
+
+/*
+ * Creates an empty table; servers are added in config order
+ */
+VirtualHostTable::VirtualHostTable() {}
+
+/*
+ * Destructor for VirtualHostTable
+ */
+VirtualHostTable::~VirtualHostTable() {}
+
+/*
+ * Adds a server block listening on this socket and indexes its names
+ * The first block added is the default for unknown or missing Host values
+ */
+void VirtualHostTable::addServer(size_t server_index, const ServerConfig& config) {
+    _servers.push_back(server_index);
+
+    const std::vector<std::string>& names = config.getServerNames();
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::string name = names[i];
+        for (size_t j = 0; j < name.length(); ++j) {
+            name[j] = std::tolower(static_cast<unsigned char>(name[j]));
+        }
+        if (name.empty()) {
+            continue;
+        }
+
+        bool inserted;
+        if (name.length() > 2 && name[0] == '*' && name[1] == '.') {
+            inserted = _suffix_names.insert(name.substr(1), server_index);
+        } else if (name.length() > 2 && name[name.length() - 1] == '*' && name[name.length() - 2] == '.') {
+            inserted = _prefix_names.insert(name.substr(0, name.length() - 1), server_index);
+        } else if (name[0] == '.') {
+            // ".example.com" covers example.com and all of its subdomains
+            inserted = _exact_names.insert(name.substr(1), server_index);
+            inserted = _suffix_names.insert(name, server_index) && inserted;
+        } else {
+            inserted = _exact_names.insert(name, server_index);
+        }
+        if (!inserted) {
+            std::cerr << "Warning: conflicting server name \"" << names[i]
+                      << "\", ignored for server " << server_index << std::endl;
+        }
+    }
+}
+
+/*
+ * Returns the index of the server block handling a Host header value
+ * The port and a trailing dot are ignored and matching is case-insensitive
+ */
+size_t VirtualHostTable::resolve(const std::string& host) const {
+    if (_servers.size() <= 1 || host.empty()) {
+        return getDefaultServer();
+    }
+
+    // Strip an optional port (but not the colons of a bracketed IPv6 literal)
+    size_t length = host.length();
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos && host.find(']', colon) == std::string::npos) {
+        length = colon;
+    }
+    if (length > 0 && host[length - 1] == '.') {
+        --length;
+    }
+
+    char name[256];
+    if (length == 0 || length >= sizeof(name)) {
+        return getDefaultServer();
+    }
+    for (size_t i = 0; i < length; ++i) {
+        name[i] = std::tolower(static_cast<unsigned char>(host[i]));
+    }
+
+    size_t server_index;
+    if (_exact_names.find(name, length, server_index)) {
+        return server_index;
+    }
+
+    // Leading wildcards, longest suffix first
+    if (!_suffix_names.empty()) {
+        for (size_t i = 0; i < length; ++i) {
+            if (name[i] == '.' && _suffix_names.find(name + i, length - i, server_index)) {
+                return server_index;
+            }
+        }
+    }
+
+    // Trailing wildcards, longest prefix first
+    if (!_prefix_names.empty()) {
+        for (size_t i = length; i > 0; --i) {
+            if (name[i - 1] == '.' && _prefix_names.find(name, i, server_index)) {
+                return server_index;
+            }
+        }
+    }
+
+    return getDefaultServer();
+}
+
+/*
+ * Returns the first server block listening on this socket
+ */
+size_t VirtualHostTable::getDefaultServer() const {
+    return _servers.empty() ? 0 : _servers[0];
+}
+
+/*
+ * Returns the indexes of all server blocks on this socket, in config order
+ */
+const std::vector<size_t>& VirtualHostTable::getServers() const {
+    return _servers;
+}
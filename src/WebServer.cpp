@@ -1,9 +1,12 @@
 #include "WebServer.hpp"
+#include "ServerClock.hpp"
 #include <iostream>
 #include <cstdlib>
 #include <unistd.h>
 #include <errno.h>
 #include <cstring>
+#include <sstream>
+#include <map>
 
 /*
  * Constructor for WebServer
@@ -12,6 +15,26 @@ WebServer::WebServer(const std::vector<ServerConfig>& server_configs, const Sign
     : _configs(server_configs), _signal_manager(signal_manager) {
     _connection_handler.setServerConfigs(_configs);
     setupSockets();
+    
+    // The file watcher is polled like a socket; its slot is always first
+    int watcher_fd = _connection_handler.getWatcherFd();
+    if (watcher_fd >= 0 && !_listen_sockets.empty()) {
+        pollfd pfd;
+        pfd.fd = watcher_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        _poll_fds.insert(_poll_fds.begin(), pfd);
+    }
+    
+    // Exited CGI scripts are reported through a signalfd
+    int child_fd = _connection_handler.getChildSignalFd();
+    if (child_fd >= 0 && !_listen_sockets.empty()) {
+        pollfd pfd;
+        pfd.fd = child_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        _poll_fds.push_back(pfd);
+    }
 }
 
 /*
@@ -56,12 +79,29 @@ bool WebServer::isListenSocket(int fd) const {
 
 /*
  * Sets up listening sockets for each server configuration
+ * Server blocks with the same host:port share one socket and are told
+ * apart by the Host header
  */
 void WebServer::setupSockets() {
+    std::map<std::string, int> bound_addresses;
+    
     for (size_t i = 0; i < _configs.size(); ++i) {
+        std::ostringstream address;
+        address << _configs[i].getHost() << ":" << _configs[i].getPort();
+        
+        std::map<std::string, int>::iterator bound = bound_addresses.find(address.str());
+        if (bound != bound_addresses.end()) {
+            if (bound->second >= 0) {
+                _connection_handler.addListenerServer(bound->second, i);
+            }
+            continue;
+        }
+        
         int sock_fd = _socket_manager.createListenSocket(_configs[i].getHost(), _configs[i].getPort());
+        bound_addresses[address.str()] = sock_fd;
         if (sock_fd >= 0) {
             _listen_sockets.push_back(sock_fd);
+            _connection_handler.addListenerServer(sock_fd, i);
             
             pollfd pfd;
             pfd.fd = sock_fd;
@@ -103,14 +143,73 @@ void WebServer::updatePollEvents(int client_sock, short events) {
     }
 }
 
+/*
+ * Polls for POLLOUT on clients that have output queued, only POLLIN on
+ * the others
+ */
+void WebServer::updateClientEvents(int client_sock) {
+    if (_connection_handler.getClient(client_sock).hasPendingOutput()) {
+        updatePollEvents(client_sock, POLLIN | POLLOUT);
+    } else {
+        updatePollEvents(client_sock, POLLIN);
+    }
+}
+
+/*
+ * Removes a closed client from the poll set
+ */
+void WebServer::removePollFd(int fd) {
+    for (std::vector<pollfd>::iterator it = _poll_fds.begin(); it != _poll_fds.end(); ++it) {
+        if (it->fd == fd) {
+            _poll_fds.erase(it);
+            break;
+        }
+    }
+}
+
+/*
+ * Hands poll results for CGI pipes to the connection handler and starts
+ * writing the responses of scripts that are done
+ */
+void WebServer::handleCgiEvents(const std::vector<pollfd>& cgi_fds) {
+    for (size_t i = 0; i < cgi_fds.size(); ++i) {
+        if (cgi_fds[i].revents == 0) {
+            continue;
+        }
+        std::vector<int> ready = _connection_handler.handleCgiEvent(cgi_fds[i].fd, cgi_fds[i].revents);
+        for (size_t j = 0; j < ready.size(); ++j) {
+            updatePollEvents(ready[j], POLLIN | POLLOUT);
+        }
+    }
+}
+
+/*
+ * Reaps exited CGI scripts and starts writing their responses
+ */
+void WebServer::reapCgiChildren() {
+    std::vector<int> ready = _connection_handler.reapCgiChildren();
+    for (size_t i = 0; i < ready.size(); ++i) {
+        updatePollEvents(ready[i], POLLIN | POLLOUT);
+    }
+}
+
 /*
  * Main server loop
+ * The pipes of running CGI scripts are appended to the poll set for one
+ * call and removed again, so the dispatch below only sees sockets
  */
 void WebServer::run() {
     std::cout << "Server running with " << _listen_sockets.size() << " listening sockets" << std::endl;
 
     while (!_signal_manager.isShutdownRequested()) {
+        size_t socket_count = _poll_fds.size();
+        _connection_handler.getCgiPollFds(_poll_fds);
         int poll_count = poll(&_poll_fds[0], _poll_fds.size(), 1000); // 1 second timeout
+        std::vector<pollfd> cgi_fds(_poll_fds.begin() + socket_count, _poll_fds.end());
+        _poll_fds.resize(socket_count);
+        
+        // One clock read per iteration; timeouts and Date headers use it
+        ServerClock::tick();
         
         if (poll_count < 0) {
             // Poll error - do not check errno as per 42 requirements
@@ -118,6 +217,12 @@ void WebServer::run() {
             break;
         }
         
+        int child_fd = _connection_handler.getChildSignalFd();
+        if (child_fd < 0) {
+            // No signalfd: look for exited scripts on every wakeup
+            reapCgiChildren();
+        }
+        
         if (poll_count == 0) {
             // Timeout, check for empty request timeouts
             std::vector<int> clients_needing_pollout = _connection_handler.checkEmptyRequestTimeouts();
@@ -133,6 +238,15 @@ void WebServer::run() {
             updatePollEvents(clients_needing_pollout[i], POLLIN | POLLOUT);
         }
         
+        // Apply file changes before serving anything, so no request sees
+        // a cached entry for a file that has already changed
+        int watcher_fd = _connection_handler.getWatcherFd();
+        if (watcher_fd >= 0 && !_poll_fds.empty() && _poll_fds[0].fd == watcher_fd && _poll_fds[0].revents) {
+            _connection_handler.handleFileEvents();
+        }
+        
+        handleCgiEvents(cgi_fds);
+        
         // Check all file descriptors
         for (size_t i = 0; i < _poll_fds.size() && !_signal_manager.isShutdownRequested(); ++i) {
             if (_poll_fds[i].revents == 0) {
@@ -141,7 +255,11 @@ void WebServer::run() {
             
             int fd = _poll_fds[i].fd;
             
-            if (isListenSocket(fd)) {
+            if (fd == watcher_fd) {
+                continue;
+            } else if (fd == child_fd) {
+                reapCgiChildren();
+            } else if (isListenSocket(fd)) {
                 if (_poll_fds[i].revents & POLLIN) {
                     handleNewConnection(fd);
                 }
@@ -149,31 +267,22 @@ void WebServer::run() {
                 if (_poll_fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
                     std::cout << "Client " << fd << " error/hangup" << std::endl;
                     _connection_handler.removeClient(fd);
-                    for (std::vector<pollfd>::iterator it = _poll_fds.begin(); it != _poll_fds.end(); ++it) {
-                        if (it->fd == fd) {
-                            _poll_fds.erase(it);
-                            break;
-                        }
-                    }
+                    removePollFd(fd);
                     --i;
                 } else {
-                    if (_poll_fds[i].revents & POLLIN) {
+                    short revents = _poll_fds[i].revents;
+                    if (revents & POLLIN) {
                         _connection_handler.handleClientRead(fd);
-                        if (_connection_handler.hasClient(fd)) {
-                            updatePollEvents(fd, POLLIN | POLLOUT);
-                        }
                     }
-                    if (_poll_fds[i].revents & POLLOUT) {
+                    if ((revents & POLLOUT) && _connection_handler.hasClient(fd)) {
                         _connection_handler.handleClientWrite(fd);
-                        if (!_connection_handler.hasClient(fd)) {
-                            for (std::vector<pollfd>::iterator it = _poll_fds.begin(); it != _poll_fds.end(); ++it) {
-                                if (it->fd == fd) {
-                                    _poll_fds.erase(it);
-                                    break;
-                                }
-                            }
-                            --i;
-                        }
+                    }
+                    if (_connection_handler.hasClient(fd)) {
+                        // A client waiting for a script has nothing to write yet
+                        updateClientEvents(fd);
+                    } else {
+                        removePollFd(fd);
+                        --i;
                     }
                 }
             }
@@ -1,13 +1,20 @@
 #include "ConfigParser.hpp"
 #include "WebServer.hpp"
 #include "SignalManager.hpp"
+#include "CgiProcess.hpp"
 #include <iostream>
+#include <cstring>
 
 /*
  * Main entry point for the webserv HTTP server program
  * Handles command line arguments, configuration parsing, and server startup
  */
 int main(int argc, char* argv[]) {
+    // A CGI pool worker, started by the server itself
+    if (argc == 2 && std::strcmp(argv[1], CgiProcess::WORKER_FLAG) == 0) {
+        return CgiProcess::runWorker();
+    }
+    
     // Create signal manager on the stack (no memory leaks!)
     SignalManager signalManager;
     if (!signalManager.setupSignals()) {
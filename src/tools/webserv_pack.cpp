@@ -0,0 +1,323 @@
+#include "BundleFormat.hpp"
+#include "MimeTypes.hpp"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*
+ * webserv-pack: packs a directory into a static site bundle
+ * Usage: webserv-pack [-z] [-p prefix] <directory> <output.pack>
+ * Files are keyed by prefix + their path below directory, which is the URI
+ * they answer when a location uses `bundle` in place of `root`. With -z,
+ * a sibling "name.gz" is stored as the gzip variant of "name".
+ */
+
+namespace {
+
+struct PackedFile {
+    std::string key;          // request path, e.g. /css/style.css
+    std::string path;         // file to read
+    std::string gzip_path;    // precompressed sibling, or empty
+    std::string content_type;
+    std::string etag;
+    uint64_t size;
+    uint64_t gzip_size;
+};
+
+bool compareKeys(const PackedFile& a, const PackedFile& b) {
+    return a.key < b.key;
+}
+
+/*
+ * Reads a whole file into content
+ */
+bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+/*
+ * Returns a strong ETag made of the body size and its FNV-1a 64-bit hash
+ */
+std::string makeEtag(const std::string& content) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < content.size(); ++i) {
+        hash ^= static_cast<unsigned char>(content[i]);
+        hash *= 1099511628211ULL;
+    }
+    static const char digits[] = "0123456789abcdef";
+    std::string etag = "\"";
+    char size_hex[17];
+    size_t length = 0;
+    uint64_t size = content.size();
+    do {
+        size_hex[length++] = digits[size & 0xf];
+        size >>= 4;
+    } while (size && length < 16);
+    while (length > 0) {
+        etag += size_hex[--length];
+    }
+    etag += '-';
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        etag += digits[(hash >> shift) & 0xf];
+    }
+    etag += '"';
+    return etag;
+}
+
+/*
+ * Collects every regular file below root, without following directory symlinks
+ */
+void collectFiles(const std::string& root, const std::string& prefix, std::vector<PackedFile>& files) {
+    std::vector<std::pair<std::string, std::string> > pending(1, std::make_pair(root, prefix));
+    for (size_t i = 0; i < pending.size(); ++i) {
+        DIR* dir = opendir(pending[i].first.c_str());
+        if (!dir) {
+            std::cerr << "webserv-pack: cannot read directory " << pending[i].first << std::endl;
+            continue;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            std::string path = pending[i].first + "/" + name;
+            std::string key = pending[i].second + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                if (entry->d_type == DT_DIR) {
+                    pending.push_back(std::make_pair(path, key));
+                }
+            } else if (S_ISREG(st.st_mode)) {
+                PackedFile file;
+                file.key = key;
+                file.path = path;
+                file.size = 0;
+                file.gzip_size = 0;
+                files.push_back(file);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+/*
+ * Turns "name.gz" files that sit next to "name" into gzip variants
+ */
+void attachGzipVariants(std::vector<PackedFile>& files) {
+    std::map<std::string, size_t> by_key;
+    for (size_t i = 0; i < files.size(); ++i) {
+        by_key[files[i].key] = i;
+    }
+    std::vector<PackedFile> kept;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const std::string& key = files[i].key;
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, ".gz") == 0) {
+            std::map<std::string, size_t>::iterator base = by_key.find(key.substr(0, key.size() - 3));
+            if (base != by_key.end()) {
+                files[base->second].gzip_path = files[i].path;
+                continue;
+            }
+        }
+        kept.push_back(files[i]);
+    }
+    files.swap(kept);
+}
+
+/*
+ * Rounds offset up to a multiple of alignment
+ */
+uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * Appends text to the string table and returns its offset
+ */
+uint32_t addString(std::string& strings, const std::string& text) {
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings += text;
+    return offset;
+}
+
+/*
+ * Writes content at offset, padding the gap since the current position
+ */
+bool writeAt(std::ofstream& out, uint64_t& position, uint64_t offset, const std::string& content) {
+    if (offset > position) {
+        std::string padding(static_cast<size_t>(offset - position), '\0');
+        out.write(padding.data(), padding.size());
+    }
+    out.write(content.data(), content.size());
+    position = offset + content.size();
+    return out.good();
+}
+
+void printUsage() {
+    std::cerr << "Usage: webserv-pack [-z] [-p prefix] <directory> <output.pack>" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    bool gzip_variants = false;
+    std::string prefix;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "-z") {
+            gzip_variants = true;
+        } else if (argument == "-p" && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (!argument.empty() && argument[0] == '-') {
+            printUsage();
+            return 1;
+        } else {
+            arguments.push_back(argument);
+        }
+    }
+    if (arguments.size() != 2) {
+        printUsage();
+        return 1;
+    }
+    while (!prefix.empty() && prefix[prefix.size() - 1] == '/') {
+        prefix.erase(prefix.size() - 1);
+    }
+    if (!prefix.empty() && prefix[0] != '/') {
+        prefix = "/" + prefix;
+    }
+
+    std::string root = arguments[0];
+    while (root.size() > 1 && root[root.size() - 1] == '/') {
+        root.erase(root.size() - 1);
+    }
+    std::vector<PackedFile> files;
+    collectFiles(root, prefix, files);
+    if (gzip_variants) {
+        attachGzipVariants(files);
+    }
+    std::sort(files.begin(), files.end(), compareKeys);
+
+    // Lay out the header, index and string table, then place the bodies
+    MimeTypes mime_types;
+    std::string strings;
+    std::vector<BundleFormat::Entry> index(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string content;
+        if (!readFile(files[i].path, content)) {
+            std::cerr << "webserv-pack: cannot read " << files[i].path << std::endl;
+            return 1;
+        }
+        files[i].size = content.size();
+        files[i].content_type = mime_types.lookup(files[i].key);
+        files[i].etag = makeEtag(content);
+        if (!files[i].gzip_path.empty()) {
+            std::string compressed;
+            if (!readFile(files[i].gzip_path, compressed)) {
+                std::cerr << "webserv-pack: cannot read " << files[i].gzip_path << std::endl;
+                return 1;
+            }
+            files[i].gzip_size = compressed.size();
+        }
+
+        BundleFormat::Entry& entry = index[i];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.path_offset = addString(strings, files[i].key);
+        entry.path_length = files[i].key.size();
+        entry.type_offset = addString(strings, files[i].content_type);
+        entry.type_length = files[i].content_type.size();
+        entry.etag_offset = addString(strings, files[i].etag);
+        entry.etag_length = files[i].etag.size();
+    }
+
+    BundleFormat::Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BundleFormat::MAGIC, sizeof(header.magic));
+    header.version = BundleFormat::VERSION;
+    header.entry_count = files.size();
+    header.index_offset = sizeof(header);
+    header.strings_offset = header.index_offset + files.size() * sizeof(BundleFormat::Entry);
+    header.strings_size = strings.size();
+
+    uint64_t offset = alignUp(header.strings_offset + strings.size(), BundleFormat::PAGE_SIZE);
+    for (size_t i = 0; i < files.size(); ++i) {
+        uint64_t alignment = files[i].size >= BundleFormat::PAGE_SIZE ? BundleFormat::PAGE_SIZE
+                                                                      : BundleFormat::BODY_ALIGNMENT;
+        offset = alignUp(offset, alignment);
+        index[i].body_offset = offset;
+        index[i].body_size = files[i].size;
+        offset += files[i].size;
+        if (files[i].gzip_size > 0) {
+            offset = alignUp(offset, BundleFormat::BODY_ALIGNMENT);
+            index[i].gzip_offset = offset;
+            index[i].gzip_size = files[i].gzip_size;
+            offset += files[i].gzip_size;
+        }
+    }
+    header.file_size = offset;
+
+    // Write to a temporary name and rename, so a running server that has
+    // the old bundle mapped never sees it change underneath
+    std::string output = arguments[1];
+    std::string temporary = output + ".tmp";
+    std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "webserv-pack: cannot create " << temporary << std::endl;
+        return 1;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!index.empty()) {
+        out.write(reinterpret_cast<const char*>(&index[0]), index.size() * sizeof(BundleFormat::Entry));
+    }
+    out.write(strings.data(), strings.size());
+    uint64_t position = header.strings_offset + strings.size();
+
+    for (size_t i = 0; i < files.size() && out.good(); ++i) {
+        std::string content;
+        if (!readFile(files[i].path, content) || content.size() != files[i].size ||
+            !writeAt(out, position, index[i].body_offset, content)) {
+            std::cerr << "webserv-pack: " << files[i].path << " changed while packing" << std::endl;
+            std::remove(temporary.c_str());
+            return 1;
+        }
+        if (files[i].gzip_size > 0) {
+            if (!readFile(files[i].gzip_path, content) || content.size() != files[i].gzip_size ||
+                !writeAt(out, position, index[i].gzip_offset, content)) {
+                std::cerr << "webserv-pack: " << files[i].gzip_path << " changed while packing" << std::endl;
+                std::remove(temporary.c_str());
+                return 1;
+            }
+        }
+    }
+    // The header promises file_size bytes; the body loop leaves the tail
+    // short when the last section ends before the page boundary
+    if (out.good()) {
+        writeAt(out, position, header.file_size, std::string());
+    }
+    out.close();
+    if (!out.good() || std::rename(temporary.c_str(), output.c_str()) != 0) {
+        std::cerr << "webserv-pack: cannot write " << output << std::endl;
+        std::remove(temporary.c_str());
+        return 1;
+    }
+
+    std::cout << "Packed " << files.size() << " files into " << output
+              << " (" << header.file_size << " bytes)" << std::endl;
+    return 0;
+}
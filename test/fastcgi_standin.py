@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Minimal FastCGI responder for trying out fastcgi_pass.
+
+Usage: fastcgi_standin.py unix:/tmp/webserv-fcgi.sock
+       fastcgi_standin.py 127.0.0.1:9000 [--no-mpxs]
+
+Answers every request with its parameters and body echoed back. Connections
+are kept open and, unless --no-mpxs is given, requests are multiplexed: each
+one is answered on its own thread. /slow streams five lines half a second
+apart, /fail ends with application status 1 before any output.
+"""
+import socket
+import struct
+import sys
+import threading
+import time
+import os
+
+BEGIN, ABORT, END, PARAMS, STDIN, STDOUT, STDERR = 1, 2, 3, 4, 5, 6, 7
+GET_VALUES, GET_VALUES_RESULT = 9, 10
+
+
+def read_pairs(data):
+    pairs, i = {}, 0
+    while i < len(data):
+        lengths = []
+        for _ in range(2):
+            if data[i] & 0x80:
+                lengths.append(struct.unpack(">I", data[i:i + 4])[0] & 0x7fffffff)
+                i += 4
+            else:
+                lengths.append(data[i])
+                i += 1
+        name = data[i:i + lengths[0]].decode()
+        value = data[i + lengths[0]:i + lengths[0] + lengths[1]].decode(errors="replace")
+        i += lengths[0] + lengths[1]
+        pairs[name] = value
+    return pairs
+
+
+def write_pairs(pairs):
+    out = b""
+    for name, value in pairs.items():
+        for part in (name, value):
+            out += bytes([len(part)])
+        out += name.encode() + value.encode()
+    return out
+
+
+class Connection:
+    def __init__(self, sock, multiplex):
+        self.sock = sock
+        self.multiplex = multiplex
+        self.lock = threading.Lock()
+        self.requests = {}
+
+    def send(self, rtype, rid, content=b""):
+        with self.lock:
+            for i in range(0, max(len(content), 1), 65535):
+                part = content[i:i + 65535]
+                pad = (8 - len(part) % 8) % 8
+                self.sock.sendall(struct.pack(">BBHHBx", 1, rtype, rid, len(part), pad) + part + b"\0" * pad)
+
+    def recv_exact(self, size):
+        data = b""
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    def serve(self):
+        try:
+            while True:
+                _, rtype, rid, length, pad = struct.unpack(">BBHHBx", self.recv_exact(8))
+                content = self.recv_exact(length + pad)[:length]
+                self.handle(rtype, rid, content)
+        except (EOFError, OSError):
+            pass
+        self.sock.close()
+
+    def handle(self, rtype, rid, content):
+        if rtype == GET_VALUES:
+            values = {"FCGI_MPXS_CONNS": "1" if self.multiplex else "0", "FCGI_MAX_REQS": "16"}
+            self.send(GET_VALUES_RESULT, 0, write_pairs(values))
+        elif rtype == BEGIN:
+            self.requests[rid] = {"params": b"", "stdin": b"", "aborted": False}
+        elif rtype == PARAMS:
+            self.requests[rid]["params"] += content
+        elif rtype == ABORT and rid in self.requests:
+            self.requests[rid]["aborted"] = True
+        elif rtype == STDIN and rid in self.requests:
+            if content:
+                self.requests[rid]["stdin"] += content
+            elif self.multiplex:
+                threading.Thread(target=self.respond, args=(rid,), daemon=True).start()
+            else:
+                self.respond(rid)
+
+    def respond(self, rid):
+        request = self.requests[rid]
+        params = read_pairs(request["params"])
+        script = params.get("SCRIPT_NAME", "")
+        if script.endswith("/fail"):
+            self.end(rid, 1)
+            return
+        if script.endswith("/slow"):
+            self.send(STDOUT, rid, b"Content-Type: text/plain\r\n\r\n")
+            for i in range(5):
+                if request["aborted"]:
+                    break
+                self.send(STDOUT, rid, ("line %d\n" % i).encode())
+                time.sleep(0.5)
+            self.end(rid, 0)
+            return
+        body = "Content-Type: text/plain\r\n\r\n"
+        body += "pid %d\n" % os.getpid()
+        for name in sorted(params):
+            body += "%s=%s\n" % (name, params[name])
+        self.send(STDOUT, rid, body.encode() + b"body:" + request["stdin"])
+        self.send(STDERR, rid, ("served %s\n" % script).encode())
+        self.end(rid, 0)
+
+    def end(self, rid, app_status):
+        self.send(STDOUT, rid)
+        self.send(END, rid, struct.pack(">IB3x", app_status, 0))
+        del self.requests[rid]
+
+
+def main():
+    address = sys.argv[1]
+    multiplex = "--no-mpxs" not in sys.argv
+    if address.startswith("unix:"):
+        path = address[5:]
+        if os.path.exists(path):
+            os.unlink(path)
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(path)
+    else:
+        host, port = address.rsplit(":", 1)
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, int(port)))
+    server.listen(16)
+    while True:
+        sock, _ = server.accept()
+        print("connection accepted", flush=True)
+        threading.Thread(target=Connection(sock, multiplex).serve, daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -10,10 +10,15 @@ import time
 import sys
 import os
 import signal
+import hashlib
+import base64
+import json
+import shutil
+import gzip
 from urllib.parse import urlparse
 
 class WebservPhase2Tester:
-    def __init__(self, host='127.0.0.1', port=8080, config_file='test_8080.conf'):
+    def __init__(self, host='127.0.0.1', port=8080, config_file='webserv_demo_simple.conf'):
         self.host = host
         self.port = port
         self.config_file = config_file
@@ -117,6 +122,43 @@ class WebservPhase2Tester:
         except Exception as e:
             return f"ERROR: {e}"
     
+    def send_in_parts(self, parts, delay=0.3, timeout=10):
+        """Send a request in several writes, so the server reads it in pieces"""
+        try:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            sock.settimeout(timeout)
+            sock.connect((self.host, self.port))
+            
+            for part in parts:
+                sock.sendall(part)
+                time.sleep(delay)
+            response = sock.recv(8192).decode(errors='replace')
+            sock.close()
+            
+            return response
+        except Exception as e:
+            return f"ERROR: {e}"
+    
+    def send_until_close(self, raw_data, timeout=10, binary=False):
+        """Send a raw request and read the response until the server closes"""
+        try:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            sock.settimeout(timeout)
+            sock.connect((self.host, self.port))
+            
+            sock.sendall(raw_data)
+            response = b""
+            while True:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                response += chunk
+            sock.close()
+            
+            return response if binary else response.decode(errors='replace')
+        except Exception as e:
+            return f"ERROR: {e}".encode() if binary else f"ERROR: {e}"
+    
     def parse_response(self, response):
         """Parse HTTP response into components"""
         if response.startswith("ERROR:"):
@@ -144,6 +186,24 @@ class WebservPhase2Tester:
         
         return status_line, headers, body, None
     
+    def decode_chunked(self, body):
+        """Join the chunks of a chunked body, None if the framing is broken"""
+        data = ""
+        chunks = 0
+        while True:
+            line, sep, body = body.partition("\r\n")
+            try:
+                size = int(line.split(';')[0], 16)
+            except ValueError:
+                return None, chunks
+            if size == 0:
+                return data, chunks
+            if not sep or len(body) < size + 2 or body[size:size + 2] != "\r\n":
+                return None, chunks
+            data += body[:size]
+            body = body[size + 2:]
+            chunks += 1
+    
     def log_test_result(self, test_name, expected, actual, passed, details=""):
         """Log test result"""
         status = "✅ PASS" if passed else "❌ FAIL"
@@ -382,6 +442,443 @@ class WebservPhase2Tester:
         passed = "400" in str(response) or "ERROR" in str(response)
         self.log_test_result("Garbage input", "400 Bad Request", response[:50] if response else "No response", passed)
     
+    def run_multipart_tests(self):
+        """Run streaming multipart upload tests (21, 40) against /upload"""
+        print("\n🧪 MULTIPART UPLOAD TESTS")
+        
+        # Test 21: Boundary split across reads
+        print("\n21. Multipart boundary split across reads")
+        boundary = "----phase2boundary7MA4YWxk"
+        content = b"first line\r\n--not-the-boundary\r\n" + bytes(range(256)) * 8
+        body = (f"--{boundary}\r\n"
+                'Content-Disposition: form-data; name="file"; filename="phase2_split.bin"\r\n'
+                "Content-Type: application/octet-stream\r\n\r\n").encode()
+        body += content + f"\r\n--{boundary}--\r\n".encode()
+        head = (f"POST /upload HTTP/1.1\r\nHost: {self.host}:{self.port}\r\n"
+                f"Content-Type: multipart/form-data; boundary={boundary}\r\n"
+                f"Content-Length: {len(body)}\r\nConnection: close\r\n\r\n").encode()
+        # Cut inside the part headers, inside the content and twice inside the closing delimiter
+        closing = len(body) - len(boundary) - 6
+        cuts = [20, 90, len(body) - len(content) - 40, closing - 3, closing + 5, len(body)]
+        parts = [head]
+        start = 0
+        for cut in cuts:
+            parts.append(body[start:cut])
+            start = cut
+        response = self.send_in_parts(parts)
+        status, headers, body_text, error = self.parse_response(response)
+        stored = b""
+        if os.path.exists("www/upload/phase2_split.bin"):
+            with open("www/upload/phase2_split.bin", "rb") as stored_file:
+                stored = stored_file.read()
+        passed = not error and status and ("200" in status or "201" in status) and stored == content
+        self.log_test_result("Multipart split boundary", "stored byte for byte",
+                             status or error, passed, "" if passed else response[:300])
+        self.send_http_request("DELETE", "/upload/phase2_split.bin")
+        
+        # Test 40: Several files and fields, summarized as JSON
+        print("\n40. Multipart upload of several files")
+        files = [("first", "phase2_multi_a.txt", b"first file\n" * 50),
+                 ("second", "phase2_multi_b.bin", bytes(range(256)) * 40)]
+        fields = [("comment", "two files"), ("tag", "phase2")]
+        body = b""
+        for field, name, content in files:
+            body += (f"--{boundary}\r\nContent-Disposition: form-data; name=\"{field}\"; filename=\"{name}\"\r\n"
+                     "Content-Type: application/octet-stream\r\n\r\n").encode() + content + b"\r\n"
+        for name, value in fields:
+            body += f"--{boundary}\r\nContent-Disposition: form-data; name=\"{name}\"\r\n\r\n{value}\r\n".encode()
+        body += f"--{boundary}--\r\n".encode()
+        head = (f"POST /upload HTTP/1.1\r\nHost: {self.host}:{self.port}\r\nAccept: application/json\r\n"
+                f"Content-Type: multipart/form-data; boundary={boundary}\r\n"
+                f"Content-Length: {len(body)}\r\nConnection: close\r\n\r\n").encode()
+        response = self.send_until_close(head + body)
+        status, headers, body_text, error = self.parse_response(response)
+        try:
+            summary = json.loads(body_text) if not error else None
+        except ValueError:
+            summary = None
+        expected_files = [{"field": field, "name": name, "size": len(content),
+                           "sha256": hashlib.sha256(content).hexdigest()} for field, name, content in files]
+        stored_ok = True
+        for _, name, content in files:
+            path = f"www/upload/{name}"
+            stored_ok = stored_ok and os.path.exists(path) and open(path, "rb").read() == content
+        passed = (summary is not None and "200" in status and
+                  headers.get('Content-Type', '').startswith("application/json") and
+                  [{key: entry[key] for key in ("field", "name", "size", "sha256")}
+                   for entry in summary.get("files", [])] == expected_files and
+                  summary.get("fields") == [{"name": name, "value": value} for name, value in fields] and
+                  summary.get("total_size") == sum(len(content) for _, _, content in files) and stored_ok)
+        self.log_test_result("Multipart JSON summary", "both files stored and listed, both fields",
+                             status or error, passed, "" if passed else response[:400])
+        for _, name, _ in files:
+            self.send_http_request("DELETE", f"/upload/{name}")
+    
+    def run_resumable_put_tests(self):
+        """Run Content-Range PUT tests (22-24) against /upload"""
+        print("\n🧪 RESUMABLE PUT TESTS")
+        
+        # Test 22: First half of an upload, then a status query
+        print("\n22. Partial PUT and status query")
+        self.send_http_request("DELETE", "/upload/phase2_resume.txt")
+        response = self.send_http_request("PUT", "/upload/phase2_resume.txt",
+                                          headers={'Content-Range': 'bytes 0-9/20'}, body="0123456789")
+        status, headers, body, error = self.parse_response(response)
+        first_ok = not error and "204" in status
+        response = self.send_http_request("PUT", "/upload/phase2_resume.txt",
+                                          headers={'Content-Range': 'bytes */20', 'Content-Length': '0'})
+        status, headers, body, error = self.parse_response(response)
+        passed = first_ok and not error and "204" in status and headers.get('Range') == "bytes=0-9"
+        self.log_test_result("Partial PUT", "204 with Range: bytes=0-9",
+                             status or error, passed, "" if passed else response[:200])
+        
+        # Test 23: Resume with the second half
+        print("\n23. Resume a partial PUT")
+        response = self.send_http_request("PUT", "/upload/phase2_resume.txt",
+                                          headers={'Content-Range': 'bytes 10-19/20'}, body="abcdefghij")
+        status, headers, body, error = self.parse_response(response)
+        completed = not error and "201" in status
+        response = self.send_http_request("GET", "/upload/phase2_resume.txt")
+        status, headers, body, error = self.parse_response(response)
+        passed = completed and not error and "200" in status and body == "0123456789abcdefghij"
+        self.log_test_result("Resume PUT", "201, then the whole file", status or error, passed,
+                             "" if passed else response[:200])
+        self.send_http_request("DELETE", "/upload/phase2_resume.txt")
+        
+        # Test 24: A range past the committed bytes
+        print("\n24. PUT with a range past the committed bytes")
+        response = self.send_http_request("PUT", "/upload/phase2_gap.txt",
+                                          headers={'Content-Range': 'bytes 10-14/20'}, body="abcde")
+        status, headers, body, error = self.parse_response(response)
+        refused = not error and "416" in status
+        # The refused request must not leave a part file that looks like an upload in progress
+        response = self.send_http_request("PUT", "/upload/phase2_gap.txt",
+                                          headers={'Content-Range': 'bytes */20', 'Content-Length': '0'})
+        status, headers, body, error = self.parse_response(response)
+        passed = (refused and not error and "204" in status and 'Range' not in headers and
+                  not os.path.exists("www/upload/phase2_gap.txt.part"))
+        self.log_test_result("PUT bad range", "416, nothing committed", status or error, passed,
+                             "" if passed else response[:200])
+    
+    def run_put_conflict_tests(self):
+        """Run concurrent PUT tests (27) against /upload"""
+        print("\n🧪 CONCURRENT PUT TESTS")
+        
+        # Test 27: A second PUT to a target another upload is writing
+        print("\n27. PUT to a target that is being uploaded")
+        first = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        first.settimeout(10)
+        try:
+            first.connect((self.host, self.port))
+            first.sendall((f"PUT /upload/phase2_locked.txt HTTP/1.1\r\nHost: {self.host}:{self.port}\r\n"
+                           "Content-Length: 10\r\nConnection: close\r\n\r\nfirst").encode())
+            time.sleep(0.3)
+            response = self.send_http_request("PUT", "/upload/phase2_locked.txt", body="second")
+            status, headers, body, error = self.parse_response(response)
+            refused = not error and "409" in status
+            first.sendall(b"-half")
+            first_status = first.recv(8192).decode(errors='replace').split('\r\n')[0]
+        except Exception as e:
+            refused = False
+            first_status = f"ERROR: {e}"
+        finally:
+            first.close()
+        response = self.send_http_request("GET", "/upload/phase2_locked.txt")
+        status, headers, body, error = self.parse_response(response)
+        passed = refused and "201" in first_status and not error and body == "first-half"
+        self.log_test_result("Concurrent PUT", "409 for the second, first stored", first_status, passed,
+                             "" if passed else response[:200])
+        self.send_http_request("DELETE", "/upload/phase2_locked.txt")
+    
+    def run_digest_tests(self):
+        """Run upload digest tests (25-26) against /upload"""
+        print("\n🧪 UPLOAD DIGEST TESTS")
+        content = "digest checked content\n"
+        digest = base64.b64encode(hashlib.sha256(content.encode()).digest()).decode()
+        
+        # Test 25: Matching Content-Digest, answered with the same digest
+        print("\n25. PUT with a matching Content-Digest")
+        response = self.send_http_request("PUT", "/upload/phase2_digest.txt",
+                                          headers={'Content-Digest': f"sha-256=:{digest}:"}, body=content)
+        status, headers, body, error = self.parse_response(response)
+        passed = (not error and "201" in status and
+                  headers.get('Repr-Digest', '').startswith(f"sha-256=:{digest}:"))
+        self.log_test_result("Matching digest", "201 with the same sha-256", status or error, passed,
+                             "" if passed else response[:300])
+        self.send_http_request("DELETE", "/upload/phase2_digest.txt")
+        
+        # Test 26: Body that does not match its Content-Digest
+        print("\n26. PUT with a mismatching Content-Digest")
+        response = self.send_http_request("PUT", "/upload/phase2_digest.txt",
+                                          headers={'Content-Digest': f"sha-256=:{digest}:"},
+                                          body=content.upper())
+        status, headers, body, error = self.parse_response(response)
+        response = self.send_http_request("GET", "/upload/phase2_digest.txt")
+        stored_status, _, _, _ = self.parse_response(response)
+        passed = not error and "400" in status and stored_status and "404" in stored_status
+        self.log_test_result("Digest mismatch", "400, nothing stored", status or error, passed)
+    
+    def run_static_tests(self):
+        """Run listing, preload and bundle tests (32-39) against test/test_phase2_static.conf"""
+        print("\n🧪 STATIC SERVING TESTS")
+        fixtures = "/tmp/webserv-phase2"
+        shutil.rmtree(fixtures, ignore_errors=True)
+        # Long names, so the listing spans several of the server's chunks
+        names = [f"entry_{i:04d}_" + "x" * 80 + ".txt" for i in range(600)]
+        os.makedirs(f"{fixtures}/listing/subdir")
+        for name in reversed(names):
+            open(f"{fixtures}/listing/{name}", "w").close()
+        os.makedirs(f"{fixtures}/preload")
+        with open(f"{fixtures}/preload/index.html", "w") as index_file:
+            index_file.write("<p>preloaded index</p>\n")
+        with open(f"{fixtures}/preload/page.txt", "w") as page_file:
+            page_file.write("preloaded page\n")
+        stylesheet = ("body { margin: 0; }\n" * 400).encode()
+        os.makedirs(f"{fixtures}/site")
+        with open(f"{fixtures}/site/style.css", "wb") as css_file:
+            css_file.write(stylesheet)
+        with open(f"{fixtures}/site/style.css.gz", "wb") as gz_file:
+            gz_file.write(gzip.compress(stylesheet))
+        with open(f"{fixtures}/site/index.html", "w") as index_file:
+            index_file.write("<p>bundled index</p>\n")
+        packed = subprocess.run(['./webserv-pack', '-z', '-p', '/bundle', f"{fixtures}/site",
+                                 f"{fixtures}/site.pack"], stdout=subprocess.DEVNULL).returncode == 0
+        # test/test_phase2_static.conf listens next to the server under test
+        static = WebservPhase2Tester(self.host, 8081, 'test/test_phase2_static.conf')
+        try:
+            if not static.start_server():
+                self.log_test_result("Static server", "started", "not started", False)
+                return
+            
+            # Test 32: JSON listing, sorted, sent as several chunks
+            print("\n32. Chunked JSON directory listing")
+            response = static.send_until_close(
+                f"GET /listing/ HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            listing, chunks = self.decode_chunked(body) if not error else (None, 0)
+            try:
+                entries = json.loads(listing) if listing is not None else None
+            except ValueError:
+                entries = None
+            expected = [{"name": name, "type": "file"} for name in names] + [{"name": "subdir", "type": "directory"}]
+            passed = (not error and "200" in status and headers.get('Transfer-Encoding') == "chunked" and
+                      chunks > 1 and entries == expected)
+            self.log_test_result("Chunked JSON listing", "601 sorted entries in several chunks",
+                                 f"{status or error}, {chunks} chunks", passed,
+                                 "" if passed else response[:300])
+            
+            # Test 33: The same listing for HTTP/1.0, with a Content-Length
+            print("\n33. JSON directory listing over HTTP/1.0")
+            response = static.send_until_close(f"GET /listing/ HTTP/1.0\r\nHost: {self.host}:8081\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = (not error and "200" in status and 'Transfer-Encoding' not in headers and
+                      headers.get('Content-Length') == str(len(body.encode())) and
+                      listing is not None and body == listing)
+            self.log_test_result("HTTP/1.0 JSON listing", "same listing with Content-Length", status or error,
+                                 passed, "" if passed else response[:300])
+            
+            # Test 34: Preloaded file and directory index
+            print("\n34. Preloaded file and index")
+            response = static.send_until_close(
+                f"GET /preload/page.txt HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            page_ok = (not error and "200" in status and body == "preloaded page\n" and
+                       headers.get('Content-Type', '').startswith("text/plain"))
+            response = static.send_until_close(
+                f"GET /preload/ HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = page_ok and not error and "200" in status and body == "<p>preloaded index</p>\n"
+            self.log_test_result("Preloaded file", "200 with the file, and the index for /", status or error,
+                                 passed, "" if passed else response[:300])
+            
+            # Test 35: A preloaded file that changed on disk is served fresh
+            print("\n35. Preloaded file changed on disk")
+            with open(f"{fixtures}/preload/page.txt", "w") as page_file:
+                page_file.write("changed page, longer than before\n")
+            time.sleep(0.5)
+            response = static.send_until_close(
+                f"GET /preload/page.txt HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = not error and "200" in status and body == "changed page, longer than before\n"
+            self.log_test_result("Preload invalidation", "the new content", status or error, passed,
+                                 "" if passed else response[:300])
+            
+            def get_bundled(path, extra_headers=""):
+                response = static.send_until_close(
+                    (f"GET {path} HTTP/1.1\r\nHost: {self.host}:8081\r\n{extra_headers}"
+                     "Connection: close\r\n\r\n").encode(), binary=True)
+                head, _, body = response.partition(b"\r\n\r\n")
+                status, headers, _, error = self.parse_response(head.decode(errors='replace') + "\r\n\r\n")
+                return status or error, headers or {}, body
+            
+            # Test 36: Bundled file and index, without compression
+            print("\n36. Bundled file")
+            status, headers, body = get_bundled("/bundle/style.css")
+            identity_etag = headers.get('ETag', '')
+            file_ok = (packed and "200" in status and body == stylesheet and identity_etag != "" and
+                       'Content-Encoding' not in headers and headers.get('Vary') == "Accept-Encoding")
+            status, headers, body = get_bundled("/bundle/")
+            passed = file_ok and "200" in status and body == b"<p>bundled index</p>\n"
+            self.log_test_result("Bundled file", "200 with the file, and the index for /", status, passed)
+            
+            # Test 37: The gzip variant, when Accept-Encoding allows it
+            print("\n37. Bundled gzip variant")
+            status, headers, body = get_bundled("/bundle/style.css", "Accept-Encoding: br, gzip;q=0.8\r\n")
+            try:
+                unpacked = gzip.decompress(body)
+            except (OSError, EOFError):
+                unpacked = None
+            gzip_etag = headers.get('ETag', '')
+            passed = ("200" in status and headers.get('Content-Encoding') == "gzip" and unpacked == stylesheet and
+                      gzip_etag not in ("", identity_etag))
+            self.log_test_result("Bundled gzip", "gzip body with its own ETag", status, passed)
+            
+            # Test 38: gzip refused with q=0
+            print("\n38. Bundled file with gzip;q=0")
+            status, headers, body = get_bundled("/bundle/style.css", "Accept-Encoding: gzip;q=0, identity\r\n")
+            passed = "200" in status and 'Content-Encoding' not in headers and body == stylesheet
+            self.log_test_result("Bundled gzip;q=0", "identity body", status, passed)
+            
+            # Test 39: Conditional requests get 304 for the matching representation only
+            print("\n39. Bundled file with If-None-Match")
+            status, headers, body = get_bundled("/bundle/style.css", f"If-None-Match: {identity_etag}\r\n")
+            not_modified = "304" in status and body == b"" and headers.get('ETag') == identity_etag
+            status, headers, body = get_bundled("/bundle/style.css",
+                                                f"If-None-Match: {identity_etag}\r\nAccept-Encoding: gzip\r\n")
+            passed = not_modified and "200" in status and headers.get('Content-Encoding') == "gzip"
+            self.log_test_result("Bundled 304", "304, then 200 for the gzip variant", status, passed)
+        finally:
+            static.stop_server()
+            shutil.rmtree(fixtures, ignore_errors=True)
+    
+    def run_cgi_tests(self):
+        """Run CGI tests (41-42) against cgi-bin/slow.py"""
+        print("\n🧪 CGI TESTS")
+        request = (f"GET /cgi-bin/slow.py HTTP/1.1\r\nHost: {self.host}:{self.port}\r\n"
+                   "Connection: close\r\n\r\n").encode()
+        
+        # Test 41: Other clients are served while a script runs
+        print("\n41. Static request during a slow CGI script")
+        slow = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        slow.settimeout(10)
+        try:
+            slow.connect((self.host, self.port))
+            slow.sendall(request)
+            time.sleep(0.2)
+            started = time.time()
+            response = self.send_http_request("GET", "/")
+            elapsed = time.time() - started
+            status, headers, body, error = self.parse_response(response)
+            script_output = b""
+            while True:
+                chunk = slow.recv(8192)
+                if not chunk:
+                    break
+                script_output += chunk
+        except Exception as e:
+            status, error, elapsed, script_output = None, f"ERROR: {e}", 0, b""
+        finally:
+            slow.close()
+        passed = (not error and "200" in status and elapsed < 1.0 and
+                  b"200" in script_output.split(b"\r\n")[0] and b"line 4" in script_output)
+        self.log_test_result("CGI does not block", "GET / answered within 1s, script completes",
+                             f"{status or error} in {elapsed:.2f}s", passed)
+        
+        # Test 42: Script output reaches the client as it is written
+        print("\n42. Streamed CGI output")
+        slow = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        slow.settimeout(10)
+        first_at = None
+        response = b""
+        try:
+            slow.connect((self.host, self.port))
+            started = time.time()
+            slow.sendall(request)
+            while True:
+                chunk = slow.recv(8192)
+                if not chunk:
+                    break
+                response += chunk
+                if first_at is None and b"line 0" in response:
+                    first_at = time.time() - started
+            total = time.time() - started
+        except Exception as e:
+            total = 0
+            response = f"ERROR: {e}".encode()
+        finally:
+            slow.close()
+        status, headers, body, error = self.parse_response(response.decode(errors='replace'))
+        body, _ = self.decode_chunked(body) if not error else (None, 0)
+        passed = (not error and "200" in status and headers.get('Transfer-Encoding') == "chunked" and
+                  first_at is not None and first_at < total - 1.0 and
+                  body == "".join(f"line {i}\n" for i in range(5)))
+        self.log_test_result("CGI streaming", "first line a second or more before the end",
+                             f"{status or error}, first line at {first_at}", passed,
+                             "" if passed else response[:300].decode(errors='replace'))
+    
+    def run_fastcgi_tests(self):
+        """Run fastcgi_pass tests (28-31) against test/fastcgi_standin.py"""
+        print("\n🧪 FASTCGI TESTS")
+        socket_path = "/tmp/webserv-fcgi.sock"
+        if os.path.exists(socket_path):
+            os.unlink(socket_path)
+        standin = subprocess.Popen([sys.executable, 'test/fastcgi_standin.py', f"unix:{socket_path}"],
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        # test/test_fastcgi.conf listens next to the server under test
+        fastcgi = WebservPhase2Tester(self.host, 8081, 'test/test_fastcgi.conf')
+        try:
+            for _ in range(20):
+                if os.path.exists(socket_path):
+                    break
+                time.sleep(0.1)
+            if not fastcgi.start_server():
+                self.log_test_result("FastCGI server", "started", "not started", False)
+                return
+            
+            # Test 28: GET, with the request variables the worker echoes
+            print("\n28. FastCGI GET")
+            response = fastcgi.send_until_close(
+                (f"GET /app/echo/more?x=1 HTTP/1.1\r\nHost: {self.host}:8081\r\n"
+                 "X-Phase2: yes\r\nConnection: close\r\n\r\n").encode())
+            status, headers, body, error = self.parse_response(response)
+            expected = ["REQUEST_METHOD=GET", "SCRIPT_NAME=/app/echo/more", "PATH_INFO=",
+                        "QUERY_STRING=x=1", "REMOTE_ADDR=127.0.0.1", "HTTP_X_PHASE2=yes"]
+            passed = not error and "200" in status and all(f"\n{line}\n" in f"\n{body}" for line in expected)
+            self.log_test_result("FastCGI GET", "200 with the request variables", status or error, passed,
+                                 "" if passed else response[:600])
+            
+            # Test 29: POST body passed through on stdin
+            print("\n29. FastCGI POST")
+            response = fastcgi.send_until_close(
+                (f"POST /app/echo HTTP/1.1\r\nHost: {self.host}:8081\r\nContent-Type: text/plain\r\n"
+                 "Content-Length: 11\r\nConnection: close\r\n\r\nhello world").encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = (not error and "200" in status and "CONTENT_LENGTH=11" in body and
+                      "body:hello world" in body)
+            self.log_test_result("FastCGI POST", "200 with the body echoed", status or error, passed,
+                                 "" if passed else response[:600])
+            
+            # Test 30: A worker that streams its output
+            print("\n30. FastCGI streamed response")
+            response = fastcgi.send_until_close(
+                f"GET /app/slow HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = not error and "200" in status and all(f"line {i}" in body for i in range(5))
+            self.log_test_result("FastCGI slow", "200 with five lines", status or error, passed,
+                                 "" if passed else response[:600])
+            
+            # Test 31: A worker that fails before any output
+            print("\n31. FastCGI failure")
+            response = fastcgi.send_until_close(
+                f"GET /app/fail HTTP/1.1\r\nHost: {self.host}:8081\r\nConnection: close\r\n\r\n".encode())
+            status, headers, body, error = self.parse_response(response)
+            passed = not error and status and "500" in status
+            self.log_test_result("FastCGI fail", "500 Internal Server Error", status or error, passed)
+        finally:
+            fastcgi.stop_server()
+            standin.terminate()
+            standin.wait()
+    
     def generate_report(self):
         """Generate comprehensive test report"""
         print("\n" + "="*60)
@@ -422,6 +919,13 @@ class WebservPhase2Tester:
             self.run_connection_tests()
             self.run_security_tests()
             self.run_telnet_tests()
+            self.run_multipart_tests()
+            self.run_resumable_put_tests()
+            self.run_digest_tests()
+            self.run_put_conflict_tests()
+            self.run_cgi_tests()
+            self.run_fastcgi_tests()
+            self.run_static_tests()
             
             passed, failed = self.generate_report()
             return failed == 0
@@ -438,7 +942,8 @@ def main():
     print("🧪 WEBSERV PHASE 2 AUTOMATED TEST SUITE")
     print("Testing HTTP server implementation...")
     
-    tester = WebservPhase2Tester()
+    config_file = sys.argv[1] if len(sys.argv) > 1 else 'webserv_demo_simple.conf'
+    tester = WebservPhase2Tester(config_file=config_file)
     success = tester.run_all_tests()
     
     sys.exit(0 if success else 1)